@@ -0,0 +1,24 @@
+#ifndef ACQUISITION_METRICS_HPP
+#define ACQUISITION_METRICS_HPP
+
+// project includes
+#include "latency_histogram.hpp"
+
+// system includes
+#include <atomic>
+#include <cstdint>
+
+/// Counters kept by a Worker as it acquires and stores frames.
+///
+/// Every member is an atomic or a LatencyHistogram, so the worker records
+/// without locking and a metrics scrape can read from any thread.
+struct AcquisitionMetrics {
+  std::atomic<uint64_t> frames_acquired{0}; ///< Frames read out completely.
+  std::atomic<uint64_t> frames_aborted{0}; ///< Frames abandoned before readout ended.
+  std::atomic<uint64_t> fits_bytes{0}; ///< Bytes of FITS files written.
+  LatencyHistogram exposure; ///< Shutter open to shutter closed (ns).
+  LatencyHistogram readout; ///< Readout start to readout end (ns).
+  LatencyHistogram fits_write; ///< Time to write each FITS file (ns).
+}; // struct AcquisitionMetrics
+
+#endif // ACQUISITION_METRICS_HPP
@@ -34,6 +34,10 @@ std::vector<double>Camera::getGainMinMax() {
   return min_max;
 }
 
+double Camera::getGain(niad::CameraReadoutMode readout_mode) {
+  return 0;
+}
+
 niad::CameraSensorType Camera::getSensorType() {
   return mSensorType;
 }
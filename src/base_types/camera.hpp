@@ -86,6 +86,10 @@ public:
   /// \return vector in (min, max) order.
   virtual std::vector<double> getGainMinMax();
 
+  /// Gets the detector gain for a readout mode (electrons / ADU).
+  /// \return The gain, or 0 if the camera does not report it.
+  virtual double getGain(niad::CameraReadoutMode readout_mode);
+
   /// Gets the type of sensor for this camera.
   virtual niad::CameraSensorType getSensorType();
 
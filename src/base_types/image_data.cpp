@@ -8,6 +8,36 @@
 #include <fitsio2.h>
 #include <math.h>
 
+/// Append a mount track to a FITS file as a binary table extension.
+static void writeMountTrack(fitsfile * fptr, const MountTrack & mount_track,
+                            const std::string & t_start, int * status) {
+
+  const char * ttype[] = {"TIME", "RA", "DEC", "AZM", "ALT"};
+  const char * tform[] = {"1D", "1D", "1D", "1D", "1D"};
+  const char * tunit[] = {"s", "deg", "deg", "deg", "deg"};
+  long nrows = mount_track.size();
+
+  fits_create_tbl(fptr, BINARY_TBL, nrows, 5,
+                  (char **) ttype, (char **) tform, (char **) tunit,
+                  "MOUNTTRK", status);
+
+  fits_write_key(fptr, TSTRING, "DATE-BEG", (void *) t_start.c_str(),
+                 "Zero point of the TIME column", status);
+
+  // Each column goes out in a single call.
+  fits_write_col(fptr, TDOUBLE, 1, 1, 1, nrows,
+                 (void *) mount_track.time.data(), status);
+
+  std::vector<double> degrees(nrows);
+  const std::vector<double> * columns[] =
+    {&mount_track.ra, &mount_track.dec, &mount_track.azm, &mount_track.alt};
+  for(int i = 0; i < 4; i++) {
+    const std::vector<double> & radians = *columns[i];
+    for(long j = 0; j < nrows; j++)
+      degrees[j] = radians[j] * 180.0 / M_PI;
+    fits_write_col(fptr, TDOUBLE, i + 2, 1, 1, nrows, degrees.data(), status);
+  }
+}
 
 void ImageData::saveToFITS(std::string filename, bool overwrite) {
 
@@ -67,6 +97,11 @@ void ImageData::saveToFITS(std::string filename, bool overwrite) {
                  "Name of photometric filter used",
                  &status);
 
+  fits_write_key(fptr, TSTRING, "IMAGETYP",
+                 (void*) image_type.c_str(),
+                 "Kind of frame",
+                 &status);
+
 
   //
   // Information about the object
@@ -129,6 +164,50 @@ void ImageData::saveToFITS(std::string filename, bool overwrite) {
                    &status);
   }
 
+  //
+  // Tracking error measured from the mount updates.
+  //
+  if(tracking_samples > 1) {
+    fits_write_key(fptr, TLONG, "TRKNSAMP", (void *) &tracking_samples,
+                   "Mount updates used for tracking statistics", &status);
+    fits_write_key(fptr, TDOUBLE, "TRKRMSRA", (void *) &tracking_rms_ra,
+                   "RMS RA tracking error on sky (arcsec)", &status);
+    fits_write_key(fptr, TDOUBLE, "TRKRMSDE", (void *) &tracking_rms_dec,
+                   "RMS DEC tracking error (arcsec)", &status);
+    fits_write_key(fptr, TDOUBLE, "TRKPKRA", (void *) &tracking_peak_ra,
+                   "Peak RA drift from start on sky (arcsec)", &status);
+    fits_write_key(fptr, TDOUBLE, "TRKPKDE", (void *) &tracking_peak_dec,
+                   "Peak DEC drift from start (arcsec)", &status);
+    fits_write_key(fptr, TDOUBLE, "TRKRTRA", (void *) &tracking_rate_ra,
+                   "RA drift rate on sky (arcsec/s)", &status);
+    fits_write_key(fptr, TDOUBLE, "TRKRTDE", (void *) &tracking_rate_dec,
+                   "DEC drift rate (arcsec/s)", &status);
+    int flagged = tracking_flagged;
+    fits_write_key(fptr, TLOGICAL, "TRKFLAG", (void *) &flagged,
+                   "Tracking error exceeded threshold", &status);
+  }
+
+  //
+  // Image processing applied after readout.
+  //
+  if(defects_corrected >= 0) {
+    fits_write_key(fptr, TLONG, "DEFCORR",
+                   (void *) &defects_corrected,
+                   "Pixels repaired using the defect map",
+                   &status);
+  }
+
+  if(cosmic_ray_hits >= 0) {
+    fits_write_key(fptr, TLONG, "CRHITS",
+                   (void *) &cosmic_ray_hits,
+                   "Cosmic ray hits removed from the image",
+                   &status);
+  }
+
+  // Append the mount track as a binary table after all image keywords.
+  if(mount_track.size() > 0)
+    writeMountTrack(fptr, mount_track, t_start, &status);
+
   // close the file
   fits_close_file(fptr, &status);
 }
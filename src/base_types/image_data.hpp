@@ -5,6 +5,24 @@
 #include <vector>
 #include <string>
 
+/// Mount positions reported while an image was being taken, stored by column.
+/// Samples report either RA/DEC or AZM/ALT; the other pair is NaN.
+struct MountTrack {
+  std::vector<double> time; ///< Time of the sample relative to exposure_start (seconds).
+  std::vector<double> ra;   ///< RA of the mount (radians).
+  std::vector<double> dec;  ///< DEC of the mount (radians).
+  std::vector<double> azm;  ///< AZM of the mount (radians).
+  std::vector<double> alt;  ///< ALT of the mount (radians).
+
+  /// Number of samples in the track.
+  size_t size() const { return time.size(); }
+
+  /// Reserve space for the specified number of samples.
+  void reserve(size_t n) {
+    time.reserve(n); ra.reserve(n); dec.reserve(n); azm.reserve(n); alt.reserve(n);
+  }
+};
+
 /// A class for storing and managing image data.
 class ImageData {
 
@@ -18,6 +36,7 @@ public:
   // exposure information
   std::string filter_name = "";   ///< Name of photometric filter
   std::string detector_name = ""; ///< Name of detector/camera
+  std::string image_type = "LIGHT"; ///< Kind of frame, e.g. LIGHT or BIAS
 
   /// Time at which the exposure began.
   std::chrono::time_point<std::chrono::high_resolution_clock> exposure_start;
@@ -55,6 +74,22 @@ public:
   double azm       = 0; ///< AZM coordinate of the image center (radians).
   double alt       = 0; ///< ALT coordinate of the image center (radians).
 
+  MountTrack mount_track; ///< Mount positions during the exposure.
+
+  // tracking information, from RA/DEC updates during the exposure
+  long   tracking_samples  = 0; ///< Number of RA/DEC updates used (0 if none).
+  double tracking_rms_ra   = 0; ///< RMS scatter of RA on the sky (arcsec).
+  double tracking_rms_dec  = 0; ///< RMS scatter of DEC (arcsec).
+  double tracking_peak_ra  = 0; ///< Largest RA offset from the start, on the sky (arcsec).
+  double tracking_peak_dec = 0; ///< Largest DEC offset from the start (arcsec).
+  double tracking_rate_ra  = 0; ///< RA drift rate on the sky (arcsec/s).
+  double tracking_rate_dec = 0; ///< DEC drift rate (arcsec/s).
+  bool   tracking_flagged  = false; ///< Whether tracking error exceeded the threshold.
+
+  // processing information
+  long defects_corrected = -1; ///< Pixels repaired using a defect map (-1 if not applied).
+  long cosmic_ray_hits   = -1; ///< Cosmic rays removed from the image (-1 if not applied).
+
 
 public:
   /// Default constructor.
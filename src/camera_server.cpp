@@ -0,0 +1,353 @@
+#include "camera_server.hpp"
+
+// system includes
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+CameraServer::CameraServer(Worker * worker)
+  : mWorker(worker),
+    mServer("camera-controller", QWebSocketServer::NonSecureMode) {
+
+  connect(&mServer, &QWebSocketServer::newConnection,
+          this, &CameraServer::onNewConnection);
+
+  // Progress reports arrive from the worker thread as queued signals.
+  connect(mWorker, &Worker::initialized, this, &CameraServer::onInitialized);
+  connect(mWorker, &Worker::exposureStarted, this, &CameraServer::onExposureStarted);
+  connect(mWorker, &Worker::exposureFinished, this, &CameraServer::onExposureFinished);
+  connect(mWorker, &Worker::sequenceFinished, this, &CameraServer::onSequenceFinished);
+
+  mTemperatureTimer.setInterval(10000);
+  connect(&mTemperatureTimer, &QTimer::timeout, this, &CameraServer::pollTemperature);
+}
+
+CameraServer::~CameraServer() {
+  for(auto client: mClients)
+    client->deleteLater();
+}
+
+bool CameraServer::listen(quint16 port) {
+  if(!mServer.listen(QHostAddress::Any, port)) {
+    qCritical() << "Could not listen on port" << port << ":" << mServer.errorString();
+    return false;
+  }
+  qInfo() << "Camera server listening on" << mServer.serverUrl().toString();
+  mTemperatureTimer.start();
+  return true;
+}
+
+void CameraServer::send(QWebSocket * client, const QJsonObject & message) {
+  client->sendTextMessage(QString::fromUtf8(QJsonDocument(message).toJson(QJsonDocument::Compact)));
+}
+
+void CameraServer::broadcast(const QJsonObject & message) {
+  // The hub keeps a slow client from delaying the others.
+  mHub.publishStatus(QString::fromUtf8(QJsonDocument(message).toJson(QJsonDocument::Compact)));
+}
+
+QJsonObject CameraServer::makeError(const QString & request, const QString & reason) {
+  QJsonObject r;
+  r["type"] = "error";
+  r["request"] = request;
+  r["reason"] = reason;
+  return r;
+}
+
+QJsonObject CameraServer::makeInfo() {
+  QJsonObject r;
+  r["type"] = "info";
+  r["device_type"] = QString::fromStdString(niad::DeviceType_Name(niad::DEVICE_TYPE_CAMERA));
+
+  auto camera = mWorker->getCamera();
+  if(camera == nullptr)
+    return r;
+
+  // getCamera() returns nullptr until the worker has finished initializing;
+  // from then on these values are fixed and can be read from this thread.
+  r["name"] = QString::fromStdString(camera->getName());
+
+  QJsonArray capabilities;
+  for(auto c: camera->getCapabilities())
+    capabilities.append(QString::fromStdString(niad::CameraCapability_Name(c)));
+  r["capabilities"] = capabilities;
+
+  QJsonArray readout_modes;
+  for(auto m: camera->getReadoutModes())
+    readout_modes.append(QString::fromStdString(niad::CameraReadoutMode_Name(m)));
+  r["readout_modes"] = readout_modes;
+
+  auto exposure = camera->getExposureMinMax();
+  r["exposure_min"] = exposure[0];
+  r["exposure_max"] = exposure[1];
+
+  QJsonArray pixel_count;
+  for(auto n: camera->getPixelCount())
+    pixel_count.append(qint64(n));
+  r["pixel_count"] = pixel_count;
+
+  auto filter_wheel = mWorker->getFilterWheel();
+  if(filter_wheel != nullptr) {
+    QJsonArray filters;
+    for(auto & f: filter_wheel->getFilterNames())
+      filters.append(QString::fromStdString(f));
+    r["filters"] = filters;
+  }
+
+  return r;
+}
+
+QJsonObject CameraServer::makeStatus() {
+  QJsonObject r;
+  r["type"] = "status";
+  r["state"] = mState;
+  if(mState == "exposing") {
+    r["exposure"] = mExposureIndex;
+    r["quantity"] = mExposureQuantity;
+    r["duration"] = mExposureDuration;
+  }
+  if(!mLastFilename.isEmpty())
+    r["last_file"] = mLastFilename;
+  if(!std::isnan(mTemperature))
+    r["temperature"] = mTemperature;
+  return r;
+}
+
+QJsonObject CameraServer::makeTemperatureHistory() {
+
+  // Columns rather than one object per reading keep a night's history small.
+  QJsonArray time, ccd, setpoint, heatsink, ambient, fan_power, cooler_power;
+  for(auto & sample: mWorker->getTemperatureHistory()) {
+    time.append(double(std::chrono::duration_cast<std::chrono::milliseconds>(
+      sample.time.time_since_epoch()).count()) * 1E-3);
+    ccd.append(sample.info.main_camera_temperature);
+    setpoint.append(sample.info.main_camera_temperature_setpoint);
+    heatsink.append(sample.info.heatsink_temperature);
+    ambient.append(sample.info.ambient_temperature);
+    fan_power.append(sample.info.fan_percent_power);
+    cooler_power.append(sample.info.cooler_percent_power);
+  }
+
+  QJsonObject r;
+  r["type"] = "temperature_history";
+  r["time"] = time;
+  r["ccd"] = ccd;
+  r["setpoint"] = setpoint;
+  r["heatsink"] = heatsink;
+  r["ambient"] = ambient;
+  r["fan_power"] = fan_power;
+  r["cooler_power"] = cooler_power;
+  return r;
+}
+
+QString CameraServer::startSequence(const QJsonObject & request) {
+
+  if(mState != "idle")
+    return "camera is " + mState;
+
+  int quantity = request["quantity"].toInt(1);
+  double duration = request["duration"].toDouble(-1);
+  if(quantity < 1)
+    return "quantity must be positive";
+  auto camera = mWorker->getCamera();
+  if(camera == nullptr)
+    return "camera is not initialized";
+  auto limits = camera->getExposureMinMax();
+  if(duration < limits[0] || duration > limits[1])
+    return "duration outside of camera limits";
+
+  niad::CameraReadoutMode readout_mode = niad::CAMERA_READOUT_MODE_1X1;
+  bool set_readout_mode = request.contains("readout_mode");
+  if(set_readout_mode &&
+     !niad::CameraReadoutMode_Parse(request["readout_mode"].toString().toStdString(),
+                                    &readout_mode))
+    return "unknown readout_mode";
+
+  niad::CameraShutterAction shutter_action = niad::CAMERA_SHUTTER_ACTION_OPEN_CLOSE;
+  bool set_shutter_action = request.contains("shutter_action");
+  if(set_shutter_action &&
+     !niad::CameraShutterAction_Parse(request["shutter_action"].toString().toStdString(),
+                                      &shutter_action))
+    return "unknown shutter_action";
+
+  niad::CameraImageAction image_action = niad::CAMERA_IMAGE_ACTION_STORE;
+  bool set_image_action = request.contains("image_action");
+  if(set_image_action &&
+     !niad::CameraImageAction_Parse(request["image_action"].toString().toStdString(),
+                                    &image_action))
+    return "unknown image_action";
+
+  // An abort that arrives before the worker starts the sequence must still
+  // stop it, so the flag is cleared here rather than in the worker.
+  mWorker->clearStop();
+
+  // Configure and start the sequence in the worker thread. Settings that
+  // were not specified keep their previous values.
+  Worker * worker = mWorker;
+  QMetaObject::invokeMethod(mWorker, [=]() {
+      worker->setExposureQuantity(quantity);
+      worker->setExposureDuration(duration);
+      if(request.contains("filter"))
+        worker->setFilter(request["filter"].toString());
+      if(request.contains("catalog"))
+        worker->setCatalogName(request["catalog"].toString());
+      if(request.contains("object"))
+        worker->setObjectName(request["object"].toString());
+      if(set_readout_mode)
+        worker->setReadoutMode(readout_mode);
+      if(set_shutter_action)
+        worker->setShutterAction(shutter_action);
+      if(set_image_action)
+        worker->setImageAction(image_action);
+      worker->runSequence();
+    }, Qt::QueuedConnection);
+
+  mState = "exposing";
+  mExposureIndex = -1;
+  mExposureQuantity = quantity;
+  mExposureDuration = duration;
+  return QString();
+}
+
+void CameraServer::onNewConnection() {
+  QWebSocket * client = mServer.nextPendingConnection();
+  connect(client, &QWebSocket::textMessageReceived,
+          this, &CameraServer::processTextMessage);
+  connect(client, &QWebSocket::disconnected,
+          this, &CameraServer::onDisconnected);
+  mClients.append(client);
+  mHub.addSubscriber(client);
+  qInfo() << "Camera client connected from" << client->peerAddress().toString();
+
+  // Announce the camera to NIAD clients.
+  niad::Envelope e;
+  e.mutable_device_envelope()->add_info()->set_type(niad::DEVICE_TYPE_CAMERA);
+  QByteArray data(e.ByteSizeLong(), Qt::Uninitialized);
+  e.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t*>(data.data()));
+  client->sendBinaryMessage(data);
+
+  send(client, makeStatus());
+}
+
+void CameraServer::onDisconnected() {
+  QWebSocket * client = qobject_cast<QWebSocket *>(sender());
+  mClients.removeAll(client);
+  mHub.removeSubscriber(client);
+  client->deleteLater();
+  qInfo() << "Camera client disconnected";
+}
+
+void CameraServer::processTextMessage(const QString & message) {
+  QWebSocket * client = qobject_cast<QWebSocket *>(sender());
+
+  QJsonParseError error;
+  QJsonDocument doc = QJsonDocument::fromJson(message.toUtf8(), &error);
+  if(!doc.isObject()) {
+    send(client, makeError("", error.errorString()));
+    return;
+  }
+
+  QJsonObject request = doc.object();
+  QString type = request["request"].toString();
+
+  if(type == "info") {
+    send(client, makeInfo());
+  } else if(type == "status") {
+    send(client, makeStatus());
+  } else if(type == "temperature_history") {
+    // The history is safe to read from this thread once initialized.
+    if(mState == "initializing")
+      send(client, makeError(type, "camera is " + mState));
+    else
+      send(client, makeTemperatureHistory());
+  } else if(type == "expose") {
+    QString reason = startSequence(request);
+    if(!reason.isEmpty())
+      send(client, makeError(type, reason));
+    else
+      broadcast(makeStatus());
+  } else if(type == "subscribe") {
+    QString frames = request["frames"].toString();
+    if(frames == "latest") {
+      mHub.setPolicy(client, FanoutHub::POLICY_LATEST_ONLY);
+    } else if(frames == "lossless") {
+      mHub.setPolicy(client, FanoutHub::POLICY_LOSSLESS);
+    } else if(frames == "none") {
+      mHub.setPolicy(client, FanoutHub::POLICY_NONE);
+    } else {
+      send(client, makeError(type, "unknown frames policy"));
+    }
+  } else if(type == "abort") {
+    // Safe from any thread; the worker checks the flag between frames and the
+    // driver aborts the exposure in progress.
+    mWorker->stopExposures();
+  } else if(type == "set_filter" || type == "set_temperature") {
+    if(mState != "idle") {
+      send(client, makeError(type, "camera is " + mState));
+      return;
+    }
+    Worker * worker = mWorker;
+    if(type == "set_filter") {
+      QString filter = request["filter"].toString();
+      QMetaObject::invokeMethod(mWorker, [=]() { worker->applyFilter(filter); },
+                                Qt::QueuedConnection);
+    } else {
+      double temperature = request["temperature"].toDouble(100);
+      QMetaObject::invokeMethod(mWorker, [=]() { worker->applyTemperature(temperature); },
+                                Qt::QueuedConnection);
+    }
+  } else {
+    send(client, makeError(type, "unknown request"));
+  }
+}
+
+void CameraServer::onInitialized(bool success) {
+  mState = success ? "idle" : "error";
+  broadcast(makeStatus());
+}
+
+void CameraServer::onExposureStarted(int index, int quantity, double duration) {
+  mState = "exposing";
+  mExposureIndex = index;
+  mExposureQuantity = quantity;
+  mExposureDuration = duration;
+  broadcast(makeStatus());
+}
+
+void CameraServer::onExposureFinished(int index, bool success, QString filename,
+                                      double temperature) {
+  mLastFilename = filename;
+  mTemperature = temperature;
+
+  QJsonObject r;
+  r["type"] = "exposure";
+  r["exposure"] = index;
+  r["success"] = success;
+  r["file"] = filename;
+  r["temperature"] = temperature;
+  broadcast(r);
+}
+
+void CameraServer::onSequenceFinished(int completed) {
+  mState = "idle";
+  QJsonObject r = makeStatus();
+  r["completed"] = completed;
+  broadcast(r);
+}
+
+void CameraServer::pollTemperature() {
+  if(mState != "idle" || mClients.isEmpty())
+    return;
+
+  // Read the temperature in the worker thread so this thread never waits on
+  // the driver, then report it from here.
+  Worker * worker = mWorker;
+  CameraServer * server = this;
+  QMetaObject::invokeMethod(mWorker, [=]() {
+      double temperature = worker->getSensorTemperature();
+      QMetaObject::invokeMethod(server, [=]() {
+          server->mTemperature = temperature;
+          server->broadcast(server->makeStatus());
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
@@ -0,0 +1,117 @@
+#ifndef CAMERA_SERVER_HPP
+#define CAMERA_SERVER_HPP
+
+// local includes
+#include "worker.hpp"
+#include "fanout_hub.hpp"
+
+// system includes
+#include <QObject>
+#include <QJsonObject>
+#include <QList>
+#include <QTimer>
+#include <QWebSocket>
+#include <QWebSocketServer>
+#include <cmath>
+
+/// Serves the camera to remote NIAD clients so that exposure sequences can be
+/// scheduled without restarting the application.
+///
+/// New connections receive a DeviceEnvelope announcing a DEVICE_TYPE_CAMERA.
+/// Camera control uses JSON text messages, each an object with a "request"
+/// member:
+///
+///   {"request": "info"}
+///   {"request": "status"}
+///   {"request": "expose", "quantity": 10, "duration": 30, "filter": "Red",
+///    "readout_mode": "CAMERA_READOUT_MODE_1X1",
+///    "shutter_action": "CAMERA_SHUTTER_ACTION_OPEN_CLOSE",
+///    "image_action": "CAMERA_IMAGE_ACTION_STORE",
+///    "catalog": "HD", "object": "1234"}
+///   {"request": "abort"}
+///   {"request": "set_filter", "filter": "Red"}
+///   {"request": "set_temperature", "temperature": -20}
+///   {"request": "subscribe", "frames": "latest" | "lossless" | "none"}
+///   {"request": "temperature_history"}
+///
+/// Every optional member of "expose" keeps its previous value when omitted.
+/// Status events ({"type": "status", ...}) are broadcast to all clients as the
+/// sequence progresses and periodically with the sensor temperature. Clients
+/// that subscribe to frames also receive each image (see FanoutHub).
+class CameraServer : public QObject {
+  Q_OBJECT;
+
+public:
+  /// Default constructor
+  /// \param worker Worker that controls the camera. Not owned. Lives in
+  ///        another thread; it is only accessed through queued calls.
+  CameraServer(Worker * worker);
+  /// Default destructor.
+  ~CameraServer();
+
+protected:
+  Worker * mWorker = nullptr; ///< Camera worker.
+
+  QWebSocketServer mServer; ///< Listening socket.
+  QList<QWebSocket *> mClients; ///< Connected clients. Owned.
+  FanoutHub mHub; ///< Delivers status messages and frames to the clients.
+
+  QTimer mTemperatureTimer; ///< Drives periodic temperature reports.
+
+  /// State of the camera: "initializing", "idle", "exposing", or "error".
+  QString mState = "initializing";
+  int mExposureIndex = -1; ///< Exposure in progress within the sequence.
+  int mExposureQuantity = 0; ///< Exposures in the current sequence.
+  double mExposureDuration = 0; ///< Duration of the exposure in progress.
+  QString mLastFilename; ///< File written for the last exposure.
+  double mTemperature = NAN; ///< Last sensor temperature (Celsius).
+
+protected:
+  /// Send a JSON object to one client.
+  void send(QWebSocket * client, const QJsonObject & message);
+
+  /// Send a JSON object to all clients.
+  void broadcast(const QJsonObject & message);
+
+  /// Build a response describing an error.
+  QJsonObject makeError(const QString & request, const QString & reason);
+
+  /// Build a description of the camera and filter wheel.
+  QJsonObject makeInfo();
+
+  /// Build a status message from the current state.
+  QJsonObject makeStatus();
+
+  /// Build a message holding every background temperature reading.
+  QJsonObject makeTemperatureHistory();
+
+  /// Start an exposure sequence described by a JSON request.
+  /// \return Error message, empty on success.
+  QString startSequence(const QJsonObject & request);
+
+protected slots:
+  void onNewConnection();
+  void onDisconnected();
+  void processTextMessage(const QString & message);
+
+  void onInitialized(bool success);
+  void onExposureStarted(int index, int quantity, double duration);
+  void onExposureFinished(int index, bool success, QString filename, double temperature);
+  void onSequenceFinished(int completed);
+
+  /// Ask the worker for the sensor temperature, if it is idle.
+  void pollTemperature();
+
+public:
+  /// Start listening for clients.
+  /// \param port TCP port.
+  /// \return True on success.
+  bool listen(quint16 port);
+
+  /// Get the hub that distributes frames to the clients.
+  FanoutHub & getHub() { return mHub; }
+
+  //
+}; // CameraServer
+
+#endif // CAMERA_SERVER_HPP
@@ -1,7 +1,27 @@
 #include "client.hpp"
 
-Client::Client() {
-  mBufferValues = false;
+#include <QDataStream>
+#include <QDebug>
+#include <QSemaphore>
+#include <QThread>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <memory>
+
+Client::Client()
+  : mImageSender(&mWebSocket),
+    mCoordinateRing(65536),
+    mBufferStart(0),
+    mBufferEnd(0),
+    mMountIsReady(false),
+    mArenaBlock(16 * 1024),
+    mSamplesLost(0) {
+
+  mReconnectTimer.setSingleShot(true);
+  connect(&mReconnectTimer, &QTimer::timeout, this, &Client::reconnect);
+  connect(&mStatsTimer, &QTimer::timeout, this, &Client::logStatistics);
 }
 
 Client::~Client() {
@@ -10,6 +30,13 @@ Client::~Client() {
 
 void Client::open(const QString & url) {
 
+  // Every camera shares one connection to the mount. Without a URL there is
+  // no mount, e.g. when the configuration file does not name one.
+  if(mOpened || url.isEmpty())
+    return;
+
+  mOpened = true;
+  mUrl = url;
   mWebSocket.open(url);
 
   // connect signals and slots
@@ -17,23 +44,56 @@ void Client::open(const QString & url) {
           this, &Client::onWebSocketConnect);
   connect(&mWebSocket, &QWebSocket::disconnected,
           this, &Client::onWebSocketDisconnect);
+  connect(&mWebSocket, &QWebSocket::stateChanged,
+          this, &Client::onWebSocketStateChanged);
   connect(&mWebSocket, &QWebSocket::textMessageReceived,
           this, &Client::processTextMessage);
   connect(&mWebSocket, &QWebSocket::binaryMessageReceived,
           this, &Client::processBinaryMessage);
+  connect(&mWebSocket, &QWebSocket::connected,
+          &mImageSender, &ImageSender::onConnected);
+  connect(&mWebSocket, &QWebSocket::disconnected,
+          &mImageSender, &ImageSender::onDisconnected);
 }
 
-void Client::send(niad::Envelope e) {
-  QByteArray data(e.SerializeAsString().c_str(), e.ByteSize());
-  mWebSocket.sendBinaryMessage(data);
+void Client::send(const niad::Envelope & e) {
+  // Compute the size once and serialize straight into a buffer that keeps
+  // its capacity between messages.
+  size_t size = e.ByteSizeLong();
+  mEncodeBuffer.resize(size);
+  e.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t*>(mEncodeBuffer.data()));
+  mWebSocket.sendBinaryMessage(mEncodeBuffer);
 }
 
 void Client::onWebSocketConnect(){
   qDebug() << "WebSocket Connected";
+  mReconnectDelay = 1000;
+  mConnected = true;
 }
 
 void Client::onWebSocketDisconnect(){
-  qDebug() << "WebSocket Disconnected";
+  qDebug() << "WebSocket Disconnected after" << mMessagesDecoded
+           << "messages," << mCoordinateUpdates << "coordinate updates,"
+           << mArenaOverflows << "arena overflows";
+  mProbePending = false;
+  mConnected = false;
+
+  // The mount announces itself again once reconnected.
+  mMountIsReady = false;
+}
+
+void Client::onWebSocketStateChanged(QAbstractSocket::SocketState state) {
+  // Covers both a dropped connection and a failed attempt to connect.
+  if(state != QAbstractSocket::UnconnectedState || mReconnectTimer.isActive())
+    return;
+
+  qDebug() << "Reconnecting to" << mUrl << "in" << mReconnectDelay << "ms";
+  mReconnectTimer.start(mReconnectDelay);
+  mReconnectDelay = std::min(2 * mReconnectDelay, 30000);
+}
+
+void Client::reconnect() {
+  mWebSocket.open(mUrl);
 }
 
 void Client::processTextMessage(QString message){
@@ -43,15 +103,48 @@ void Client::processTextMessage(QString message){
 void Client::processBinaryMessage(QByteArray message){
   using namespace niad;
 
-  Envelope e;
-  e.ParseFromArray(message.data(), message.size());
+  // Image transfer acknowledgements share this socket.
+  if (mImageSender.processMessage(message))
+    return;
+
+  if (mRecordFile.isOpen()) {
+    QDataStream s(&mRecordFile);
+    s << message;
+  }
+
+  // Decode into an arena over a reused block so that typical messages
+  // allocate nothing. Everything is released when the arena goes out of scope.
+  size_t arena_used = 0;
+  {
+    google::protobuf::ArenaOptions options;
+    options.initial_block = mArenaBlock.data();
+    options.initial_block_size = mArenaBlock.size();
+    google::protobuf::Arena arena(options);
+
+    Envelope * e = google::protobuf::Arena::CreateMessage<Envelope>(&arena);
+    if (!e->ParseFromArray(message.data(), message.size())) {
+      qWarning() << "Discarding malformed NIAD message of" << message.size() << "bytes";
+      mMalformed++;
+      return;
+    }
+    mMessagesDecoded++;
+
+    if (e->has_device_envelope()) {
+      processDeviceEnvelope(e->device_envelope());
+    }
+
+    if (e->has_mount_envelope()) {
+      processMountEnvelope(e->mount_envelope());
+    }
 
-  if (e.has_device_envelope()) {
-    processDeviceEnvelope(e.device_envelope());
+    arena_used = arena.SpaceAllocated();
   }
 
-  if (e.has_mount_envelope()) {
-    processMountEnvelope(e.mount_envelope());
+  // Grow the block for next time if this message did not fit. This must wait
+  // until the arena that referenced the block has been destroyed.
+  if (arena_used > mArenaBlock.size()) {
+    mArenaOverflows++;
+    mArenaBlock.resize(2 * arena_used);
   }
 }
 
@@ -60,7 +153,7 @@ void Client::processDeviceEnvelope(const niad::DeviceEnvelope &e){
 
   // Find the first mount and get additional information about it
   for(size_t i = 0; i < e.info_size(); i++) {
-    auto info = e.info(i);
+    const auto & info = e.info(i);
 
     if (info.type() == DEVICE_TYPE_MOUNT) {
       Envelope e;
@@ -81,7 +174,7 @@ void Client::processMountEnvelope(const niad::MountEnvelope &m_e){
     // On connect, we should get an info object describing the
     // capabilities of the mount. Start by requesting a subscription
     // to all coordinate systems supported.
-    auto info = m_e.info();
+    const auto & info = m_e.info();
 
     Envelope r;
     auto r_m = r.mutable_mount_envelope();
@@ -106,23 +199,46 @@ void Client::processMountEnvelope(const niad::MountEnvelope &m_e){
 
   } else if (m_e.has_coords()) {
 
-    auto coords = m_e.coords();
+    auto & coords = m_e.coords();
 
     if(coords.type() == niad::COORDINATE_TYPE_LAT_LON_ALT) {
-      mMountLLA = coords;
-    } else {
+      if(mProbePending) {
+        double latency = mProbeTimer.nsecsElapsed() * 0.5E-6;
+        mProbePending = false;
+        mProbeCount++;
+        mProbeSum += latency;
+        mProbeMax = std::max(mProbeMax, latency);
+      }
+      if(coords.position_size() >= 3) {
+        mMountState.has_lla = true;
+        for(int i = 0; i < 3; i++)
+          mMountState.lla[i] = coords.position(i);
+        mMountSnapshot.store(mMountState);
+      }
+    } else if(coords.position_size() >= 2) {
 
-      // put the coordinates into the buffer, if instructed.
-      if (mBufferValues)
-        mCoordinateBuffer.push_back(coords);
+      // Record the sample; the worker selects the window it needs.
+      mCoordinateUpdates++;
+      CoordinateSample sample;
+      sample.type = coords.type();
+      sample.position[0] = coords.position(0);
+      sample.position[1] = coords.position(1);
+      for(int i = 0; i < 2; i++)
+        sample.position_min[i] = sample.position_max[i] = sample.position[i];
+      sample.arrival_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+
+      recordSample(sample);
 
       // Update the latest coordinates.
-      mLastCoordinates = coords;
+      mMountState.coordinates = sample;
+      mMountSnapshot.store(mMountState);
     }
 
   } else if(m_e.type() == MOUNT_RESPONSE_IS_READY) {
     // indicate the mount is operational.
     mMountIsReady = true;
+    mReadyCount++;
 
     // Shut off non RA/DEC coordinate subscriptions.
     Envelope r;
@@ -135,19 +251,191 @@ void Client::processMountEnvelope(const niad::MountEnvelope &m_e){
   }
 }
 
+void Client::recordSample(const CoordinateSample & sample) {
+
+  if(mBucketWidth <= 0) {
+    mCoordinateRing.push(sample);
+    return;
+  }
+
+  // Close the current bucket once its interval has passed. Buckets are
+  // aligned to multiples of the width so that they do not drift.
+  auto & b = mBuckets[sample.type];
+  if(b.count > 0 && sample.arrival_ns >= b.end_ns)
+    closeBucket(b);
+
+  if(b.count == 0) {
+    b = CoordinateBucket();
+    b.first = sample;
+    b.end_ns = (sample.arrival_ns / mBucketWidth + 1) * mBucketWidth;
+  }
+
+  double delta[2] = {sample.position[0] - b.first.position[0],
+                     sample.position[1] - b.first.position[1]};
+  delta[0] = remainder(delta[0], 2 * M_PI);
+  for(int i = 0; i < 2; i++) {
+    b.sum[i] += delta[i];
+    b.min[i] = std::min(b.min[i], delta[i]);
+    b.max[i] = std::max(b.max[i], delta[i]);
+  }
+  b.sum_arrival_ns += sample.arrival_ns - b.first.arrival_ns;
+  b.count++;
+}
+
+bool Client::record(const QString & filename) {
+  if(mRecordFile.isOpen())
+    return true;
+
+  mRecordFile.setFileName(filename);
+  if(!mRecordFile.open(QIODevice::WriteOnly)) {
+    qWarning() << "Cannot record NIAD messages to" << filename;
+    return false;
+  }
+  return true;
+}
+
+void Client::closeBucket(CoordinateBucket & b) {
+  if(b.count == 0)
+    return;
+
+  CoordinateSample out = b.first;
+  out.count = b.count;
+  out.arrival_ns += int64_t(b.sum_arrival_ns / b.count);
+  for(int i = 0; i < 2; i++) {
+    double mean = b.sum[i] / b.count;
+    out.position[i] = b.first.position[i] + mean;
+    out.position_min[i] = out.position[i] + (b.min[i] - mean);
+    out.position_max[i] = out.position[i] + (b.max[i] - mean);
+  }
+
+  // Wrap the mean of the angle and carry the extremes with it, so that
+  // min <= position <= max even when the bucket straddles 0.
+  double wrapped = fmod(out.position[0], 2 * M_PI);
+  if(wrapped < 0)
+    wrapped += 2 * M_PI;
+  double shift = wrapped - out.position[0];
+  out.position[0] += shift;
+  out.position_min[0] += shift;
+  out.position_max[0] += shift;
+
+  mCoordinateRing.push(out);
+  b.count = 0;
+}
+
+void Client::closeBuckets() {
+  for(auto & it: mBuckets)
+    closeBucket(it.second);
+}
+
+void Client::flushCoordinates() {
+  if(mBucketWidth <= 0)
+    return;
+
+  if(QThread::currentThread() == thread()) {
+    closeBuckets();
+    return;
+  }
+
+  // Only the Qt thread writes the ring. Ask it to close the buckets and wait
+  // briefly; an event loop that is shutting down must not hang the caller.
+  auto done = std::make_shared<QSemaphore>();
+  QMetaObject::invokeMethod(this, [this, done]() {
+    closeBuckets();
+    done->release();
+  }, Qt::QueuedConnection);
+  if(!done->tryAcquire(1, 1000))
+    qWarning() << "Timed out flushing the coordinate buckets";
+}
+
+void Client::setStatisticsPeriod(double seconds) {
+  if(seconds <= 0) {
+    mStatsTimer.stop();
+    return;
+  }
+  mStatsUpdates = mCoordinateUpdates;
+  mStatsCpuTime = double(std::clock()) / CLOCKS_PER_SEC;
+  mStatsTimer.start(int(seconds * 1000));
+}
+
+void Client::logStatistics() {
+  using namespace niad;
+
+  double period = mStatsTimer.interval() * 1E-3;
+  double cpu_time = double(std::clock()) / CLOCKS_PER_SEC;
+  double cpu = 100.0 * (cpu_time - mStatsCpuTime) / period;
+
+  QString latency = "n/a";
+  if(mProbeCount > 0)
+    latency = QString("%1/%2 ms").arg(mProbeSum / mProbeCount, 0, 'f', 2)
+                                 .arg(mProbeMax, 0, 'f', 2);
+  qInfo() << "Mount updates/s:" << (mCoordinateUpdates - mStatsUpdates) / period
+          << "latency mean/max:" << latency
+          << "lost:" << mSamplesLost.load()
+          << "malformed:" << mMalformed
+          << "process CPU:" << QString::number(cpu, 'f', 1) + "%";
+
+  mStatsUpdates = mCoordinateUpdates;
+  mStatsCpuTime = cpu_time;
+  mProbeCount = 0;
+  mProbeSum = 0;
+  mProbeMax = 0;
+
+  // Probe the latency for the next report.
+  if(mWebSocket.isValid() && !mProbePending) {
+    Envelope e;
+    e.mutable_mount_envelope()->set_type(MOUNT_REQUEST_GET_LAT_LON_ALT);
+    mProbePending = true;
+    mProbeTimer.start();
+    send(e);
+  }
+}
+
+void Client::setCoordinateRate(double rate) {
+  mBucketWidth = rate > 0 ? int64_t(1E9 / rate) : 0;
+}
+
 void Client::startBuffering() {
-  mCoordinateBuffer.clear();
-  mBufferValues = true;
+  mBufferEnd = UINT64_MAX;
+  mBufferStart = mCoordinateRing.head();
 }
 
 void Client::stopBuffering() {
-  mBufferValues = false;
+  mBufferEnd = mCoordinateRing.head();
+}
+
+std::vector<CoordinateSample> Client::getCoordinates() {
+  uint64_t last = mBufferEnd;
+  if(last == UINT64_MAX)
+    last = mCoordinateRing.head();
+
+  return getCoordinates(mBufferStart, last);
+}
+
+std::vector<CoordinateSample> Client::getCoordinates(uint64_t first, uint64_t last) {
+  std::vector<CoordinateSample> output;
+  output.reserve(std::min<uint64_t>(last - first, mCoordinateRing.capacity()));
+  uint64_t copied = mCoordinateRing.read(first, last, output);
+  if(copied > first) {
+    qWarning() << "Coordinate buffer overflowed;" << copied - first << "samples lost";
+    mSamplesLost += copied - first;
+  }
+
+  return output;
+}
+
+std::vector<CoordinateSample> Client::getRecentCoordinates(size_t count) {
+  std::vector<CoordinateSample> output;
+  uint64_t last = mCoordinateRing.head();
+  count = std::min<uint64_t>(count, std::min<uint64_t>(last, mCoordinateRing.capacity()));
+  output.reserve(count);
+  mCoordinateRing.read(last - count, last, output);
+  return output;
 }
 
-std::vector<niad::Coordinates> Client::getCoordinates() {
-  return mCoordinateBuffer;
+MountSnapshot Client::getMountSnapshot() {
+  return mMountSnapshot.load();
 }
 
-niad::Coordinates Client::getLLA() {
-  return mMountLLA;
+void Client::sendImage(std::shared_ptr<ImageData> image) {
+  mImageSender.enqueue(image);
 }
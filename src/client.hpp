@@ -2,11 +2,57 @@
 #define CLIENT_HPP
 
 #include "niad.pb.h"
+#include "image_sender.hpp"
+#include "spsc_ring.hpp"
+#include "seqlock.hpp"
 
 #include <QObject>
 #include <QString>
 #include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTimer>
 #include <QWebSocket>
+#include <google/protobuf/arena.h>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+/// Compact copy of a mount coordinate update, shared with the worker thread.
+struct CoordinateSample {
+  int32_t type = 0; ///< niad::CoordinateType of the position.
+  double position[2] = {0, 0}; ///< Position in the coordinate system (radians).
+  int64_t arrival_ns = 0; ///< Local arrival time, nanoseconds since the epoch.
+
+  // When decimating, a sample summarizes all updates in one time bucket.
+  // position and arrival_ns are then means over the bucket.
+  uint32_t count = 1; ///< Number of mount updates summarized by this sample.
+  double position_min[2] = {0, 0}; ///< Smallest position in the bucket (radians).
+  double position_max[2] = {0, 0}; ///< Largest position in the bucket (radians).
+  // The first axis wraps at 2 pi. Its min and max are on the same branch as
+  // position, so they can lie just outside [0, 2 pi).
+};
+
+/// Accumulates mount updates of one coordinate type over a time bucket.
+/// The first axis is an angle that wraps at 2 pi (RA or AZM), so it is
+/// accumulated relative to the first update in the bucket.
+struct CoordinateBucket {
+  int64_t end_ns = 0; ///< Arrival time at which the bucket closes.
+  CoordinateSample first; ///< First update in the bucket.
+  uint32_t count = 0; ///< Number of updates in the bucket.
+  double sum[2] = {0, 0}; ///< Sum of positions relative to first.
+  double min[2] = {0, 0}; ///< Smallest position relative to first.
+  double max[2] = {0, 0}; ///< Largest position relative to first.
+  double sum_arrival_ns = 0; ///< Sum of arrival times relative to first.
+};
+
+/// Most recent state reported by the mount.
+struct MountSnapshot {
+  CoordinateSample coordinates; ///< Latest non-LLA coordinates.
+  bool has_lla = false; ///< Whether lla has been received.
+  double lla[3] = {0, 0, 0}; ///< Latitude (rad), longitude (rad), altitude (m).
+};
 
 /// Class to serve as a client to NIAD devices.
 class Client : public QObject {
@@ -20,31 +66,94 @@ public:
 
 protected:
   QWebSocket mWebSocket; ///< Websocket connection.
+  QString mUrl; ///< URL passed to open().
+  QTimer mReconnectTimer; ///< Reopens mWebSocket after the connection drops.
+  int mReconnectDelay = 1000; ///< Delay before the next reconnection attempt (ms).
+
+  ImageSender mImageSender; ///< Delivers images over mWebSocket.
 
   //
-  // Things to control buffering.
+  // Things to control buffering. The Qt thread is the only producer of
+  // coordinate samples; worker threads only read them.
+  //
+
+  /// Every coordinate update received, oldest overwritten first.
+  SpscRing<CoordinateSample> mCoordinateRing;
+
+  /// Ring sequence number at which buffering started.
+  std::atomic<uint64_t> mBufferStart;
+
+  /// Ring sequence number at which buffering stopped. UINT64_MAX while buffering.
+  std::atomic<uint64_t> mBufferEnd;
 
-  /// Boolean to instruct this class to buffer data
-  std::atomic<bool> mBufferValues;
+  /// Width of the decimation buckets (nanoseconds). 0 keeps every update.
+  int64_t mBucketWidth = 0;
+
+  /// Bucket being filled for each coordinate type.
+  std::map<int32_t, CoordinateBucket> mBuckets;
 
   //
   // Things specific to the interface with a mount.
   //
-  bool mMountIsReady = false; ///< Indicates whether or not the mount is ready for use.
-  niad::Coordinates mMountLLA; ///< Latitude, Longitude, and Altitude of the mount.
-  niad::Coordinates mLastCoordinates; ///< Last coordinates provided by the mount.
-  std::vector<niad::Coordinates> mCoordinateBuffer; ///< Buffer of mount coordinates.
+  bool mOpened = false; ///< Whether open() has been called with a URL.
+  std::atomic<bool> mConnected{false}; ///< Whether the WebSocket is connected.
+  std::atomic<bool> mMountIsReady; ///< Indicates whether or not the mount is ready for use.
+  std::atomic<uint64_t> mReadyCount{0}; ///< Times the mount has reported ready.
+  MountSnapshot mMountState; ///< Writer-side copy of the latest mount state.
+  SeqLock<MountSnapshot> mMountSnapshot; ///< Latest mount state for readers.
+
+  //
+  // Things to avoid heap allocation on the NIAD message path.
+  //
+  std::vector<char> mArenaBlock; ///< Initial block for the decode arena, reused per message.
+  QByteArray mEncodeBuffer; ///< Reused serialization buffer for outgoing messages.
+  uint64_t mMessagesDecoded = 0; ///< Number of NIAD envelopes decoded.
+  uint64_t mArenaOverflows = 0; ///< Decodes that outgrew mArenaBlock.
+  uint64_t mCoordinateUpdates = 0; ///< RA/DEC and AZM/ALT updates received.
+  uint64_t mMalformed = 0; ///< Messages that could not be decoded.
+  std::atomic<uint64_t> mSamplesLost; ///< Samples overwritten in the ring before being read.
+
+  //
+  // Periodic statistics, for load testing against mock-mount. Latency is
+  // half the round trip of a latitude/longitude/altitude request, which
+  // queues behind any coordinate updates the mount is still sending.
+  //
+  QTimer mStatsTimer; ///< Drives logStatistics().
+  QElapsedTimer mProbeTimer; ///< Started when a latency probe is sent.
+  bool mProbePending = false; ///< Whether a probe awaits its response.
+  uint64_t mProbeCount = 0; ///< Probes answered since the last report.
+  double mProbeSum = 0; ///< Sum of one-way latencies since the last report (ms).
+  double mProbeMax = 0; ///< Largest one-way latency since the last report (ms).
+  uint64_t mStatsUpdates = 0; ///< mCoordinateUpdates at the last report.
+  double mStatsCpuTime = 0; ///< Process CPU time at the last report (seconds).
+  QFile mRecordFile; ///< Receives every NIAD message when recording.
 
 protected:
+  /// Add a mount update to the ring, either directly or through its bucket.
+  /// \param sample The update.
+  void recordSample(const CoordinateSample & sample);
+
+  /// Add the summary of a bucket to the ring and empty it.
+  void closeBucket(CoordinateBucket & b);
+
+  /// Close every partly filled bucket. Must run on the Qt thread.
+  void closeBuckets();
+
   /// Send a NIAD command
   /// \param e NIAD envelope.
-  void send(niad::Envelope e);
+  void send(const niad::Envelope & e);
 
 public slots:
   /// Slot to handle WebSocket connect events
   void onWebSocketConnect();
   /// Slot to handle WebSocket disconnect events
   void onWebSocketDisconnect();
+  /// Slot to retry the connection once it is lost or could not be made.
+  void onWebSocketStateChanged(QAbstractSocket::SocketState state);
+  /// Slot to reopen the connection.
+  void reconnect();
+  /// Slot to log update rate, latency, losses, and CPU use.
+  void logStatistics();
 
   /// Slot to process WebSocket text messages
   void processTextMessage(QString message);
@@ -57,21 +166,97 @@ public slots:
   void processMountEnvelope(const niad::MountEnvelope &e);
 
 public:
-  /// Open a connection to the specified URL.
+  /// Open a connection to the specified URL. Does nothing if already open.
+  /// The connection is reopened whenever it drops, backing off to one
+  /// attempt every 30 seconds.
   /// \param url A valid URL to a NIAD server.
   void open(const QString & url);
 
+  /// Save every NIAD message received to a file, for niad-bench. Each message
+  /// is written as a QDataStream QByteArray. Does nothing if already recording.
+  /// \param filename File to write.
+  /// \return False if the file could not be opened.
+  bool record(const QString & filename);
+
+  /// Log the coordinate update rate, latency, lost updates, and process CPU
+  /// use periodically.
+  /// \param seconds Period. 0 (the default) disables the log.
+  void setStatisticsPeriod(double seconds);
+
+  /// Limit the rate at which coordinates are buffered. Updates arriving
+  /// faster are combined into one sample per 1/rate seconds that carries the
+  /// mean, min, and max position.
+  /// \param rate Samples per second. 0 (the default) keeps every update.
+  void setCoordinateRate(double rate);
+
+  /// Add the partly filled decimation buckets to the buffer now, rather than
+  /// when their interval ends. Call at the end of an exposure so that the
+  /// last updates within it are in the window. Safe to call from any thread.
+  void flushCoordinates();
+
   /// Instruct the class to start buffering data.
   void startBuffering();
 
   /// Instruct the class to stop buffering data.
   void stopBuffering();
 
-  /// Get all mount coordinates buffered by the class.
-  std::vector<niad::Coordinates> getCoordinates();
+  /// Get all mount coordinates buffered between startBuffering() and
+  /// stopBuffering(). If more samples arrived than the ring holds, only the
+  /// newest are returned.
+  std::vector<CoordinateSample> getCoordinates();
+
+  /// Get the sequence number the next coordinate update will receive. Mark
+  /// the start and end of a window with this to read it with getCoordinates().
+  uint64_t getCoordinateSequence() const { return mCoordinateRing.head(); }
+
+  /// Get the mount coordinates received in a window of sequence numbers.
+  /// Several consumers may each track their own window this way.
+  /// \param first Sequence number at the start of the window.
+  /// \param last Sequence number at the end of the window.
+  std::vector<CoordinateSample> getCoordinates(uint64_t first, uint64_t last);
+
+  /// Get the most recent coordinate updates, whether or not buffering.
+  /// \param count Largest number of updates to return.
+  /// \return Updates, oldest first.
+  std::vector<CoordinateSample> getRecentCoordinates(size_t count);
+
+  /// Whether open() has been called with a URL, i.e. whether a mount is
+  /// expected.
+  bool isOpen() const { return mOpened; }
+
+  /// Whether the connection to the mount is currently up. Safe to call from
+  /// any thread.
+  bool isConnected() const { return mConnected; }
+
+  /// Whether the mount has reported that it is ready for use.
+  bool isMountReady() const { return mMountIsReady; }
+
+  /// Number of times the mount has reported that it is ready. Changes when
+  /// the mount becomes ready again, e.g. after a reconnect.
+  uint64_t getReadyCount() const { return mReadyCount; }
+
+  /// Get the latest coordinates and the Latitude, Longitude, and Altitude of
+  /// the mount as one consistent snapshot.
+  MountSnapshot getMountSnapshot();
+
+  /// Queue an image for delivery to the NIAD server. Safe to call from any
+  /// thread; never blocks on the network.
+  /// \param image The image to send.
+  void sendImage(std::shared_ptr<ImageData> image);
+
+  /// Get the number of NIAD envelopes decoded.
+  uint64_t getMessagesDecoded() const { return mMessagesDecoded; }
+
+  /// Get the number of RA/DEC and AZM/ALT updates received, before any
+  /// decimation by setCoordinateRate().
+  uint64_t getCoordinateUpdates() const { return mCoordinateUpdates; }
+
+  /// Get the number of decodes that needed heap memory beyond the reused
+  /// arena block. This should stay near zero once the block has grown to fit.
+  uint64_t getArenaOverflows() const { return mArenaOverflows; }
 
-  /// Get the Latitude, Longitude, and Altitude of the mount.
-  niad::Coordinates getLLA();
+  /// Get the image sender to adjust compression and flow control settings.
+  ImageSender & getImageSender() { return mImageSender; }
 
   //
 }; // Client
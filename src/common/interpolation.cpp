@@ -0,0 +1,62 @@
+// system includes
+#include <algorithm>
+#include <cmath>
+
+// local includes
+#include "interpolation.hpp"
+
+namespace Interpolation {
+
+  double CubicSpline(const std::vector<double> & x,
+                     const std::vector<double> & y, double x0) {
+    const size_t n = x.size();
+    if(n == 1 || x0 <= x.front())
+      return y.front();
+    if(x0 >= x.back())
+      return y.back();
+
+    // Interval containing x0.
+    size_t k = std::upper_bound(x.begin(), x.end(), x0) - x.begin() - 1;
+    double h = x[k + 1] - x[k];
+    double a = (x[k + 1] - x0) / h;
+    double b = (x0 - x[k]) / h;
+    if(n == 2)
+      return a * y[k] + b * y[k + 1];
+
+    // Solve the tridiagonal system for the second derivatives, which are
+    // zero at the end points (natural spline).
+    std::vector<double> m(n, 0.0);
+    std::vector<double> c(n, 0.0);
+    for(size_t i = 1; i + 1 < n; i++) {
+      double h0 = x[i] - x[i - 1];
+      double h1 = x[i + 1] - x[i];
+      double sigma = h0 / (h0 + h1);
+      double p = sigma * m[i - 1] + 2.0;
+      m[i] = (sigma - 1.0) / p;
+      c[i] = (y[i + 1] - y[i]) / h1 - (y[i] - y[i - 1]) / h0;
+      c[i] = (6.0 * c[i] / (h0 + h1) - sigma * c[i - 1]) / p;
+    }
+    m[n - 1] = 0;
+    for(size_t i = n - 1; i-- > 0;)
+      m[i] = m[i] * m[i + 1] + c[i];
+
+    return a * y[k] + b * y[k + 1] +
+      ((a * a * a - a) * m[k] + (b * b * b - b) * m[k + 1]) * (h * h) / 6.0;
+  }
+
+  void Unwrap(std::vector<double> & angles, double period) {
+    for(size_t i = 1; i < angles.size(); i++) {
+      double delta = angles[i] - angles[i - 1];
+      angles[i] -= period * std::round(delta / period);
+    }
+  }
+
+  double Wrap(double angle, double period) {
+    angle = fmod(angle, period);
+    if(angle < 0)
+      angle += period;
+    return angle;
+  }
+
+  //
+}; // namespace Interpolation
@@ -0,0 +1,31 @@
+#ifndef INTERPOLATION_H
+#define INTERPOLATION_H
+
+// system includes
+#include <vector>
+
+namespace Interpolation {
+
+  /// Evaluate a natural cubic spline through the points (x, y) at x0.
+  /// Points need not be evenly spaced but x must be strictly increasing.
+  /// Values outside of [x.front(), x.back()] are clamped to the end points.
+  /// Falls back to linear interpolation for two points.
+  /// \param x Abscissae, strictly increasing. Must not be empty.
+  /// \param y Ordinates, one per abscissa.
+  /// \param x0 Location at which the spline is evaluated.
+  double CubicSpline(const std::vector<double> & x,
+                     const std::vector<double> & y, double x0);
+
+  /// Remove discontinuities from a series of angles by adding multiples of
+  /// the period, so that consecutive values differ by less than half a period.
+  /// \param angles Angles to unwrap, in place.
+  /// \param period Period of the angle (e.g. 2 pi radians).
+  void Unwrap(std::vector<double> & angles, double period);
+
+  /// Wrap an angle into [0, period).
+  double Wrap(double angle, double period);
+
+  //
+}; // namespace Interpolation
+
+#endif // INTERPOLATION_H
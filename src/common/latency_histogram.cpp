@@ -0,0 +1,73 @@
+
+// local includes
+#include "latency_histogram.hpp"
+
+// system includes
+#include <algorithm>
+#include <cmath>
+
+LatencyHistogram::LatencyHistogram() {
+  for(auto & bucket: mBuckets)
+    bucket.store(0, std::memory_order_relaxed);
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t ns) {
+
+  if(ns < 2 * SUB_BUCKETS)
+    return ns;
+
+  // Keep the SUB_BUCKET_BITS + 1 most significant bits. Bucket blocks of
+  // SUB_BUCKETS follow on from the exact values below 2 * SUB_BUCKETS.
+  int msb = 63 - __builtin_clzll(ns);
+  int shift = msb - SUB_BUCKET_BITS;
+  size_t index = shift * SUB_BUCKETS + (ns >> shift);
+  return std::min(index, BUCKETS - 1);
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+
+  if(index < 2 * SUB_BUCKETS)
+    return index;
+
+  int shift = index / SUB_BUCKETS - 1;
+  uint64_t mantissa = index - shift * SUB_BUCKETS;
+  return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+
+  mBuckets[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+  mCount.fetch_add(1, std::memory_order_relaxed);
+  mSum.fetch_add(ns, std::memory_order_relaxed);
+
+  uint64_t max = mMax.load(std::memory_order_relaxed);
+  while(ns > max && !mMax.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+}
+
+double LatencyHistogram::getMean() const {
+  uint64_t count = getCount();
+  if(count == 0)
+    return 0;
+  return double(mSum.load(std::memory_order_relaxed)) / count;
+}
+
+uint64_t LatencyHistogram::getPercentile(double percentile) const {
+
+  // Counts may move while we read them; the result is still a value that
+  // was recorded at about the requested rank.
+  uint64_t total = 0;
+  for(auto & bucket: mBuckets)
+    total += bucket.load(std::memory_order_relaxed);
+  if(total == 0)
+    return 0;
+
+  uint64_t rank = std::max<uint64_t>(1, std::ceil(percentile / 100 * total));
+  uint64_t seen = 0;
+  for(size_t i = 0; i < BUCKETS; i++) {
+    seen += mBuckets[i].load(std::memory_order_relaxed);
+    if(seen >= rank)
+      return std::min(bucketUpperBound(i), getMax());
+  }
+
+  return getMax();
+}
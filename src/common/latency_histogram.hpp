@@ -0,0 +1,65 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+// system includes
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/// Histogram of durations with a fixed relative precision, in the style of
+/// HdrHistogram.
+///
+/// Values below SUB_BUCKETS nanoseconds are counted exactly. Above that each
+/// power of two is split into SUB_BUCKETS linear buckets, so any recorded
+/// value is known to within 1/SUB_BUCKETS (about 3%). Recording is a few
+/// relaxed atomic increments; it never locks or allocates, so any number of
+/// threads may record while others read.
+class LatencyHistogram {
+
+public:
+  static const size_t SUB_BUCKETS = 32; ///< Linear buckets per power of two.
+  static const int    SUB_BUCKET_BITS = 5; ///< log2(SUB_BUCKETS)
+  static const int    MAX_BITS = 42; ///< Values are clamped below 2^42 ns (~73 minutes).
+  /// Total number of buckets.
+  static const size_t BUCKETS = (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  /// Default constructor
+  LatencyHistogram();
+
+protected:
+  std::array<std::atomic<uint64_t>, BUCKETS> mBuckets; ///< Counts per bucket.
+  std::atomic<uint64_t> mCount{0}; ///< Number of values recorded.
+  std::atomic<uint64_t> mSum{0}; ///< Sum of values recorded (ns).
+  std::atomic<uint64_t> mMax{0}; ///< Largest value recorded (ns).
+
+  /// Get the bucket holding a value.
+  static size_t bucketIndex(uint64_t ns);
+
+  /// Get the largest value held by a bucket.
+  static uint64_t bucketUpperBound(size_t index);
+
+public:
+  /// Record a duration.
+  /// \param ns Duration (nanoseconds).
+  void record(uint64_t ns);
+
+  /// Number of values recorded.
+  uint64_t getCount() const { return mCount.load(std::memory_order_relaxed); }
+
+  /// Mean of the values recorded (nanoseconds). 0 if none.
+  double getMean() const;
+
+  /// Largest value recorded (nanoseconds).
+  uint64_t getMax() const { return mMax.load(std::memory_order_relaxed); }
+
+  /// Get a percentile of the values recorded.
+  /// \param percentile Percentile from 0 to 100.
+  /// \return Upper bound of the bucket holding the percentile (nanoseconds),
+  ///         never more than getMax(). 0 if nothing was recorded.
+  uint64_t getPercentile(double percentile) const;
+
+  //
+}; // LatencyHistogram
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,48 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+// system includes
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+/// A single-writer sequence lock around a trivially copyable value.
+///
+/// The writer never waits. Readers copy the value and retry if the writer
+/// changed it in the meantime, so they always observe a complete snapshot.
+template<typename T>
+class SeqLock {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SeqLock values must be trivially copyable");
+
+protected:
+  std::atomic<uint32_t> mSequence{0}; ///< Odd while a write is in progress.
+  T mValue{}; ///< The protected value.
+
+public:
+  /// Replace the value. Writer thread only.
+  void store(const T & value) {
+    uint32_t s = mSequence.load(std::memory_order_relaxed);
+    mSequence.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    mValue = value;
+    mSequence.store(s + 2, std::memory_order_release);
+  }
+
+  /// Get a consistent copy of the value. Safe from any thread.
+  T load() const {
+    T value;
+    uint32_t before, after;
+    do {
+      before = mSequence.load(std::memory_order_acquire);
+      value = mValue;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = mSequence.load(std::memory_order_relaxed);
+    } while((before & 1) || before != after);
+    return value;
+  }
+
+  //
+}; // SeqLock
+
+#endif // SEQLOCK_H
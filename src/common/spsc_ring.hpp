@@ -0,0 +1,97 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+// system includes
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+/// Bounded single-producer / single-consumer ring of trivially copyable
+/// values.
+///
+/// The producer never blocks: once the ring is full the oldest value is
+/// overwritten. Every value receives a sequence number (the number of values
+/// pushed before it), which lets the consumer ask for a window of values by
+/// sequence number without removing them. Reads are validated against the
+/// producer's position afterwards, so values overwritten during a read are
+/// discarded rather than returned torn.
+template<typename T>
+class SpscRing {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SpscRing values must be trivially copyable");
+
+public:
+  /// Default constructor
+  /// \param capacity Number of values retained. Rounded up to a power of two.
+  explicit SpscRing(size_t capacity) {
+    size_t n = 1;
+    while(n < capacity)
+      n <<= 1;
+    mSlots.resize(n);
+    mMask = n - 1;
+  }
+
+protected:
+  std::vector<T> mSlots; ///< Storage for values.
+  size_t mMask = 0; ///< mSlots.size() - 1
+  std::atomic<uint64_t> mHead{0}; ///< Sequence number of the next value.
+
+public:
+  /// Append a value. Producer thread only.
+  void push(const T & value) {
+    uint64_t head = mHead.load(std::memory_order_relaxed);
+    mSlots[head & mMask] = value;
+    mHead.store(head + 1, std::memory_order_release);
+  }
+
+  /// Get the sequence number the next value will receive. Safe from any thread.
+  uint64_t head() const {
+    return mHead.load(std::memory_order_acquire);
+  }
+
+  /// Get the number of values retained.
+  size_t capacity() const {
+    return mSlots.size();
+  }
+
+  /// Copy the values with sequence numbers in [first, last) that are still
+  /// held in the ring. Consumer thread only.
+  /// \param first Sequence number of the first value requested.
+  /// \param last One past the sequence number of the last value requested.
+  /// \param out Values are appended to this vector.
+  /// \return Sequence number of the first value appended. Greater than first
+  ///         if older values had already been overwritten.
+  uint64_t read(uint64_t first, uint64_t last, std::vector<T> & out) const {
+    const uint64_t capacity = mSlots.size();
+
+    uint64_t head = mHead.load(std::memory_order_acquire);
+    last = std::min(last, head);
+    if(head > capacity)
+      first = std::max(first, head - capacity);
+    if(first >= last)
+      return last;
+
+    size_t start = out.size();
+    for(uint64_t s = first; s < last; s++)
+      out.push_back(mSlots[s & mMask]);
+
+    // The producer may have lapped the oldest values while they were being
+    // copied. The slot for sequence (head - capacity) may also be mid-write.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    head = mHead.load(std::memory_order_relaxed);
+    uint64_t valid = (head + 1 > capacity) ? head + 1 - capacity : 0;
+    if(valid > first) {
+      size_t drop = std::min<uint64_t>(valid - first, last - first);
+      out.erase(out.begin() + start, out.begin() + start + drop);
+      first += drop;
+    }
+
+    return first;
+  }
+
+  //
+}; // SpscRing
+
+#endif // SPSC_RING_H
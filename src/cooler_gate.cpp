@@ -0,0 +1,102 @@
+#include "cooler_gate.hpp"
+
+// system includes
+#include <algorithm>
+#include <cmath>
+
+CoolerGate::CoolerGate() {
+}
+
+void CoolerGate::setThresholds(double tolerance, double hold) {
+  mTolerance = tolerance;
+  mHold = hold;
+}
+
+bool CoolerGate::update(const std::vector<double> & times,
+                        const std::vector<double> & temperatures,
+                        double setpoint, double now) {
+
+  mStable = false;
+  mAsymptote = mTimeConstant = mTimeToStable = NAN;
+  mTemperature = temperatures.empty() ? NAN : temperatures.back();
+
+  // Keep the readings within the fit window.
+  size_t first = 0;
+  while(first < times.size() && times[first] < now - mWindow)
+    first++;
+  size_t n = times.size() - first;
+  if(n == 0)
+    return false;
+
+  // How long the CCD has been within tolerance without a break.
+  double inside_since = NAN;
+  for(size_t i = times.size(); i-- > first; ) {
+    if(std::fabs(temperatures[i] - setpoint) > mTolerance)
+      break;
+    inside_since = times[i];
+  }
+  double time_inside = std::isnan(inside_since) ? 0 : now - inside_since;
+  if(time_inside >= mHold) {
+    mStable = true;
+    mTimeToStable = 0;
+    return true;
+  }
+
+  if(n < mMinSamples)
+    return false;
+
+  // For each candidate time constant the model is linear in T_inf and A, so
+  // solve that by least squares and keep the time constant with the smallest
+  // residual. A is the offset at the newest reading, which keeps the
+  // exponentials bounded.
+  double t_last = times.back();
+  double best_sse = INFINITY;
+  double best_a = 0;
+  for(double tau = 5; tau <= 7200; tau *= 1.1) {
+    double s1 = 0, se = 0, see = 0, sy = 0, sey = 0;
+    for(size_t i = first; i < times.size(); i++) {
+      double e = exp((t_last - times[i]) / tau);
+      s1 += 1; se += e; see += e * e;
+      sy += temperatures[i]; sey += e * temperatures[i];
+    }
+
+    double det = s1 * see - se * se;
+    if(det <= 1E-9 * s1 * see)
+      continue; // readings too close together to tell the terms apart
+
+    double a = (s1 * sey - se * sy) / det;
+    double t_inf = (sy - a * se) / s1;
+    double sse = 0;
+    for(size_t i = first; i < times.size(); i++) {
+      double r = temperatures[i] - t_inf - a * exp((t_last - times[i]) / tau);
+      sse += r * r;
+    }
+
+    if(sse < best_sse) {
+      best_sse = sse;
+      best_a = a;
+      mAsymptote = t_inf;
+      mTimeConstant = tau;
+    }
+  }
+
+  if(std::isnan(mAsymptote))
+    return false;
+
+  // The CCD enters the tolerance once the decaying term is smaller than the
+  // room the asymptote leaves, then has to stay there for the hold time.
+  double offset = std::fabs(mAsymptote - setpoint);
+  if(offset >= mTolerance) {
+    mTimeToStable = INFINITY;
+    return false;
+  }
+
+  double enter = 0;
+  double margin = mTolerance - offset;
+  if(std::fabs(best_a) > margin)
+    enter = mTimeConstant * log(std::fabs(best_a) / margin) - (now - t_last);
+  enter = std::max(enter, 0.0);
+
+  mTimeToStable = enter > 0 ? enter + mHold : mHold - time_inside;
+  return false;
+}
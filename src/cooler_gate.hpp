@@ -0,0 +1,70 @@
+#ifndef COOLER_GATE_HPP
+#define COOLER_GATE_HPP
+
+// system includes
+#include <cstddef>
+#include <vector>
+
+/// Decides whether the CCD temperature has stabilized at its set point, and
+/// predicts when it will.
+///
+/// A regulated cooler approaches its set point roughly exponentially, so
+/// T(t) = T_inf + A exp(-t / tau) is fit to the recent temperature readings.
+/// The CCD is stable once every reading over a hold period is within the
+/// tolerance. The fit predicts when that will happen, or that it will not
+/// (e.g. the cooler cannot reach the set point).
+class CoolerGate {
+
+public:
+  /// Default constructor
+  CoolerGate();
+
+protected:
+  double mTolerance = 0.5; ///< Largest stable offset from the set point (Celsius).
+  double mHold = 60; ///< Time the CCD must stay within tolerance (seconds).
+  double mWindow = 900; ///< Readings older than this are not fit (seconds).
+  size_t mMinSamples = 5; ///< Fewest readings needed for a prediction.
+
+  double mTemperature = 0; ///< Newest reading (Celsius).
+  double mAsymptote = 0; ///< Fitted final temperature (Celsius).
+  double mTimeConstant = 0; ///< Fitted time constant (seconds).
+  double mTimeToStable = 0; ///< Predicted wait from the last update() (seconds).
+  bool mStable = false; ///< Result of the last update().
+
+public:
+  /// Set the thresholds.
+  /// \param tolerance Largest stable offset from the set point (Celsius).
+  /// \param hold Time the CCD must stay within tolerance (seconds).
+  void setThresholds(double tolerance, double hold);
+
+  /// Evaluate the readings.
+  /// \param times Time of each reading, oldest first (seconds, any origin).
+  /// \param temperatures CCD temperature of each reading (Celsius).
+  /// \param setpoint Cooler set point (Celsius).
+  /// \param now Current time on the same clock as times (seconds).
+  /// \return True if the CCD is stable.
+  bool update(const std::vector<double> & times,
+              const std::vector<double> & temperatures,
+              double setpoint, double now);
+
+  /// Get the result of the last update().
+  bool isStable() const { return mStable; }
+
+  /// Get the newest temperature passed to update() (Celsius).
+  double getTemperature() const { return mTemperature; }
+
+  /// Get the fitted final temperature (Celsius). NaN if unknown.
+  double getAsymptote() const { return mAsymptote; }
+
+  /// Get the fitted time constant (seconds). NaN if unknown.
+  double getTimeConstant() const { return mTimeConstant; }
+
+  /// Get the predicted time until the CCD is stable (seconds). 0 if stable,
+  /// infinity if the fit never reaches the tolerance, NaN if there are too
+  /// few readings to tell.
+  double getTimeToStable() const { return mTimeToStable; }
+
+  //
+}; // CoolerGate
+
+#endif // COOLER_GATE_HPP
@@ -0,0 +1,160 @@
+#include "duty_cycle.hpp"
+
+// system includes
+#include <QDateTime>
+#include <QDebug>
+#include <QTextStream>
+#include <algorithm>
+#include <numeric>
+
+/// Convert a time difference to seconds.
+template <typename Duration>
+static double seconds(Duration d) {
+  return std::chrono::duration<double>(d).count();
+}
+
+DutyCycleAccountant::DutyCycleAccountant() {
+  mFrame.fill(0);
+  mTotal.fill(0);
+}
+
+const char * DutyCycleAccountant::getPhaseName(Phase phase) {
+  switch(phase) {
+  case PHASE_MOUNT_WAIT:  return "mount";
+  case PHASE_FILTER_MOVE: return "filter";
+  case PHASE_START:       return "start";
+  case PHASE_EXPOSURE:    return "exposure";
+  case PHASE_COMPLETION:  return "completion";
+  case PHASE_READOUT:     return "readout";
+  case PHASE_TEMPERATURE: return "temperature";
+  case PHASE_PROCESSING:  return "processing";
+  case PHASE_COORDINATES: return "coordinates";
+  case PHASE_SEND:        return "send";
+  case PHASE_FITS_WRITE:  return "fits";
+  case PHASE_OTHER:       return "other";
+  default:                return "unknown";
+  }
+}
+
+void DutyCycleAccountant::beginSequence(const QString & log_filename) {
+  mSequenceStart = Clock::now();
+  mTotal.fill(0);
+  mFramesWall = 0;
+  mFrames = 0;
+
+  if(mLog.isOpen())
+    mLog.close();
+  if(log_filename.isEmpty())
+    return;
+
+  mLog.setFileName(log_filename);
+  if(!mLog.open(QIODevice::WriteOnly | QIODevice::Text)) {
+    qWarning() << "Could not open timing log" << log_filename;
+    return;
+  }
+
+  QTextStream out(&mLog);
+  out << "frame,start,aborted,wall";
+  for(int p = 0; p < PHASE_COUNT; p++)
+    out << "," << getPhaseName(Phase(p));
+  out << "\n";
+}
+
+void DutyCycleAccountant::beginFrame() {
+  mFrameStart = mLap = Clock::now();
+  mFrame.fill(0);
+}
+
+void DutyCycleAccountant::lap(Phase phase) {
+  auto now = Clock::now();
+  mFrame[phase] += seconds(now - mLap);
+  mLap = now;
+}
+
+void DutyCycleAccountant::add(Phase phase, double seconds) {
+  mFrame[phase] += seconds;
+}
+
+void DutyCycleAccountant::addAcquisition(const ImageData & image,
+                                         Clock::time_point call_start) {
+  auto call_end = Clock::now();
+  mLap = call_end;
+
+  // An aborted frame carries no times.
+  if(image.aborted) {
+    mFrame[PHASE_OTHER] += seconds(call_end - call_start);
+    return;
+  }
+
+  // The shutter is open for the requested time; any longer is the time the
+  // poll took to notice the end, plus ending the exposure.
+  double exposure = std::min(image.exposure_duration_sec,
+                             seconds(image.readout_start - image.exposure_start));
+  mFrame[PHASE_START] += seconds(image.exposure_start - call_start);
+  mFrame[PHASE_EXPOSURE] += exposure;
+  mFrame[PHASE_COMPLETION] += seconds(image.readout_start - image.exposure_start) - exposure;
+  mFrame[PHASE_READOUT] += seconds(image.readout_end - image.readout_start);
+  mFrame[PHASE_TEMPERATURE] += seconds(call_end - image.readout_end);
+}
+
+void DutyCycleAccountant::endFrame(int index, bool aborted) {
+  auto now = Clock::now();
+  double wall = seconds(now - mFrameStart);
+  double claimed = std::accumulate(mFrame.begin(), mFrame.end() - 1, 0.0);
+  mFrame[PHASE_OTHER] = std::max(wall - claimed, 0.0);
+
+  for(int p = 0; p < PHASE_COUNT; p++)
+    mTotal[p] += mFrame[p];
+  mFramesWall += wall;
+  mFrames++;
+
+  if(!mLog.isOpen())
+    return;
+
+  // Milliseconds keep the lines short and are ample resolution.
+  QTextStream out(&mLog);
+  out << index << ","
+      << QDateTime::currentDateTimeUtc().addMSecs(-qint64(wall * 1000)).toString(Qt::ISODateWithMs)
+      << "," << (aborted ? 1 : 0) << "," << qRound64(wall * 1000);
+  for(int p = 0; p < PHASE_COUNT; p++)
+    out << "," << qRound64(mFrame[p] * 1000);
+  out << "\n";
+  out.flush();
+}
+
+double DutyCycleAccountant::getFrameDutyCycle() const {
+  double wall = std::accumulate(mFrame.begin(), mFrame.end(), 0.0);
+  return wall > 0 ? 100 * mFrame[PHASE_EXPOSURE] / wall : 0.0;
+}
+
+double DutyCycleAccountant::getDutyCycle() const {
+  return mFramesWall > 0 ? 100 * mTotal[PHASE_EXPOSURE] / mFramesWall : 0.0;
+}
+
+double DutyCycleAccountant::getMeanOverhead() const {
+  if(mFrames == 0)
+    return 0;
+  double overhead = mFramesWall - mTotal[PHASE_EXPOSURE] - mTotal[PHASE_FILTER_MOVE];
+  return overhead / mFrames;
+}
+
+QStringList DutyCycleAccountant::getSummary() const {
+
+  double sequence_wall = seconds(Clock::now() - mSequenceStart);
+  QStringList lines;
+  lines << QString("duty cycle %1% over %2 frames (%3 s); %4 s before the first frame")
+    .arg(getDutyCycle(), 0, 'f', 1).arg(mFrames)
+    .arg(mFramesWall, 0, 'f', 1).arg(sequence_wall - mFramesWall, 0, 'f', 1);
+
+  for(int p = 0; p < PHASE_COUNT; p++) {
+    if(mTotal[p] == 0)
+      continue;
+    lines << QString("  %1 %2 s (%3%), %4 ms/frame")
+      .arg(getPhaseName(Phase(p)), -12)
+      .arg(mTotal[p], 9, 'f', 3)
+      .arg(mFramesWall > 0 ? 100 * mTotal[p] / mFramesWall : 0.0, 5, 'f', 1)
+      .arg(mFrames > 0 ? 1000 * mTotal[p] / mFrames : 0.0, 0, 'f', 1);
+  }
+
+  return lines;
+}
@@ -0,0 +1,108 @@
+#ifndef DUTY_CYCLE_HPP
+#define DUTY_CYCLE_HPP
+
+// project includes
+#include "image_data.hpp"
+
+// system includes
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <array>
+#include <chrono>
+
+/// Splits the wall time of an exposure sequence into what it was spent on.
+///
+/// Each frame's wall time runs from beginFrame() to endFrame(). It is split
+/// into the phases below, and whatever no phase claims is counted as other.
+/// The duty cycle is the exposure phase (the requested shutter time) over
+/// wall time. Every frame is written as one line of a CSV timing log, and
+/// the totals are given by getSummary().
+class DutyCycleAccountant {
+
+public:
+  /// Where a frame's wall time went.
+  enum Phase {
+    PHASE_MOUNT_WAIT,  ///< Waiting for the mount to settle.
+    PHASE_FILTER_MOVE, ///< Waiting for the filter wheel.
+    PHASE_START,       ///< Starting the exposure.
+    PHASE_EXPOSURE,    ///< Requested exposure time.
+    PHASE_COMPLETION,  ///< Detecting the end of the exposure.
+    PHASE_READOUT,     ///< Reading out the CCD.
+    PHASE_TEMPERATURE, ///< Temperature and other metadata after the readout.
+    PHASE_PROCESSING,  ///< Defect, cosmic ray and auto-exposure processing.
+    PHASE_COORDINATES, ///< Attaching mount coordinates and tracking errors.
+    PHASE_SEND,        ///< Handing the frame to the network.
+    PHASE_FITS_WRITE,  ///< Writing the FITS file.
+    PHASE_OTHER,       ///< Everything else.
+    PHASE_COUNT,
+  };
+
+  typedef std::chrono::high_resolution_clock Clock;
+
+  /// Default constructor
+  DutyCycleAccountant();
+
+protected:
+  typedef std::array<double, PHASE_COUNT> Times;
+
+  Clock::time_point mSequenceStart; ///< Set by beginSequence().
+  Clock::time_point mFrameStart; ///< Set by beginFrame().
+  Clock::time_point mLap; ///< End of the last phase recorded by lap().
+  Times mFrame; ///< Time in each phase this frame (seconds).
+  Times mTotal; ///< Time in each phase over all frames (seconds).
+  double mFramesWall = 0; ///< Wall time of all frames (seconds).
+  int mFrames = 0; ///< Frames counted.
+
+  QFile mLog; ///< Per-frame timing log, if open.
+
+public:
+  /// Get the name of a phase as used in the log and summary.
+  static const char * getPhaseName(Phase phase);
+
+  /// Start a sequence, clearing the totals.
+  /// \param log_filename File for the per-frame timing log. Empty disables it.
+  void beginSequence(const QString & log_filename = "");
+
+  /// Start a frame.
+  void beginFrame();
+
+  /// Charge the time since the last lap (or beginFrame()) to a phase.
+  void lap(Phase phase);
+
+  /// Charge time to a phase.
+  /// \param seconds Time (seconds).
+  void add(Phase phase, double seconds);
+
+  /// Split a call to Camera::acquireImage() into its phases using the times
+  /// recorded in the image, and restart the lap.
+  /// \param image The image returned.
+  /// \param call_start Time the call was made.
+  void addAcquisition(const ImageData & image, Clock::time_point call_start);
+
+  /// End a frame, log it and add it to the totals.
+  /// \param index Index of the frame in the sequence.
+  /// \param aborted Whether the frame was aborted.
+  void endFrame(int index, bool aborted);
+
+  /// Get the duty cycle of the last frame (percent).
+  double getFrameDutyCycle() const;
+
+  /// Get the duty cycle of all frames so far (percent).
+  double getDutyCycle() const;
+
+  /// Get the number of frames counted so far.
+  int getFrameCount() const { return mFrames; }
+
+  /// Get the mean time per frame spent on anything other than the exposure
+  /// and filter moves (seconds). 0 before the first frame.
+  double getMeanOverhead() const;
+
+  /// Describe the totals, one line per phase.
+  /// \return The summary. The first line gives the overall duty cycle.
+  QStringList getSummary() const;
+
+  //
+}; // DutyCycleAccountant
+
+#endif // DUTY_CYCLE_HPP
@@ -0,0 +1,202 @@
+#include "fanout_hub.hpp"
+
+// system includes
+#include <QDebug>
+#include <QDir>
+#include <algorithm>
+#include <chrono>
+
+FanoutHub::FanoutHub()
+  : QObject(nullptr) {
+}
+
+FanoutHub::~FanoutHub() {
+}
+
+FanoutHub::Subscriber * FanoutHub::find(QWebSocket * socket) {
+  for(auto & s: mSubscribers) {
+    if(s->socket == socket)
+      return s.get();
+  }
+  return nullptr;
+}
+
+void FanoutHub::addSubscriber(QWebSocket * socket) {
+  if(find(socket) != nullptr)
+    return;
+
+  auto s = std::unique_ptr<Subscriber>(new Subscriber());
+  s->socket = socket;
+  connect(socket, &QWebSocket::bytesWritten, this, [this, socket](qint64 bytes) {
+      Subscriber * s = find(socket);
+      if(s == nullptr)
+        return;
+      s->in_flight = std::max<qint64>(0, s->in_flight - bytes);
+      pump(*s);
+    });
+  mSubscribers.push_back(std::move(s));
+}
+
+void FanoutHub::removeSubscriber(QWebSocket * socket) {
+  for(auto it = mSubscribers.begin(); it != mSubscribers.end(); ++it) {
+    if((*it)->socket == socket) {
+      auto & s = **it;
+      if(s.dropped > 0 || s.spilled > 0)
+        qInfo() << "Subscriber left having dropped" << s.dropped
+                << "and spilled" << s.spilled << "messages";
+      disconnect(socket, &QWebSocket::bytesWritten, this, nullptr);
+      mSubscribers.erase(it);
+      return;
+    }
+  }
+}
+
+void FanoutHub::setPolicy(QWebSocket * socket, Policy policy) {
+  Subscriber * s = find(socket);
+  if(s != nullptr)
+    s->policy = policy;
+}
+
+size_t FanoutHub::getQueueDepth() const {
+  size_t depth = 0;
+  for(auto & s: mSubscribers)
+    depth += s->queue.size();
+  return depth;
+}
+
+void FanoutHub::publishStatus(const QString & text) {
+  Message m;
+  m.data = std::make_shared<const QByteArray>(text.toUtf8());
+  publish(m);
+}
+
+void FanoutHub::publishFrame(std::shared_ptr<ImageData> image) {
+  using namespace std::chrono;
+
+  // Encode in the calling thread so the hub's thread only moves bytes.
+  ImageChunkHeader h;
+  QByteArray payload;
+  const char * pixels = reinterpret_cast<const char *>(image->data.data());
+  int n_bytes = image->data.size() * sizeof(uint16_t);
+  if(mCompress) {
+    payload = qCompress(reinterpret_cast<const uchar *>(pixels), n_bytes);
+    h.flags = ImageChunkHeader::FLAG_COMPRESSED;
+  } else {
+    payload = QByteArray::fromRawData(pixels, n_bytes);
+  }
+
+  h.type        = ImageChunkHeader::TYPE_CHUNK;
+  h.width       = image->width;
+  h.height      = image->height;
+  h.total_bytes = payload.size();
+  h.offset      = 0;
+  h.length      = payload.size();
+  h.exposure_start_us =
+    duration_cast<microseconds>(image->exposure_start.time_since_epoch()).count();
+
+  h.frame_id = mNextFrameId++;
+
+  auto frame = std::make_shared<QByteArray>(h.toByteArray());
+  frame->reserve(frame->size() + payload.size());
+  frame->append(payload);
+
+  Message m;
+  m.data = frame;
+  m.binary = true;
+  m.is_frame = true;
+  QMetaObject::invokeMethod(this, [this, m]() { publish(m); }, Qt::QueuedConnection);
+}
+
+void FanoutHub::publish(const Message & message) {
+  for(auto & s: mSubscribers) {
+    if(message.is_frame && s->policy == POLICY_NONE)
+      continue;
+    enqueue(*s, message);
+    pump(*s);
+  }
+}
+
+void FanoutHub::enqueue(Subscriber & s, const Message & message) {
+
+  Entry e;
+  e.message = message;
+  e.size = message.data->size();
+
+  if(s.policy == POLICY_LOSSLESS) {
+    // Keep everything. Whatever does not fit in memory goes to disk.
+    if(s.queued_bytes + e.size > mMaxQueuedBytes) {
+      if(s.spill == nullptr) {
+        QString dir = mSpillDir.isEmpty() ? QDir::tempPath() : mSpillDir;
+        s.spill.reset(new QTemporaryFile(QDir(dir).filePath("fanout-XXXXXX.spill")));
+        if(!s.spill->open()) {
+          qWarning() << "Could not open spill file in" << dir << "; dropping message";
+          s.spill.reset();
+          s.dropped++;
+          return;
+        }
+      }
+      e.spill_offset = s.spill->size();
+      s.spill->seek(e.spill_offset);
+      if(s.spill->write(*e.message.data) != e.size) {
+        qWarning() << "Could not write spill file; dropping message";
+        s.dropped++;
+        return;
+      }
+      e.message.data.reset();
+      s.spilled++;
+    }
+  } else {
+    // Previews only care about the newest frame.
+    if(message.is_frame) {
+      for(auto it = s.queue.begin(); it != s.queue.end();) {
+        if(it->message.is_frame) {
+          s.queued_bytes -= it->size;
+          s.dropped++;
+          it = s.queue.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+
+    // Make room by discarding the oldest messages.
+    while(!s.queue.empty() && s.queued_bytes + e.size > mMaxQueuedBytes) {
+      s.queued_bytes -= s.queue.front().size;
+      s.queue.pop_front();
+      s.dropped++;
+    }
+  }
+
+  if(e.spill_offset < 0)
+    s.queued_bytes += e.size;
+  s.queue.push_back(std::move(e));
+}
+
+void FanoutHub::pump(Subscriber & s) {
+
+  if(!s.socket->isValid())
+    return;
+
+  while(!s.queue.empty() && s.in_flight < mWindowSize) {
+    Entry & e = s.queue.front();
+
+    std::shared_ptr<const QByteArray> data = e.message.data;
+    if(e.spill_offset >= 0) {
+      s.spill->seek(e.spill_offset);
+      data = std::make_shared<const QByteArray>(s.spill->read(e.size));
+    } else {
+      s.queued_bytes -= e.size;
+    }
+
+    if(e.message.binary)
+      s.socket->sendBinaryMessage(*data);
+    else
+      s.socket->sendTextMessage(QString::fromUtf8(*data));
+    s.in_flight += e.size;
+    s.queue.pop_front();
+  }
+
+  // Reclaim the spill file once everything in it has been sent.
+  if(s.queue.empty() && s.spill != nullptr && s.spill->size() > 0)
+    s.spill->resize(0);
+}
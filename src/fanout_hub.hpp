@@ -0,0 +1,139 @@
+#ifndef FANOUT_HUB_HPP
+#define FANOUT_HUB_HPP
+
+// local includes
+#include "image_sender.hpp"
+
+// project includes
+#include "image_data.hpp"
+
+// system includes
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QTemporaryFile>
+#include <QWebSocket>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+/// Distributes frames and status messages to any number of WebSocket
+/// subscribers without letting a slow one hold back the others.
+///
+/// Each message is encoded once and shared by reference between subscribers.
+/// Every subscriber has its own queue, bounded in bytes, and its own
+/// flow-control window. What happens when a queue is full depends on the
+/// subscriber's frame policy:
+///
+///  - POLICY_NONE: the subscriber receives status messages only.
+///  - POLICY_LATEST_ONLY: a new frame replaces any frame still waiting, and
+///    the oldest waiting messages are dropped when the queue is full. Suited
+///    to previews.
+///  - POLICY_LOSSLESS: messages that do not fit in memory are written to a
+///    per-subscriber spill file and sent, in order, once the subscriber
+///    catches up. Suited to archivers.
+///
+/// Frames use the ImageChunkHeader format with the whole frame in one
+/// message (offset 0, length total_bytes). Receivers do not acknowledge them.
+class FanoutHub : public QObject {
+  Q_OBJECT;
+
+public:
+  /// What a subscriber receives and how its queue overflows.
+  enum Policy {
+    POLICY_NONE,
+    POLICY_LATEST_ONLY,
+    POLICY_LOSSLESS,
+  };
+
+  /// Default constructor
+  FanoutHub();
+  /// Default destructor.
+  ~FanoutHub();
+
+protected:
+  /// A message shared by every subscriber it is queued for.
+  struct Message {
+    std::shared_ptr<const QByteArray> data; ///< Encoded message.
+    bool binary = false; ///< Binary or text WebSocket message.
+    bool is_frame = false; ///< Whether the message carries a frame.
+  };
+
+  /// A message waiting in a subscriber's queue.
+  struct Entry {
+    Message message; ///< The message. data is null once spilled.
+    qint64 size = 0; ///< Size of the message (bytes).
+    qint64 spill_offset = -1; ///< Location in the spill file, -1 if in memory.
+  };
+
+  /// State kept for each subscriber.
+  struct Subscriber {
+    QWebSocket * socket = nullptr; ///< Socket for the subscriber. Not owned.
+    Policy policy = POLICY_NONE; ///< Frame policy.
+    std::deque<Entry> queue; ///< Messages not yet handed to the socket.
+    qint64 queued_bytes = 0; ///< Bytes of queued messages held in memory.
+    qint64 in_flight = 0; ///< Bytes handed to the socket but not yet written.
+    std::unique_ptr<QTemporaryFile> spill; ///< Overflow for POLICY_LOSSLESS.
+    size_t dropped = 0; ///< Messages dropped.
+    size_t spilled = 0; ///< Messages written to the spill file.
+  };
+
+  std::vector<std::unique_ptr<Subscriber>> mSubscribers; ///< Current subscribers.
+
+  std::atomic<quint32> mNextFrameId{1}; ///< Identifier for the next frame.
+  bool mCompress = false; ///< Whether frames are compressed.
+  qint64 mMaxQueuedBytes = 64 * 1024 * 1024; ///< Memory allowed per subscriber queue.
+  qint64 mWindowSize = 4 * 1024 * 1024; ///< Max unwritten bytes per socket.
+  QString mSpillDir; ///< Directory for spill files. Empty for the system default.
+
+protected:
+  /// Find the subscriber for a socket, or nullptr.
+  Subscriber * find(QWebSocket * socket);
+
+  /// Queue a message for every subscriber that wants it.
+  void publish(const Message & message);
+
+  /// Add a message to one subscriber's queue, applying its policy.
+  void enqueue(Subscriber & s, const Message & message);
+
+  /// Hand queued messages to a subscriber's socket while its window allows.
+  void pump(Subscriber & s);
+
+public:
+  /// Start sending to a socket. Subscribers get status messages only until
+  /// setPolicy() is called.
+  void addSubscriber(QWebSocket * socket);
+
+  /// Stop sending to a socket and discard its queue.
+  void removeSubscriber(QWebSocket * socket);
+
+  /// Set the frame policy for a subscriber.
+  void setPolicy(QWebSocket * socket, Policy policy);
+
+  /// Send a text message to every subscriber.
+  void publishStatus(const QString & text);
+
+  /// Send a frame to every subscriber with a frame policy. Safe to call from
+  /// any thread; the frame is encoded in the calling thread.
+  void publishFrame(std::shared_ptr<ImageData> image);
+
+  /// Get the number of messages waiting in every subscriber's queue.
+  size_t getQueueDepth() const;
+
+  /// Enable or disable zlib compression of frames.
+  void setCompression(bool compress) { mCompress = compress; }
+
+  /// Set the memory allowed for each subscriber's queue (bytes).
+  void setMaxQueuedBytes(qint64 bytes) { mMaxQueuedBytes = bytes; }
+
+  /// Set the maximum bytes handed to a socket but not yet written.
+  void setWindowSize(qint64 bytes) { mWindowSize = bytes; }
+
+  /// Set the directory used for spill files.
+  void setSpillDirectory(const QString & directory) { mSpillDir = directory; }
+
+  //
+}; // FanoutHub
+
+#endif // FANOUT_HUB_HPP
@@ -0,0 +1,189 @@
+#include "image_sender.hpp"
+
+// system includes
+#include <QDataStream>
+#include <QDebug>
+#include <algorithm>
+#include <chrono>
+
+QByteArray ImageChunkHeader::toByteArray() const {
+  QByteArray output;
+  output.reserve(SIZE);
+
+  QDataStream s(&output, QIODevice::WriteOnly);
+  s << MAGIC << type << flags << frame_id << width << height
+    << total_bytes << offset << length << exposure_start_us;
+
+  return output;
+}
+
+bool ImageChunkHeader::fromByteArray(const QByteArray & message) {
+  if(message.size() < SIZE)
+    return false;
+
+  QDataStream s(message);
+  quint32 magic = 0;
+  s >> magic;
+  if(magic != MAGIC)
+    return false;
+
+  s >> type >> flags >> frame_id >> width >> height
+    >> total_bytes >> offset >> length >> exposure_start_us;
+
+  return s.status() == QDataStream::Ok;
+}
+
+ImageSender::ImageSender(QWebSocket * socket)
+  : QObject(nullptr), mWebSocket(socket) {
+
+  connect(mWebSocket, &QWebSocket::bytesWritten,
+          this, &ImageSender::pump);
+}
+
+ImageSender::~ImageSender() {
+}
+
+void ImageSender::enqueue(std::shared_ptr<ImageData> image) {
+  using namespace std::chrono;
+
+  // Encode the frame in the calling thread so the GUI thread only moves bytes.
+  auto transfer = std::make_shared<Transfer>();
+  const char * pixels = reinterpret_cast<const char *>(image->data.data());
+  int n_bytes = image->data.size() * sizeof(uint16_t);
+  if(mCompress) {
+    transfer->payload = qCompress(reinterpret_cast<const uchar *>(pixels), n_bytes);
+    transfer->header.flags = ImageChunkHeader::FLAG_COMPRESSED;
+  } else {
+    transfer->payload = QByteArray(pixels, n_bytes);
+  }
+
+  auto & h = transfer->header;
+  h.type        = ImageChunkHeader::TYPE_CHUNK;
+  h.width       = image->width;
+  h.height      = image->height;
+  h.total_bytes = transfer->payload.size();
+  h.exposure_start_us =
+    duration_cast<microseconds>(image->exposure_start.time_since_epoch()).count();
+
+  {
+    const std::lock_guard<std::mutex> lock(mQueueMutex);
+    h.frame_id = mNextFrameId++;
+
+    // Never block the caller. Drop the oldest waiting frame instead.
+    if(mQueue.size() >= mMaxQueuedFrames) {
+      qWarning() << "Image queue full, dropping frame" << mQueue.front()->header.frame_id;
+      mQueue.pop_front();
+      mFramesDropped++;
+    }
+    mQueue.push_back(transfer);
+  }
+
+  QMetaObject::invokeMethod(this, &ImageSender::pump, Qt::QueuedConnection);
+}
+
+void ImageSender::pump() {
+
+  if(!mWebSocket->isValid())
+    return;
+
+  while(true) {
+    // Pick up the next frame if nothing is in flight.
+    if(mActive == nullptr) {
+      const std::lock_guard<std::mutex> lock(mQueueMutex);
+      if(mQueue.empty())
+        return;
+
+      mActive = mQueue.front();
+      mQueue.pop_front();
+      mActive->timer.start();
+    }
+
+    // Everything handed to the socket; wait for acknowledgements.
+    auto & t = *mActive;
+    if(t.sent_offset >= t.header.total_bytes)
+      return;
+
+    // Respect the flow-control window and the socket's own buffer.
+    qint64 in_flight = qint64(t.sent_offset) - t.acked_offset;
+    if(in_flight >= mWindowSize || mWebSocket->bytesToWrite() >= mWindowSize)
+      return;
+
+    ImageChunkHeader h = t.header;
+    h.offset = t.sent_offset;
+    h.length = std::min<quint32>(mChunkSize, t.header.total_bytes - t.sent_offset);
+
+    QByteArray message = h.toByteArray();
+    message.append(t.payload.constData() + h.offset, h.length);
+    mWebSocket->sendBinaryMessage(message);
+
+    t.sent_offset += h.length;
+  }
+}
+
+bool ImageSender::processMessage(const QByteArray & message) {
+
+  ImageChunkHeader h;
+  if(!h.fromByteArray(message))
+    return false;
+
+  if(h.type != ImageChunkHeader::TYPE_ACK)
+    return true;
+
+  // Ignore acknowledgements for frames no longer in flight.
+  if(mActive == nullptr || h.frame_id != mActive->header.frame_id)
+    return true;
+
+  auto & t = *mActive;
+  t.acked_offset = std::max(t.acked_offset, std::min(h.offset, t.header.total_bytes));
+
+  if(t.acked_offset >= t.header.total_bytes) {
+    double seconds = t.timer.nsecsElapsed() * 1E-9;
+    if(seconds > 0)
+      mLastThroughput = t.header.total_bytes / seconds / (1024.0 * 1024.0);
+
+    qInfo() << "Sent frame" << t.header.frame_id
+            << "(" << t.header.total_bytes << "bytes) at"
+            << mLastThroughput << "MiB/s";
+
+    mFramesSent++;
+    mActive.reset();
+  }
+
+  pump();
+  return true;
+}
+
+void ImageSender::onConnected() {
+  pump();
+}
+
+void ImageSender::onDisconnected() {
+  // Anything beyond the last acknowledgement may have been lost. Resend it
+  // once the connection is re-established.
+  if(mActive != nullptr) {
+    qInfo() << "Image transfer interrupted at"
+            << mActive->acked_offset << "of" << mActive->header.total_bytes << "bytes";
+    mActive->sent_offset = mActive->acked_offset;
+  }
+}
+
+size_t ImageSender::getQueueDepth() {
+  const std::lock_guard<std::mutex> lock(mQueueMutex);
+  return mQueue.size() + (mActive != nullptr ? 1 : 0);
+}
+
+void ImageSender::setCompression(bool compress) {
+  mCompress = compress;
+}
+
+void ImageSender::setChunkSize(int bytes) {
+  mChunkSize = std::max(1024, bytes);
+}
+
+void ImageSender::setWindowSize(qint64 bytes) {
+  mWindowSize = std::max<qint64>(mChunkSize, bytes);
+}
+
+void ImageSender::setMaxQueuedFrames(size_t frames) {
+  mMaxQueuedFrames = std::max<size_t>(1, frames);
+}
@@ -0,0 +1,150 @@
+#ifndef IMAGE_SENDER_HPP
+#define IMAGE_SENDER_HPP
+
+// project includes
+#include "image_data.hpp"
+
+// system includes
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QWebSocket>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+/// Header prepended to every binary image transfer message. Image messages
+/// share the WebSocket with NIAD envelopes and are distinguished by the magic
+/// number at the start of the message. All fields are big-endian.
+struct ImageChunkHeader {
+  static const quint32 MAGIC = 0x4E494D47; ///< 'NIMG'
+  static const int SIZE = 40; ///< Size of the serialized header (bytes).
+
+  /// Message types for image transfers.
+  enum Type : quint16 {
+    TYPE_CHUNK  = 1, ///< Sender to receiver: a slice of a frame.
+    TYPE_ACK    = 2, ///< Receiver to sender: all bytes before offset received.
+  };
+
+  /// Flags describing the frame payload.
+  enum Flags : quint16 {
+    FLAG_NONE       = 0,
+    FLAG_COMPRESSED = 1, ///< Payload is zlib compressed (see qCompress).
+  };
+
+  quint16 type        = TYPE_CHUNK; ///< Message type.
+  quint16 flags       = FLAG_NONE; ///< Payload flags.
+  quint32 frame_id    = 0; ///< Identifier for the frame, unique per session.
+  quint32 width       = 0; ///< Width of the image (pixels).
+  quint32 height      = 0; ///< Height of the image (pixels).
+  quint32 total_bytes = 0; ///< Total size of the (possibly compressed) payload.
+  quint32 offset      = 0; ///< Offset of this chunk within the payload.
+  quint32 length      = 0; ///< Length of the data following this header.
+  qint64  exposure_start_us = 0; ///< Exposure start, microseconds since epoch.
+
+  /// Serialize the header to a byte array.
+  QByteArray toByteArray() const;
+
+  /// Parse a header from the start of a message.
+  /// \return true if the message contained a valid header.
+  bool fromByteArray(const QByteArray & message);
+
+  //
+}; // ImageChunkHeader
+
+/// Class to deliver images to a NIAD server over an existing WebSocket.
+///
+/// Frames are split into fixed-size chunks and sent as binary messages. The
+/// number of unacknowledged bytes is bounded by a window so that a slow
+/// receiver cannot grow the socket's write buffer without limit. Frames are
+/// queued up to a fixed depth; when the queue is full the oldest frame that
+/// has not begun transmission is dropped so acquisition is never blocked.
+/// If the connection drops, the frame in flight is resumed from the last
+/// acknowledged offset once the socket reconnects.
+class ImageSender : public QObject {
+  Q_OBJECT;
+
+public:
+  /// Default constructor
+  /// \param socket WebSocket over which images are sent. Not owned.
+  ImageSender(QWebSocket * socket);
+  /// Default destructor.
+  ~ImageSender();
+
+protected:
+  /// A frame awaiting (or undergoing) transmission.
+  struct Transfer {
+    ImageChunkHeader header; ///< Header template for this frame.
+    QByteArray payload; ///< Encoded frame data.
+    quint32 sent_offset  = 0; ///< Bytes handed to the socket.
+    quint32 acked_offset = 0; ///< Bytes acknowledged by the receiver.
+    QElapsedTimer timer; ///< Started when the first chunk is sent.
+  };
+
+  QWebSocket * mWebSocket = nullptr; ///< Socket used for transfers.
+
+  std::mutex mQueueMutex; ///< Protects mQueue.
+  std::deque<std::shared_ptr<Transfer>> mQueue; ///< Frames waiting to be sent.
+  std::shared_ptr<Transfer> mActive; ///< Frame currently being sent.
+
+  quint32 mNextFrameId = 1; ///< Identifier for the next frame.
+  bool mCompress = false; ///< Whether frames should be compressed.
+  int mChunkSize = 256 * 1024; ///< Size of each chunk (bytes).
+  qint64 mWindowSize = 4 * 1024 * 1024; ///< Max unacknowledged bytes.
+  size_t mMaxQueuedFrames = 4; ///< Max frames held before dropping.
+
+  size_t mFramesSent = 0; ///< Frames fully acknowledged.
+  size_t mFramesDropped = 0; ///< Frames dropped due to a full queue.
+  double mLastThroughput = 0; ///< Throughput of the last frame (MiB/s).
+
+protected slots:
+  /// Send as many chunks as the flow-control window permits.
+  void pump();
+
+public slots:
+  /// Called when the socket (re)connects. Resumes any frame in flight.
+  void onConnected();
+  /// Called when the socket disconnects. Rewinds to the last acknowledged byte.
+  void onDisconnected();
+
+public:
+  /// Queue an image for delivery. Safe to call from any thread.
+  /// \param image The image to send.
+  void enqueue(std::shared_ptr<ImageData> image);
+
+  /// Process an image transfer message from the receiver.
+  /// \param message A binary WebSocket message.
+  /// \return true if the message was an image transfer message.
+  bool processMessage(const QByteArray & message);
+
+  /// Enable or disable zlib compression of frames.
+  void setCompression(bool compress);
+
+  /// Whether frames are compressed.
+  bool getCompression() { return mCompress; }
+
+  /// Set the chunk size in bytes.
+  void setChunkSize(int bytes);
+
+  /// Set the maximum number of unacknowledged bytes on the wire.
+  void setWindowSize(qint64 bytes);
+
+  /// Set the maximum number of frames waiting to be sent.
+  void setMaxQueuedFrames(size_t frames);
+
+  /// Get the throughput of the most recently completed frame (MiB/s).
+  double getLastThroughput() { return mLastThroughput; }
+
+  /// Get the number of frames delivered.
+  size_t getFramesSent() { return mFramesSent; }
+
+  /// Get the number of frames dropped.
+  size_t getFramesDropped() { return mFramesDropped; }
+
+  /// Get the number of frames waiting to be sent, including any in flight.
+  size_t getQueueDepth();
+
+  //
+}; // ImageSender
+
+#endif // IMAGE_SENDER_HPP
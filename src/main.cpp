@@ -4,32 +4,57 @@
 #include "niad-tools.hpp"
 #include "version.h"
 
+// vendor-specific includes
+#include "sbig_st_trace.hpp"
+
 // local includes
 #include "worker.hpp"
 #include "client.hpp"
+#include "camera_server.hpp"
+#include "metrics_server.hpp"
+#include "observation_plan.hpp"
 
 // system includes
 #include <QCoreApplication>
 #include <QDateTime>
 #include <QDebug>
 #include <QTimeZone>
+#include <QHostAddress>
 #include <QWebSocket>
 #include <QCommandLineParser>
 #include <QCommandLineOption>
 #include <QTimer>
 #include <QThread>
 #include <QSettings>
+#include <QStandardPaths>
+#include <QMap>
 #include <csignal>
+#include <memory>
+#include <vector>
+
+std::vector<QThread *> worker_threads;
+std::vector<Worker *> workers;
+CameraServer * camera_server = nullptr;
+MetricsServer * metrics_server = nullptr;
 
-QThread * worker_thread = nullptr;
-Worker * worker = nullptr;
+// Set from the signal handler and acted on by a timer in the event loop;
+// logging, aborting the driver and posting events are not async-signal-safe.
+volatile std::sig_atomic_t quit_requested = 0;
 
 void signal_handler(int s) {
   std::signal(s, SIG_DFL);
+  quit_requested = 1;
+}
 
+void handle_quit_request() {
   qInfo() << "Quitting...";
 
-  worker->stopExposures();
+  for(auto worker: workers)
+    worker->stopExposures();
+
+  // In server mode the worker never finishes on its own.
+  if(camera_server != nullptr)
+    QCoreApplication::quit();
 }
 
 int setup_from_cli(Worker *worker, QThread *worker_thread,
@@ -71,6 +96,21 @@ int main(int argc, char *argv[]) {
       {"config",
        "Configuration file",
        "config"},
+      {"camera",
+       "Camera to use as MODEL[:FILTER_WHEEL[:SERIAL]] (default ST-10:CFW-8). "
+       "Repeat to run a sequence on several cameras at once.",
+       "camera"},
+      {"server-port",
+       "Serve the camera on this port and wait for remote commands instead of "
+       "running a single exposure sequence",
+       "port"},
+      {"metrics-port",
+       "Serve metrics in the Prometheus text format on this port at /metrics",
+       "port"},
+      {"metrics-bind",
+       "Address on which to serve metrics (default 127.0.0.1). Use 0.0.0.0 "
+       "to allow remote scrapes",
+       "address"},
       {"catalog",
        "The catalog to which the object belongs",
        "catalog"},
@@ -87,13 +127,103 @@ int main(int argc, char *argv[]) {
        "filter"},
       {"telescope-url", "URI to a NIAD telescope",
        "url"},
+      {"settle-velocity",
+       "Wait before each exposure until the mount moves slower than this "
+       "(arcsec/s, default 2)",
+       "rate", "2"},
+      {"settle-jitter",
+       "Wait before each exposure until the mount jitter is below this "
+       "(arcsec RMS, default 1)",
+       "arcsec", "1"},
+      {"settle-window",
+       "Time over which mount settling is judged (seconds, default 2)",
+       "seconds", "2"},
+      {"mount-timeout",
+       "Longest wait for the mount to be ready and settled (seconds, default 120)",
+       "seconds"},
+      {"cooler-tolerance",
+       "Wait before a sequence until the CCD is within this of the set point "
+       "(Celsius, default 0.5)",
+       "celsius"},
+      {"cooler-timeout",
+       "Longest wait for the CCD temperature to stabilize (seconds, default "
+       "1800). 0 starts exposing immediately.",
+       "seconds"},
+      {"bias-while-cooling",
+       "Take bias frames while waiting for the CCD temperature to stabilize"},
+      {"plan",
+       "Run the targets in this JSON observation plan instead of a single "
+       "sequence",
+       "file"},
+      {"telemetry-period",
+       "Read the camera temperatures in the background this often "
+       "(seconds, default 5). 0 disables the readings.",
+       "seconds"},
+      {"tracking-threshold",
+       "Flag images whose peak tracking error exceeds this (arcsec)",
+       "arcsec"},
+      {"coordinate-rate",
+       "Buffer telescope coordinates at most this often (Hz). Faster updates "
+       "are averaged. Default keeps every update.",
+       "rate"},
+      {"mount-stats",
+       "Log the mount update rate, latency, lost updates and CPU use every "
+       "second (for testing with mock-mount)"},
+      {"record-mount",
+       "Save every message from the mount to this file for niad-bench",
+       "file"},
       {"readout-mode",
        "Readout mode to use. Valid options are 1x1, 2x2, 3x3, 9x9",
        "mode"},
       {"shutter-mode",
        "Shutter mode to use. Valid options are OPEN_CLOSE [default], "
        "CLOSE_CLOSE",
-       "shutter-mode"}});
+       "shutter-mode"},
+      {"image-action",
+       "What to do with images. Valid options are STORE [default], SEND, "
+       "SEND_AND_STORE",
+       "image-action"},
+      {"compress-images",
+       "Compress images sent to the NIAD server"},
+      {"defect-map-dir",
+       "Directory containing hot pixel and bad column maps",
+       "dir"},
+      {"build-defect-map",
+       "Build a defect map from this sequence, which should be darks"},
+      {"clean-cosmic-rays",
+       "Remove cosmic rays from each image"},
+      {"auto-exposure-level",
+       "Adjust exposure durations to reach this median level (ADU). "
+       "exposure_duration is used for the first frame.",
+       "adu"},
+      {"auto-exposure-snr",
+       "Adjust exposure durations so the brightest star reaches this SNR. "
+       "exposure_duration is used for the first frame.",
+       "snr"},
+      {"bias-level",
+       "Detector bias level for auto-exposure (ADU, default 100)",
+       "adu"},
+      {"gain",
+       "Detector gain (e-/ADU). Defaults to the gain the camera reports.",
+       "gain"},
+      {"read-noise",
+       "Detector read noise for auto-exposure and cosmic ray cleaning "
+       "(e-, default 8.8)",
+       "electrons"},
+      {"trace-record",
+       "Record every SBIG driver call to this file for later replay",
+       "file"},
+      {"trace-replay",
+       "Answer SBIG driver calls from a recorded trace instead of a camera",
+       "file"},
+      {"device-cache",
+       "Directory in which camera information is cached between runs "
+       "(defaults to the user cache directory)",
+       "dir"},
+      {"replay-time-scale",
+       "Multiplier for recorded driver call durations during replay. "
+       "0 replays as fast as possible (default 1).",
+       "scale"}});
 
   // Process command line options
   parser.process(app);
@@ -101,14 +231,128 @@ int main(int argc, char *argv[]) {
 
   Client client;
 
-  // Create a camera controler.
-  worker_thread = new QThread();
-  worker = new Worker(&client);
-  worker->moveToThread(worker_thread);
-  QObject::connect(worker_thread, &QThread::started, worker, &Worker::run);
-  QObject::connect(worker, &Worker::finished, worker_thread, &QThread::quit);
-  QObject::connect(worker_thread, &QThread::finished, &app,
-                   &QCoreApplication::quit);
+  // Read the server port and cameras before anything else so we know how to
+  // start.
+  quint16 server_port = 0;
+  quint16 metrics_port = 0;
+  QString metrics_bind = "127.0.0.1";
+  QStringList cameras;
+  QString trace_record;
+  QString trace_replay;
+  double replay_time_scale = 1;
+  QString device_cache =
+    QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/devices";
+  if (parser.isSet("config")) {
+    QSettings settings(parser.value("config"), QSettings::IniFormat);
+    server_port = settings.value("server/port", 0).toUInt();
+    metrics_port = settings.value("server/metrics_port", 0).toUInt();
+    metrics_bind = settings.value("server/metrics_bind", metrics_bind).toString();
+    cameras = settings.value("camera/devices").toStringList();
+    trace_record = settings.value("driver/trace_record").toString();
+    trace_replay = settings.value("driver/trace_replay").toString();
+    replay_time_scale = settings.value("driver/replay_time_scale", 1).toDouble();
+    device_cache = settings.value("driver/device_cache", device_cache).toString();
+  }
+  if (parser.isSet("server-port")) {
+    server_port = parser.value("server-port").toUShort();
+  }
+  if (parser.isSet("metrics-port")) {
+    metrics_port = parser.value("metrics-port").toUShort();
+  }
+  if (parser.isSet("metrics-bind")) {
+    metrics_bind = parser.value("metrics-bind");
+  }
+  if (parser.isSet("camera")) {
+    cameras = parser.values("camera");
+  }
+  if (cameras.isEmpty()) {
+    cameras << "ST-10:CFW-8";
+  }
+  if (cameras.size() > 1 && server_port > 0) {
+    qCritical() << "Only one camera can be served for remote control.";
+    return -1;
+  }
+  if (parser.isSet("trace-record")) {
+    trace_record = parser.value("trace-record");
+  }
+  if (parser.isSet("trace-replay")) {
+    trace_replay = parser.value("trace-replay");
+  }
+  if (parser.isSet("replay-time-scale")) {
+    replay_time_scale = parser.value("replay-time-scale").toDouble();
+  }
+  if (parser.isSet("device-cache")) {
+    device_cache = parser.value("device-cache");
+  }
+
+  // The driver is created by the first camera, so its backend must be
+  // chosen before any worker starts.
+  try {
+    if (!trace_replay.isEmpty()) {
+      qInfo() << "Replaying SBIG driver calls from" << trace_replay;
+      SbigSTDriver::SetBackend(std::unique_ptr<SbigSTBackend>(
+        new SbigSTTraceReplayer(trace_replay.toStdString(), replay_time_scale)));
+    } else if (!trace_record.isEmpty()) {
+      qInfo() << "Recording SBIG driver calls to" << trace_record;
+      SbigSTDriver::SetBackend(std::unique_ptr<SbigSTBackend>(
+        new SbigSTTraceRecorder(trace_record.toStdString())));
+    }
+  } catch (std::exception & e) {
+    qCritical() << e.what();
+    return -1;
+  }
+
+  // Cached camera information skips most of the queries made when a camera
+  // is opened. A replay must make the recorded queries, so it never uses it,
+  // and a recording must contain them for the replay to find.
+  if (!device_cache.isEmpty() && (!trace_replay.isEmpty() || !trace_record.isEmpty()))
+    qInfo() << "Not using the device cache while recording or replaying driver calls";
+  if (trace_replay.isEmpty() && trace_record.isEmpty() && !device_cache.isEmpty()) {
+    if (QDir().mkpath(device_cache))
+      SbigSTDriver::GetInstance().GetCCDInfoCache().SetDirectory(device_cache.toStdString());
+    else
+      qWarning() << "Cannot create device cache" << device_cache;
+  }
+
+  // Create a camera controller with its own thread for each camera. The
+  // controllers share the mount connection and the SBIG driver.
+  QMap<QString, int> model_count;
+  for (auto & camera: cameras) {
+    QStringList fields = camera.split(":");
+    QString model = fields.value(0);
+    QString serial = fields.value(2);
+    int skip = serial.isEmpty() ? model_count[model]++ : 0;
+
+    auto worker_thread = new QThread();
+    auto worker = new Worker(&client);
+    worker->setDevice(model, fields.value(1), serial, skip);
+    if (cameras.size() > 1)
+      worker->setLabel(model + "_" + (serial.isEmpty() ? QString::number(skip) : serial));
+    worker->moveToThread(worker_thread);
+
+    worker_threads.push_back(worker_thread);
+    workers.push_back(worker);
+  }
+
+  if (server_port > 0) {
+    // Keep the camera open and run sequences on request.
+    camera_server = new CameraServer(workers[0]);
+    if (!camera_server->listen(server_port))
+      return -1;
+    QObject::connect(worker_threads[0], &QThread::started,
+                     workers[0], &Worker::initialize);
+  } else {
+    // Quit once every camera has finished its sequence.
+    auto running = std::make_shared<size_t>(workers.size());
+    for (size_t i = 0; i < workers.size(); i++) {
+      QObject::connect(worker_threads[i], &QThread::started, workers[i], &Worker::run);
+      QObject::connect(workers[i], &Worker::finished, worker_threads[i], &QThread::quit);
+      QObject::connect(worker_threads[i], &QThread::finished, &app, [running]() {
+        if (--(*running) == 0)
+          QCoreApplication::quit();
+      });
+    }
+  }
 
   // Configure the application from either the CLI or parser.
   int status = 0;
@@ -119,20 +363,63 @@ int main(int argc, char *argv[]) {
     // Verify that the file exists.
     QFileInfo cfg_file(filename);
     if(cfg_file.exists() && cfg_file.isFile()) {
-      setup_from_config(worker, worker_thread, client, filename, parser);
+      for (size_t i = 0; i < workers.size() && status == 0; i++)
+        status = setup_from_config(workers[i], worker_threads[i], client, filename, parser);
     } else {
       qWarning() << "Configuration file not found. Exiting.";
       return 0;
     }
   } else {
-    setup_from_cli(worker, worker_thread, client, parser);
+    for (size_t i = 0; i < workers.size() && status == 0; i++)
+      status = setup_from_cli(workers[i], worker_threads[i], client, parser);
+  }
+  if (status < 0)
+    return status;
+
+  // Local subscribers get frames encoded the same way as the NIAD server.
+  if (camera_server != nullptr) {
+    camera_server->getHub().setCompression(client.getImageSender().getCompression());
+    workers[0]->setImageHub(&camera_server->getHub());
+  }
+
+  // Metrics are read on this thread from counters the workers keep anyway.
+  if (metrics_port > 0) {
+    metrics_server = new MetricsServer(&client, workers);
+    if (camera_server != nullptr)
+      metrics_server->setHub(&camera_server->getHub());
+    QHostAddress address;
+    if (!address.setAddress(metrics_bind)) {
+      qCritical() << "Invalid metrics bind address" << metrics_bind;
+      return -1;
+    }
+    if (!metrics_server->listen(metrics_port, address))
+      return -1;
   }
 
   // Start taking images.
-  worker_thread->start();
+  for (auto worker_thread: worker_threads)
+    worker_thread->start();
+
+  // Poll for SIGINT/SIGTERM; a second signal terminates immediately.
+  QTimer quit_timer;
+  quit_timer.setInterval(100);
+  QObject::connect(&quit_timer, &QTimer::timeout, [&quit_timer]() {
+      if(quit_requested == 0)
+        return;
+      quit_timer.stop();
+      handle_quit_request();
+    });
+  quit_timer.start();
 
   // Run the application and event loop.
-  return app.exec();
+  int result = app.exec();
+
+  if (camera_server != nullptr) {
+    worker_threads[0]->quit();
+    worker_threads[0]->wait();
+  }
+
+  return result;
 }
 
 int setup_from_cli(Worker * worker, QThread * worker_thread, Client & client,
@@ -148,9 +435,53 @@ int setup_from_cli(Worker * worker, QThread * worker_thread, Client & client,
   // before we start taking images.
   QString telescope_url = "None";
   bool connect_to_telescope = false;
+  if (parser.isSet("coordinate-rate")) {
+    client.setCoordinateRate(parser.value("coordinate-rate").toDouble());
+  }
+  if (parser.isSet("record-mount")) {
+    client.record(parser.value("record-mount"));
+  }
+  if (parser.isSet("mount-stats")) {
+    client.setStatisticsPeriod(1);
+  }
   if (parser.isSet("telescope-url")) {
     client.open(parser.value("telescope-url"));
   }
+  worker->setSettleThresholds(parser.value("settle-velocity").toDouble(),
+                              parser.value("settle-jitter").toDouble(),
+                              parser.value("settle-window").toDouble());
+  if (parser.isSet("mount-timeout")) {
+    worker->setMountTimeout(parser.value("mount-timeout").toDouble());
+  }
+  if (parser.isSet("tracking-threshold")) {
+    worker->setTrackingThreshold(parser.value("tracking-threshold").toDouble());
+  }
+  if (parser.isSet("telemetry-period")) {
+    worker->setTelemetryPeriod(parser.value("telemetry-period").toDouble());
+  }
+  if (parser.isSet("cooler-tolerance") || parser.isSet("cooler-timeout")) {
+    double tolerance = 0.5;
+    double timeout = 1800;
+    if (parser.isSet("cooler-tolerance"))
+      tolerance = parser.value("cooler-tolerance").toDouble();
+    if (parser.isSet("cooler-timeout"))
+      timeout = parser.value("cooler-timeout").toDouble();
+    worker->setCoolerThresholds(tolerance, 60, timeout);
+  }
+  worker->setBiasWhileCooling(parser.isSet("bias-while-cooling"));
+
+  // Run an observation plan instead of a single sequence.
+  bool have_plan = false;
+  if (parser.isSet("plan")) {
+    ObservationPlan plan;
+    QString error;
+    if (!plan.load(parser.value("plan"), error)) {
+      qCritical() << "Cannot load plan" << parser.value("plan") << ":" << error;
+      return -1;
+    }
+    worker->setPlan(plan);
+    have_plan = true;
+  }
 
   // Set the temperature. If there are no other requests, exit.
   double temperature = 0;
@@ -160,19 +491,17 @@ int setup_from_cli(Worker * worker, QThread * worker_thread, Client & client,
     worker->setTemperature(temperature);
 
     // If there are no further arguments, exit gracefully.
-    if (num_args == 0) {
+    if (num_args == 0 && !have_plan) {
       return 0;
     }
   }
 
-  // Set up the arguments
+  // Set up the arguments. They are optional when serving the camera.
   auto positionalArguments = parser.positionalArguments();
-  int num_exposures = positionalArguments[0].toInt();
-  worker->setExposureQuantity(positionalArguments[0].toInt());
-  double exposure_duration = positionalArguments[1].toDouble();
-  worker->setExposureDuration(positionalArguments[1].toDouble());
-
-  if (positionalArguments.isEmpty()) {
+  if (positionalArguments.size() >= 2) {
+    worker->setExposureQuantity(positionalArguments[0].toInt());
+    worker->setExposureDuration(positionalArguments[1].toDouble());
+  } else if (camera_server == nullptr && !have_plan) {
     cerr << "Missing required arguments. See -h for more information."
          << endl;
     return -1;
@@ -235,6 +564,42 @@ int setup_from_cli(Worker * worker, QThread * worker_thread, Client & client,
   }
   worker->setShutterAction(shutter_action);
 
+  niad::CameraImageAction image_action = niad::CAMERA_IMAGE_ACTION_STORE;
+  if(parser.isSet("image-action")) {
+    QString action = parser.value("image-action");
+    if(action == "SEND") {
+      image_action = niad::CAMERA_IMAGE_ACTION_SEND;
+    } else if (action == "SEND_AND_STORE") {
+      image_action = niad::CAMERA_IMAGE_ACTION_SEND_AND_STORE;
+    }
+  }
+  worker->setImageAction(image_action);
+  client.getImageSender().setCompression(parser.isSet("compress-images"));
+
+  // Hot pixel and bad column correction.
+  if (parser.isSet("defect-map-dir")) {
+    worker->setDefectMapDir(parser.value("defect-map-dir"));
+  }
+  worker->setBuildDefectMap(parser.isSet("build-defect-map"));
+  worker->setCleanCosmicRays(parser.isSet("clean-cosmic-rays"));
+
+  // Auto-exposure
+  if (parser.isSet("auto-exposure-level")) {
+    worker->setAutoExposureLevel(parser.value("auto-exposure-level").toDouble());
+  } else if (parser.isSet("auto-exposure-snr")) {
+    worker->setAutoExposureSNR(parser.value("auto-exposure-snr").toDouble());
+  }
+  double bias_level = 100;
+  double gain = 0;
+  double read_noise = 8.8;
+  if (parser.isSet("bias-level"))
+    bias_level = parser.value("bias-level").toDouble();
+  if (parser.isSet("gain"))
+    gain = parser.value("gain").toDouble();
+  if (parser.isSet("read-noise"))
+    read_noise = parser.value("read-noise").toDouble();
+  worker->setDetectorModel(bias_level, 60000, gain, read_noise);
+
   return 0;
 }
 
@@ -251,8 +616,55 @@ int setup_from_config(Worker *worker, QThread *worker_thread,
   // before we start taking images.
   QString telescope_url = settings.value("mount/url").toString();
   qInfo() << "Mount URL:" << telescope_url;
+  double coordinate_rate = settings.value("mount/coordinate_rate", 0).toDouble();
+  if (parser.isSet("coordinate-rate")) {
+    coordinate_rate = parser.value("coordinate-rate").toDouble();
+  }
+  qInfo() << "Coordinate Rate:" << coordinate_rate;
+  client.setCoordinateRate(coordinate_rate);
+  QString record_mount = settings.value("mount/record").toString();
+  if (parser.isSet("record-mount")) {
+    record_mount = parser.value("record-mount");
+  }
+  if (!record_mount.isEmpty()) {
+    client.record(record_mount);
+  }
+  double stats_period = settings.value("mount/stats_period", 0).toDouble();
+  if (parser.isSet("mount-stats")) {
+    stats_period = 1;
+  }
+  client.setStatisticsPeriod(stats_period);
   client.open(telescope_url);
 
+  // Mount settling before each exposure.
+  double settle_velocity = settings.value("mount/settle_velocity", 2).toDouble();
+  double settle_jitter = settings.value("mount/settle_jitter", 1).toDouble();
+  double settle_window = settings.value("mount/settle_window", 2).toDouble();
+  double mount_timeout = settings.value("mount/timeout", 120).toDouble();
+  if (parser.isSet("settle-velocity")) {
+    settle_velocity = parser.value("settle-velocity").toDouble();
+  }
+  if (parser.isSet("settle-jitter")) {
+    settle_jitter = parser.value("settle-jitter").toDouble();
+  }
+  if (parser.isSet("settle-window")) {
+    settle_window = parser.value("settle-window").toDouble();
+  }
+  if (parser.isSet("mount-timeout")) {
+    mount_timeout = parser.value("mount-timeout").toDouble();
+  }
+  qInfo() << "Mount Settle:" << settle_velocity << "arcsec/s," << settle_jitter
+          << "arcsec over" << settle_window << "s";
+  worker->setSettleThresholds(settle_velocity, settle_jitter, settle_window);
+  worker->setMountTimeout(mount_timeout);
+
+  double tracking_threshold = settings.value("mount/tracking_threshold", 0).toDouble();
+  if (parser.isSet("tracking-threshold")) {
+    tracking_threshold = parser.value("tracking-threshold").toDouble();
+  }
+  qInfo() << "Tracking Threshold:" << tracking_threshold;
+  worker->setTrackingThreshold(tracking_threshold);
+
   // Read the catalog from the configuration file
   QString object_catalog = settings.value("object_info/catalog").toString();
   // Override the catalog name if it was specified on the CLI
@@ -284,6 +696,48 @@ int setup_from_config(Worker *worker, QThread *worker_thread,
   qInfo() << "Set Temperature:" << temperature;
   worker->setTemperature(temperature);
 
+  double telemetry_period = settings.value("camera/telemetry_period", 5).toDouble();
+  if (parser.isSet("telemetry-period")) {
+    telemetry_period = parser.value("telemetry-period").toDouble();
+  }
+  qInfo() << "Telemetry Period:" << telemetry_period;
+  worker->setTelemetryPeriod(telemetry_period);
+
+  // Wait for the CCD temperature to stabilize before each sequence.
+  double cooler_tolerance = settings.value("camera/cooler_tolerance", 0.5).toDouble();
+  double cooler_hold = settings.value("camera/cooler_hold", 60).toDouble();
+  double cooler_timeout = settings.value("camera/cooler_timeout", 1800).toDouble();
+  bool bias_while_cooling = settings.value("camera/bias_while_cooling", false).toBool();
+  if (parser.isSet("cooler-tolerance")) {
+    cooler_tolerance = parser.value("cooler-tolerance").toDouble();
+  }
+  if (parser.isSet("cooler-timeout")) {
+    cooler_timeout = parser.value("cooler-timeout").toDouble();
+  }
+  if (parser.isSet("bias-while-cooling")) {
+    bias_while_cooling = true;
+  }
+  qInfo() << "Cooler Stable:" << cooler_tolerance << "C for" << cooler_hold
+          << "s, timeout" << cooler_timeout << "s";
+  worker->setCoolerThresholds(cooler_tolerance, cooler_hold, cooler_timeout);
+  worker->setBiasWhileCooling(bias_while_cooling);
+
+  // Run an observation plan instead of a single sequence.
+  QString plan_file = settings.value("camera/plan").toString();
+  if (parser.isSet("plan")) {
+    plan_file = parser.value("plan");
+  }
+  if (!plan_file.isEmpty()) {
+    qInfo() << "Plan:" << plan_file;
+    ObservationPlan plan;
+    QString error;
+    if (!plan.load(plan_file, error)) {
+      qCritical() << "Cannot load plan" << plan_file << ":" << error;
+      return -1;
+    }
+    worker->setPlan(plan);
+  }
+
   // Set up the save directory.
   QString base_dir = settings.value("global/base_dir").toString();
   QString raw_dir = settings.value("global/raw_sub_dir").toString();
@@ -325,5 +779,71 @@ int setup_from_config(Worker *worker, QThread *worker_thread,
   }
   worker->setShutterAction(shutter_action);
 
+  niad::CameraImageAction image_action = niad::CAMERA_IMAGE_ACTION_STORE;
+  QString image_action_name = settings.value("camera/image_action").toString();
+  qInfo() << "Image Action:" << image_action_name;
+  if (image_action_name == "SEND") {
+    image_action = niad::CAMERA_IMAGE_ACTION_SEND;
+  } else if (image_action_name == "SEND_AND_STORE") {
+    image_action = niad::CAMERA_IMAGE_ACTION_SEND_AND_STORE;
+  }
+  worker->setImageAction(image_action);
+
+  bool compress_images = settings.value("camera/compress_images", false).toBool()
+    || parser.isSet("compress-images");
+  qInfo() << "Compress Images:" << compress_images;
+  client.getImageSender().setCompression(compress_images);
+
+  // Hot pixel and bad column correction.
+  QString defect_map_dir = settings.value("camera/defect_map_dir").toString();
+  if (parser.isSet("defect-map-dir")) {
+    defect_map_dir = parser.value("defect-map-dir");
+  }
+  qInfo() << "Defect Map Dir:" << defect_map_dir;
+  if (!defect_map_dir.isEmpty()) {
+    worker->setDefectMapDir(defect_map_dir);
+  }
+  worker->setBuildDefectMap(settings.value("camera/build_defect_map", false).toBool()
+                            || parser.isSet("build-defect-map"));
+
+  bool clean_cosmic_rays = settings.value("camera/clean_cosmic_rays", false).toBool()
+    || parser.isSet("clean-cosmic-rays");
+  qInfo() << "Clean Cosmic Rays:" << clean_cosmic_rays;
+  worker->setCleanCosmicRays(clean_cosmic_rays);
+
+  // Auto-exposure
+  double auto_exposure_level = settings.value("camera/auto_exposure_level", 0).toDouble();
+  double auto_exposure_snr = settings.value("camera/auto_exposure_snr", 0).toDouble();
+  if (parser.isSet("auto-exposure-level")) {
+    auto_exposure_level = parser.value("auto-exposure-level").toDouble();
+  } else if (parser.isSet("auto-exposure-snr")) {
+    auto_exposure_snr = parser.value("auto-exposure-snr").toDouble();
+  }
+  if (auto_exposure_level > 0) {
+    qInfo() << "Auto-exposure Level:" << auto_exposure_level;
+    worker->setAutoExposureLevel(auto_exposure_level);
+  } else if (auto_exposure_snr > 0) {
+    qInfo() << "Auto-exposure SNR:" << auto_exposure_snr;
+    worker->setAutoExposureSNR(auto_exposure_snr);
+  }
+
+  // Detector noise model. A gain of 0 uses the gain the camera reports.
+  double bias_level = settings.value("camera/bias_level", 100).toDouble();
+  double saturation_level = settings.value("camera/saturation_level", 60000).toDouble();
+  double gain = settings.value("camera/gain", 0).toDouble();
+  double read_noise = settings.value("camera/read_noise", 8.8).toDouble();
+  if (parser.isSet("bias-level")) {
+    bias_level = parser.value("bias-level").toDouble();
+  }
+  if (parser.isSet("gain")) {
+    gain = parser.value("gain").toDouble();
+  }
+  if (parser.isSet("read-noise")) {
+    read_noise = parser.value("read-noise").toDouble();
+  }
+  qInfo() << "Detector Model:" << bias_level << "ADU bias," << saturation_level
+          << "ADU saturation," << gain << "e-/ADU," << read_noise << "e- read noise";
+  worker->setDetectorModel(bias_level, saturation_level, gain, read_noise);
+
   return 0;
 }
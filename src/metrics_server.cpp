@@ -0,0 +1,203 @@
+#include "metrics_server.hpp"
+
+// system includes
+#include <QDebug>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <utility>
+#include <vector>
+
+MetricsServer::MetricsServer(Client * client, const std::vector<Worker *> & workers)
+  : mClient(client), mWorkers(workers) {
+
+  connect(&mServer, &QTcpServer::newConnection, this, &MetricsServer::onNewConnection);
+}
+
+MetricsServer::~MetricsServer() {
+}
+
+bool MetricsServer::listen(quint16 port, const QHostAddress & address) {
+  if(!mServer.listen(address, port)) {
+    qCritical() << "Could not listen on" << address.toString() << "port" << port
+                << ":" << mServer.errorString();
+    return false;
+  }
+  qInfo() << "Metrics available at http://" + address.toString() + ":" +
+             QString::number(port) + "/metrics";
+  return true;
+}
+
+void MetricsServer::onNewConnection() {
+  while(QTcpSocket * socket = mServer.nextPendingConnection()) {
+    connect(socket, &QTcpSocket::readyRead, this, &MetricsServer::onReadyRead);
+    connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+  }
+}
+
+void MetricsServer::onReadyRead() {
+  auto socket = qobject_cast<QTcpSocket *>(sender());
+  if(socket == nullptr)
+    return;
+
+  // Wait for the end of the headers. Anything larger than a scrape request
+  // is not one.
+  QByteArray request = socket->peek(socket->bytesAvailable());
+  if(!request.contains("\r\n\r\n") && request.size() < 8192)
+    return;
+  socket->readAll();
+
+  QList<QByteArray> request_line = request.left(request.indexOf("\r\n")).split(' ');
+  QByteArray method = request_line.value(0);
+  QByteArray path = request_line.value(1);
+
+  QByteArray status = "200 OK";
+  QByteArray body;
+  if(method != "GET") {
+    status = "405 Method Not Allowed";
+  } else if(path == "/metrics" || path.startsWith("/metrics?")) {
+    body = render();
+  } else {
+    status = "404 Not Found";
+  }
+
+  QByteArray response = "HTTP/1.1 " + status + "\r\n"
+    "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+    "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+    "Connection: close\r\n\r\n" + body;
+  socket->write(response);
+  socket->disconnectFromHost();
+}
+
+void MetricsServer::writeSummary(QTextStream & out, const QString & name,
+                                 const QString & labels,
+                                 const LatencyHistogram & histogram) {
+
+  // Quantile labels are merged into any existing label set.
+  QString prefix = labels.isEmpty() ? "{" : labels.left(labels.size() - 1) + ",";
+  for(double q: {0.5, 0.9, 0.99}) {
+    out << name << "_seconds" << prefix << "quantile=\"" << q << "\"} "
+        << histogram.getPercentile(100 * q) * 1E-9 << "\n";
+  }
+  out << name << "_seconds_sum" << labels << " "
+      << histogram.getMean() * histogram.getCount() * 1E-9 << "\n";
+  out << name << "_seconds_count" << labels << " " << histogram.getCount() << "\n";
+}
+
+QByteArray MetricsServer::render() {
+
+  QByteArray body;
+  QTextStream out(&body);
+  out.setRealNumberPrecision(9);
+
+  auto help = [&](const char * name, const char * type, const char * text) {
+    out << "# HELP " << name << " " << text << "\n";
+    out << "# TYPE " << name << " " << type << "\n";
+  };
+  auto label = [](Worker * worker) {
+    return "{camera=\"" + worker->getName() + "\"}";
+  };
+
+  //
+  // Acquisition
+  //
+  help("camera_frames_acquired_total", "counter", "Frames read out completely.");
+  for(auto worker: mWorkers)
+    out << "camera_frames_acquired_total" << label(worker) << " "
+        << worker->getMetrics().frames_acquired.load() << "\n";
+
+  help("camera_frames_aborted_total", "counter", "Frames abandoned before readout ended.");
+  for(auto worker: mWorkers)
+    out << "camera_frames_aborted_total" << label(worker) << " "
+        << worker->getMetrics().frames_aborted.load() << "\n";
+
+  help("camera_exposure_seconds", "summary", "Time the shutter was open.");
+  for(auto worker: mWorkers)
+    writeSummary(out, "camera_exposure", label(worker), worker->getMetrics().exposure);
+
+  help("camera_readout_seconds", "summary", "Time to read out a frame.");
+  for(auto worker: mWorkers)
+    writeSummary(out, "camera_readout", label(worker), worker->getMetrics().readout);
+
+  //
+  // Storage
+  //
+  help("camera_fits_write_seconds", "summary", "Time to write a FITS file.");
+  for(auto worker: mWorkers)
+    writeSummary(out, "camera_fits_write", label(worker), worker->getMetrics().fits_write);
+
+  help("camera_fits_written_bytes_total", "counter", "Bytes of FITS files written.");
+  for(auto worker: mWorkers)
+    out << "camera_fits_written_bytes_total" << label(worker) << " "
+        << worker->getMetrics().fits_bytes.load() << "\n";
+
+  //
+  // Temperatures, from the newest background reading
+  //
+  // Read each worker once so all families describe the same reading, then
+  // write every family's samples together under its HELP and TYPE lines.
+  std::vector<std::pair<Worker *, TemperatureSample>> samples;
+  for(auto worker: mWorkers) {
+    TemperatureSample sample;
+    if(worker->getLatestTemperature(sample))
+      samples.emplace_back(worker, sample);
+  }
+  auto temperature_family = [&](const char * name, const char * text,
+                                std::function<double(const TemperatureSample &)> value) {
+    help(name, "gauge", text);
+    for(auto & s: samples)
+      out << name << label(s.first) << " " << value(s.second) << "\n";
+  };
+  auto now = std::chrono::high_resolution_clock::now();
+  temperature_family("camera_ccd_temperature_celsius", "Imaging CCD temperature.",
+    [](const TemperatureSample & s) { return s.info.main_camera_temperature; });
+  temperature_family("camera_ccd_setpoint_celsius", "Imaging CCD set point.",
+    [](const TemperatureSample & s) { return s.info.main_camera_temperature_setpoint; });
+  temperature_family("camera_heatsink_temperature_celsius", "Heatsink temperature.",
+    [](const TemperatureSample & s) { return s.info.heatsink_temperature; });
+  temperature_family("camera_cooler_power_percent", "Imaging CCD cooler power.",
+    [](const TemperatureSample & s) { return s.info.cooler_percent_power; });
+  temperature_family("camera_temperature_age_seconds", "Age of the temperature reading.",
+    [now](const TemperatureSample & s) {
+      return std::chrono::duration<double>(now - s.time).count(); });
+
+  //
+  // SBIG driver
+  //
+  auto & driver = SbigSTDriver::GetInstance();
+  help("sbig_driver_queue_depth", "gauge", "Commands waiting for the driver thread.");
+  out << "sbig_driver_queue_depth " << driver.GetQueueDepth() << "\n";
+
+  help("sbig_driver_handle_switches_total", "counter", "Driver handle switches.");
+  out << "sbig_driver_handle_switches_total " << driver.GetExecutorStats().handle_switches << "\n";
+
+  help("sbig_driver_wait_seconds", "summary", "Time commands waited for the driver thread.");
+  writeSummary(out, "sbig_driver_wait", "", driver.GetQueueWait());
+
+  //
+  // Network
+  //
+  auto & sender = mClient->getImageSender();
+  help("niad_image_queue_depth", "gauge", "Frames waiting to be sent to the NIAD server.");
+  out << "niad_image_queue_depth " << sender.getQueueDepth() << "\n";
+
+  help("niad_images_sent_total", "counter", "Frames delivered to the NIAD server.");
+  out << "niad_images_sent_total " << sender.getFramesSent() << "\n";
+
+  help("niad_images_dropped_total", "counter", "Frames dropped by a full send queue.");
+  out << "niad_images_dropped_total " << sender.getFramesDropped() << "\n";
+
+  help("niad_coordinate_updates_total", "counter", "Mount coordinate updates received.");
+  out << "niad_coordinate_updates_total " << mClient->getCoordinateUpdates() << "\n";
+
+  help("niad_messages_decoded_total", "counter", "NIAD messages decoded.");
+  out << "niad_messages_decoded_total " << mClient->getMessagesDecoded() << "\n";
+
+  if(mHub != nullptr) {
+    help("camera_server_queue_depth", "gauge", "Messages waiting for local subscribers.");
+    out << "camera_server_queue_depth " << mHub->getQueueDepth() << "\n";
+  }
+
+  out.flush();
+  return body;
+}
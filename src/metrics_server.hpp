@@ -0,0 +1,79 @@
+#ifndef METRICS_SERVER_HPP
+#define METRICS_SERVER_HPP
+
+// local includes
+#include "client.hpp"
+#include "fanout_hub.hpp"
+#include "worker.hpp"
+
+// project includes
+#include "latency_histogram.hpp"
+
+// system includes
+#include <QObject>
+#include <QByteArray>
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTextStream>
+#include <vector>
+
+/// Serves acquisition, I/O and device metrics over HTTP in the Prometheus
+/// text format, e.g. `curl http://localhost:9100/metrics`.
+///
+/// Requests are answered on the Qt event loop from counters the workers,
+/// the NIAD client and the SBIG driver keep anyway. A scrape never calls the
+/// driver or waits on a worker; temperatures come from the background
+/// readings. Durations are exported as summaries (quantiles, sum and count).
+class MetricsServer : public QObject {
+  Q_OBJECT;
+
+public:
+  /// Default constructor
+  /// \param client NIAD client. Not owned.
+  /// \param workers Camera workers. Not owned. They may live in other threads.
+  MetricsServer(Client * client, const std::vector<Worker *> & workers);
+  /// Default destructor.
+  ~MetricsServer();
+
+protected:
+  Client * mClient = nullptr; ///< NIAD client.
+  std::vector<Worker *> mWorkers; ///< Camera workers.
+  FanoutHub * mHub = nullptr; ///< Hub for local subscribers, if any.
+
+  QTcpServer mServer; ///< Listening socket.
+
+protected:
+  /// Build the response body.
+  QByteArray render();
+
+  /// Write a summary of a duration histogram.
+  /// \param out Destination.
+  /// \param name Metric name, without the _seconds suffix.
+  /// \param labels Label set including braces, or empty.
+  /// \param histogram Durations (ns).
+  void writeSummary(QTextStream & out, const QString & name,
+                    const QString & labels, const LatencyHistogram & histogram);
+
+protected slots:
+  void onNewConnection();
+
+  /// Answer a request once its headers have arrived.
+  void onReadyRead();
+
+public:
+  /// Start listening for scrapes.
+  /// \param port TCP port.
+  /// \param address Address to bind. Only this host by default, as the
+  ///        metrics are served without authentication.
+  /// \return True on success.
+  bool listen(quint16 port, const QHostAddress & address = QHostAddress::LocalHost);
+
+  /// Also report the queue depth of a hub for local subscribers.
+  /// \param hub The hub. Not owned. Must live in this object's thread.
+  void setHub(FanoutHub * hub) { mHub = hub; }
+
+  //
+}; // MetricsServer
+
+#endif // METRICS_SERVER_HPP
@@ -0,0 +1,53 @@
+
+// local includes
+#include "mock_mount_server.hpp"
+
+// system includes
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <cmath>
+
+int main(int argc, char *argv[]) {
+
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("mock-mount");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(
+    "Simulated NIAD mount for testing the camera controller without a telescope");
+  parser.addHelpOption();
+  parser.addOptions({
+      {"port", "Port to listen on (default 8765)", "port", "8765"},
+      {"rate", "Coordinate updates per second (default 50)", "rate", "50"},
+      {"ra", "Target RA (degrees)", "ra", "0"},
+      {"dec", "Target DEC (degrees)", "dec", "0"},
+      {"periodic-error", "Amplitude of RA periodic error (arcseconds)",
+       "arcsec", "0"},
+      {"periodic-error-period", "Period of RA periodic error (seconds)",
+       "seconds", "480"},
+      {"drop-fraction", "Fraction of coordinate updates to drop (0-1)",
+       "fraction", "0"},
+      {"ack-delay", "Delay before acknowledging each image chunk (ms)",
+       "ms", "0"},
+      {"interrupt-after", "Drop the connection once after receiving this many "
+       "image bytes (default never)", "bytes", "0"}});
+  parser.process(app);
+
+  const double deg = M_PI / 180;
+
+  MockMountServer server;
+  server.setRate(parser.value("rate").toDouble());
+  server.setTarget(parser.value("ra").toDouble() * deg,
+                   parser.value("dec").toDouble() * deg);
+  server.setPeriodicError(parser.value("periodic-error").toDouble() * deg / 3600,
+                          parser.value("periodic-error-period").toDouble());
+  server.setDropFraction(parser.value("drop-fraction").toDouble());
+  server.setAckDelay(parser.value("ack-delay").toInt());
+  server.setInterruptAfter(parser.value("interrupt-after").toLongLong());
+
+  if(!server.listen(parser.value("port").toUShort()))
+    return -1;
+
+  return app.exec();
+}
@@ -0,0 +1,276 @@
+#include "mock_mount_server.hpp"
+
+// project includes
+#include "image_sender.hpp"
+
+// system includes
+#include <QDebug>
+#include <QPointer>
+#include <cmath>
+#include <ctime>
+
+/// Sidereal rate (radians per second).
+static const double SIDEREAL_RATE = 7.2921159E-5;
+
+MockMountServer::MockMountServer()
+  : mServer("mock-mount", QWebSocketServer::NonSecureMode),
+    mRandom(42) {
+
+  connect(&mServer, &QWebSocketServer::newConnection,
+          this, &MockMountServer::onNewConnection);
+
+  mStreamTimer.setTimerType(Qt::PreciseTimer);
+  mStreamTimer.setInterval(1);
+  connect(&mStreamTimer, &QTimer::timeout, this, &MockMountServer::stream);
+
+  mReportTimer.setInterval(1000);
+  connect(&mReportTimer, &QTimer::timeout, this, &MockMountServer::report);
+}
+
+MockMountServer::~MockMountServer() {
+  for(auto & c: mConnections)
+    c.socket->deleteLater();
+}
+
+bool MockMountServer::listen(quint16 port) {
+  if(!mServer.listen(QHostAddress::Any, port)) {
+    qCritical() << "Could not listen on port" << port << ":" << mServer.errorString();
+    return false;
+  }
+  qInfo() << "Mock mount listening on" << mServer.serverUrl().toString()
+          << "at" << mRate << "updates per second";
+
+  mClock.start();
+  mStreamTimer.start();
+  mReportTimer.start();
+  mLastCpuTime = double(std::clock()) / CLOCKS_PER_SEC;
+  return true;
+}
+
+void MockMountServer::send(QWebSocket * socket, const niad::Envelope & e) {
+  QByteArray data(e.ByteSizeLong(), Qt::Uninitialized);
+  e.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t*>(data.data()));
+  socket->sendBinaryMessage(data);
+}
+
+MockMountServer::Connection * MockMountServer::findConnection(QWebSocket * socket) {
+  for(auto & c: mConnections) {
+    if(c.socket == socket)
+      return &c;
+  }
+  return nullptr;
+}
+
+void MockMountServer::onNewConnection() {
+  using namespace niad;
+
+  QWebSocket * socket = mServer.nextPendingConnection();
+  connect(socket, &QWebSocket::binaryMessageReceived,
+          this, &MockMountServer::processBinaryMessage);
+  connect(socket, &QWebSocket::disconnected,
+          this, &MockMountServer::onDisconnected);
+
+  Connection c;
+  c.socket = socket;
+  mConnections.append(c);
+  qInfo() << "Client connected from" << socket->peerAddress().toString();
+
+  // Announce the mount.
+  Envelope e;
+  auto d_e = e.mutable_device_envelope();
+  d_e->add_info()->set_type(DEVICE_TYPE_MOUNT);
+  send(socket, e);
+}
+
+void MockMountServer::onDisconnected() {
+  QWebSocket * socket = qobject_cast<QWebSocket *>(sender());
+  uint64_t sent = 0;
+  for(int i = 0; i < mConnections.size(); i++) {
+    if(mConnections[i].socket == socket) {
+      sent = mConnections[i].sent;
+      mConnections.removeAt(i);
+      break;
+    }
+  }
+  // Compare with the count the controller logs to find updates it lost.
+  qInfo() << "Client disconnected after" << sent << "coordinate updates";
+  socket->deleteLater();
+}
+
+void MockMountServer::processBinaryMessage(const QByteArray & message) {
+  using namespace niad;
+
+  QWebSocket * socket = qobject_cast<QWebSocket *>(sender());
+  Connection * c = findConnection(socket);
+  if(c == nullptr)
+    return;
+
+  // Images from the camera controller share the socket.
+  if(processImageMessage(socket, message))
+    return;
+
+  Envelope request;
+  if(!request.ParseFromArray(message.data(), message.size()) ||
+     !request.has_mount_envelope())
+    return;
+
+  Envelope r;
+  auto r_m = r.mutable_mount_envelope();
+  double t = mClock.nsecsElapsed() * 1E-9;
+
+  switch(request.mount_envelope().type()) {
+  case MOUNT_REQUEST_GET_INFO: {
+    r_m->set_type(MOUNT_RESPONSE_INFO);
+    auto info = r_m->mutable_info();
+    info->add_capabilities(MOUNT_CAPABILITY_GET_COORDS_RA_DEC);
+    info->add_capabilities(MOUNT_CAPABILITY_GET_COORDS_AZM_ALT);
+    info->add_capabilities(MOUNT_CAPABILITY_GET_LAT_LON_ALT);
+    send(socket, r);
+    break;
+  }
+  case MOUNT_REQUEST_GET_IS_READY:
+    r_m->set_type(MOUNT_RESPONSE_IS_READY);
+    send(socket, r);
+    break;
+  case MOUNT_REQUEST_GET_LAT_LON_ALT:
+    makeCoordinates(r_m->mutable_coords(), COORDINATE_TYPE_LAT_LON_ALT, t);
+    send(socket, r);
+    break;
+  case MOUNT_REQUEST_SUBSCRIBE_COORDS_RA_DEC:
+    c->subscriptions.insert(COORDINATE_TYPE_RA_DEC);
+    break;
+  case MOUNT_REQUEST_SUBSCRIBE_COORDS_AZM_ALT:
+    c->subscriptions.insert(COORDINATE_TYPE_AZM_ALT);
+    break;
+  case MOUNT_REQUEST_UNSUBSCRIBE_COORDS_RA_DEC:
+    c->subscriptions.erase(COORDINATE_TYPE_RA_DEC);
+    break;
+  case MOUNT_REQUEST_UNSUBSCRIBE_COORDS_AZM_ALT:
+    c->subscriptions.erase(COORDINATE_TYPE_AZM_ALT);
+    break;
+  default:
+    qDebug() << "Ignoring mount request" << request.mount_envelope().type();
+    break;
+  }
+}
+
+bool MockMountServer::processImageMessage(QWebSocket * socket, const QByteArray & message) {
+
+  ImageChunkHeader h;
+  if(!h.fromByteArray(message))
+    return false;
+  if(h.type != ImageChunkHeader::TYPE_CHUNK ||
+     message.size() < ImageChunkHeader::SIZE + qint64(h.length))
+    return true;
+
+  auto & frame = mImageFrames[h.frame_id];
+  if(frame.payload.isEmpty())
+    frame.timer.start();
+
+  // Chunks arrive in order, but after a reconnection the sender resends from
+  // its last acknowledgement, which may overlap what was already received.
+  qint64 received = frame.payload.size();
+  qint64 end = qint64(h.offset) + h.length;
+  if(h.offset > received) {
+    qWarning() << "Image frame" << h.frame_id << "skipped from" << received
+               << "to" << h.offset << "bytes";
+  } else if(end > received) {
+    frame.payload.append(message.constData() + ImageChunkHeader::SIZE + (received - h.offset),
+                         end - received);
+    mImageBytes += end - received;
+    received = end;
+  }
+
+  if(received >= h.total_bytes) {
+    QByteArray pixels = frame.payload.left(h.total_bytes);
+    if(h.flags & ImageChunkHeader::FLAG_COMPRESSED)
+      pixels = qUncompress(pixels);
+    bool intact = pixels.size() == qint64(h.width) * h.height * 2;
+    qInfo() << "Received frame" << h.frame_id << h.width << "x" << h.height
+            << (intact ? "intact" : "CORRUPT") << "in"
+            << frame.timer.nsecsElapsed() * 1E-9 << "s";
+    mImageFrames.erase(h.frame_id);
+  }
+
+  // Acknowledge everything received, later if acting as a slow receiver.
+  ImageChunkHeader ack = h;
+  ack.type = ImageChunkHeader::TYPE_ACK;
+  ack.offset = received;
+  ack.length = 0;
+  QByteArray reply = ack.toByteArray();
+  QPointer<QWebSocket> target(socket);
+  QTimer::singleShot(mAckDelay, this, [target, reply]() {
+    if(target)
+      target->sendBinaryMessage(reply);
+  });
+
+  // Drop the connection part way through a frame to exercise resumption.
+  if(mInterruptAfter > 0 && mImageBytes >= mInterruptAfter) {
+    mInterruptAfter = 0;
+    qInfo() << "Dropping the connection after" << mImageBytes << "image bytes";
+    socket->close();
+  }
+
+  return true;
+}
+
+void MockMountServer::makeCoordinates(niad::Coordinates * coords, int type, double t) {
+  using namespace niad;
+
+  coords->set_type(CoordinateType(type));
+  if(type == COORDINATE_TYPE_RA_DEC) {
+    coords->add_position(mRA + mPeriodicError * sin(2 * M_PI * t / mPeriodicErrorPeriod));
+    coords->add_position(mDEC);
+  } else if(type == COORDINATE_TYPE_AZM_ALT) {
+    coords->add_position(fmod(M_PI + SIDEREAL_RATE * t, 2 * M_PI));
+    coords->add_position(M_PI / 4);
+  } else if(type == COORDINATE_TYPE_LAT_LON_ALT) {
+    for(double v: mLLA)
+      coords->add_position(v);
+  }
+}
+
+void MockMountServer::stream() {
+  using namespace niad;
+
+  // Send every update that has come due since the last tick. At rates above
+  // the timer resolution this produces bursts, as a busy mount would.
+  double t = mClock.nsecsElapsed() * 1E-9;
+  uint64_t due = uint64_t(t * mRate);
+  std::uniform_real_distribution<double> uniform(0, 1);
+
+  // NIAD coordinates carry no timestamp, so the client takes their arrival
+  // time as the time of the position. Compute each position for the moment
+  // it is sent, so that the difference is only the delivery latency and not
+  // this server's timer lag.
+  Envelope e;
+  auto m_e = e.mutable_mount_envelope();
+  for(; mUpdates < due; mUpdates++) {
+    for(auto & c: mConnections) {
+      for(int type: c.subscriptions) {
+        if(mDropFraction > 0 && uniform(mRandom) < mDropFraction) {
+          mDropped++;
+          continue;
+        }
+        m_e->clear_coords();
+        makeCoordinates(m_e->mutable_coords(), type, mClock.nsecsElapsed() * 1E-9);
+        send(c.socket, e);
+        c.sent++;
+        mSent++;
+      }
+    }
+  }
+}
+
+void MockMountServer::report() {
+  double cpu_time = double(std::clock()) / CLOCKS_PER_SEC;
+  double cpu = 100.0 * (cpu_time - mLastCpuTime) / (mReportTimer.interval() * 1E-3);
+  mLastCpuTime = cpu_time;
+
+  qInfo() << "Clients:" << mConnections.size()
+          << "sent/s:" << mSent
+          << "dropped/s:" << mDropped
+          << "CPU:" << QString::number(cpu, 'f', 1) + "%";
+  mSent = 0;
+  mDropped = 0;
+}
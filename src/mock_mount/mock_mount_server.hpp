@@ -0,0 +1,145 @@
+#ifndef MOCK_MOUNT_SERVER_HPP
+#define MOCK_MOUNT_SERVER_HPP
+
+// External includes
+#include "niad.pb.h"
+
+// system includes
+#include <QObject>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QWebSocket>
+#include <QWebSocketServer>
+#include <QList>
+#include <map>
+#include <random>
+#include <set>
+
+/// A NIAD mount simulator for exercising Client without a telescope.
+///
+/// Announces a single mount to every connection, answers info, ready, and
+/// latitude/longitude/altitude requests, and streams synthetic coordinates to
+/// subscribers at a configurable rate. The mount tracks a fixed RA/DEC with a
+/// sinusoidal periodic error while AZM advances at the sidereal rate.
+///
+/// The server also stands in for a NIAD image receiver. It acknowledges image
+/// chunks, optionally after a delay to act as a slow consumer, checks that
+/// each frame arrives whole, and can drop the connection part way through a
+/// frame to exercise resumption.
+class MockMountServer : public QObject {
+  Q_OBJECT;
+
+public:
+  /// Default constructor
+  MockMountServer();
+  /// Default destructor.
+  ~MockMountServer();
+
+protected:
+  /// State kept for each connected client.
+  struct Connection {
+    QWebSocket * socket = nullptr; ///< Socket for the client. Owned.
+    std::set<int> subscriptions; ///< Subscribed niad::CoordinateType values.
+    uint64_t sent = 0; ///< Coordinate updates sent to this client.
+  };
+
+  QWebSocketServer mServer; ///< Listening socket.
+  QList<Connection> mConnections; ///< Connected clients.
+
+  QTimer mStreamTimer; ///< Drives coordinate updates.
+  QTimer mReportTimer; ///< Drives periodic statistics.
+  QElapsedTimer mClock; ///< Time since streaming started.
+
+  double mRate = 50; ///< Coordinate updates per second, per subscription.
+  uint64_t mUpdates = 0; ///< Updates generated since streaming started.
+
+  double mRA = 0; ///< Target RA (radians).
+  double mDEC = 0; ///< Target DEC (radians).
+  double mPeriodicError = 0; ///< Amplitude of RA periodic error (radians).
+  double mPeriodicErrorPeriod = 480; ///< Period of RA periodic error (seconds).
+  double mLLA[3] = {0, 0, 0}; ///< Latitude (rad), longitude (rad), altitude (m).
+
+  double mDropFraction = 0; ///< Fraction of updates deliberately not sent.
+  std::mt19937 mRandom; ///< Source for deliberate drops.
+
+  /// A frame being received from the camera controller.
+  struct ImageFrame {
+    QByteArray payload; ///< Bytes received so far, in order.
+    QElapsedTimer timer; ///< Started with the first chunk.
+  };
+
+  std::map<quint32, ImageFrame> mImageFrames; ///< Frames being received, by id.
+  int mAckDelay = 0; ///< Delay before acknowledging an image chunk (ms).
+  qint64 mInterruptAfter = 0; ///< Image bytes after which to drop the connection once. 0 never.
+  qint64 mImageBytes = 0; ///< Image bytes received.
+
+  uint64_t mSent = 0; ///< Updates sent since the last report.
+  uint64_t mDropped = 0; ///< Updates deliberately dropped since the last report.
+  double mLastCpuTime = 0; ///< Process CPU time at the last report (seconds).
+
+protected:
+  /// Send an envelope to one client.
+  void send(QWebSocket * socket, const niad::Envelope & e);
+
+  /// Find the connection for a socket.
+  Connection * findConnection(QWebSocket * socket);
+
+  /// Receive an image chunk and acknowledge it.
+  /// \return False if the message is not an image transfer message.
+  bool processImageMessage(QWebSocket * socket, const QByteArray & message);
+
+  /// Fill a coordinate message with the position of the specified type at
+  /// time t (seconds since streaming started).
+  void makeCoordinates(niad::Coordinates * coords, int type, double t);
+
+protected slots:
+  /// Accept a new client.
+  void onNewConnection();
+  /// Forget a client that disconnected.
+  void onDisconnected();
+  /// Answer a NIAD request.
+  void processBinaryMessage(const QByteArray & message);
+  /// Send all coordinate updates that are due.
+  void stream();
+  /// Log throughput, drops, and CPU usage.
+  void report();
+
+public:
+  /// Start listening for clients.
+  /// \param port TCP port.
+  /// \return True on success.
+  bool listen(quint16 port);
+
+  /// Set the number of coordinate updates per second. Rates above the timer
+  /// resolution (1 kHz) are sent in bursts.
+  void setRate(double rate) { mRate = rate; }
+
+  /// Set the target the mount is tracking.
+  void setTarget(double ra, double dec) { mRA = ra; mDEC = dec; }
+
+  /// Set the RA periodic error.
+  /// \param amplitude Amplitude (radians).
+  /// \param period Period (seconds).
+  void setPeriodicError(double amplitude, double period) {
+    mPeriodicError = amplitude;
+    mPeriodicErrorPeriod = period;
+  }
+
+  /// Set the location of the mount.
+  void setLocation(double latitude, double longitude, double altitude) {
+    mLLA[0] = latitude; mLLA[1] = longitude; mLLA[2] = altitude;
+  }
+
+  /// Set the fraction of updates that are generated but not sent.
+  void setDropFraction(double fraction) { mDropFraction = fraction; }
+
+  /// Set the delay before acknowledging each image chunk (ms).
+  void setAckDelay(int ms) { mAckDelay = ms; }
+
+  /// Drop the connection once, after this many image bytes. 0 never does.
+  void setInterruptAfter(qint64 bytes) { mInterruptAfter = bytes; }
+
+  //
+}; // MockMountServer
+
+#endif // MOCK_MOUNT_SERVER_HPP
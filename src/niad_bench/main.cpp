@@ -0,0 +1,101 @@
+// project includes
+#include "client.hpp"
+
+// system includes
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDataStream>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+/// Number of heap allocations made by the process.
+static std::atomic<uint64_t> gAllocations(0);
+
+void * operator new(std::size_t size) {
+  gAllocations++;
+  if(void * p = std::malloc(size > 0 ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept {
+  std::free(p);
+}
+
+int main(int argc, char *argv[]) {
+
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("niad-bench");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(
+    "Replay NIAD messages saved with --record-mount through the client and "
+    "report messages per second and heap allocations per message");
+  parser.addHelpOption();
+  parser.addPositionalArgument("file", "Recorded messages");
+  parser.addOptions({
+      {"passes", "Number of times to replay the recording (default 10)",
+       "passes", "10"}});
+  parser.process(app);
+
+  if(parser.positionalArguments().isEmpty()) {
+    qCritical() << "No recording given. See -h for more information.";
+    return -1;
+  }
+
+  // Load the whole recording so that file access is not measured.
+  QFile file(parser.positionalArguments()[0]);
+  if(!file.open(QIODevice::ReadOnly)) {
+    qCritical() << "Cannot open" << file.fileName();
+    return -1;
+  }
+  std::vector<QByteArray> messages;
+  QDataStream s(&file);
+  while(!s.atEnd()) {
+    QByteArray message;
+    s >> message;
+    if(s.status() != QDataStream::Ok)
+      break;
+    messages.push_back(message);
+  }
+  if(messages.empty()) {
+    qCritical() << "No messages in" << file.fileName();
+    return -1;
+  }
+
+  // The first pass grows the decode arena and buffers to their working size.
+  Client client;
+  for(auto & message: messages)
+    client.processBinaryMessage(message);
+
+  int passes = std::max(1, parser.value("passes").toInt());
+  uint64_t overflows = client.getArenaOverflows();
+  uint64_t allocations = gAllocations;
+  QElapsedTimer timer;
+  timer.start();
+  for(int pass = 0; pass < passes; pass++) {
+    for(auto & message: messages)
+      client.processBinaryMessage(message);
+  }
+  double seconds = timer.nsecsElapsed() * 1E-9;
+  allocations = gAllocations - allocations;
+
+  double count = double(messages.size()) * passes;
+  qInfo().noquote() << QString("%1 messages x %2 passes: %3 messages/s, "
+                               "%4 allocations/message, %5 arena overflows")
+    .arg(messages.size()).arg(passes)
+    .arg(count / seconds, 0, 'f', 0)
+    .arg(allocations / count, 0, 'f', 3)
+    .arg(client.getArenaOverflows() - overflows);
+
+  return 0;
+}
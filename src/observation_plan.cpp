@@ -0,0 +1,423 @@
+#include "observation_plan.hpp"
+
+// system includes
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+FilterMoveModel::FilterMoveModel() {
+}
+
+void FilterMoveModel::setSlotCount(int slots) {
+  mSlots = std::max(slots, 1);
+}
+
+int FilterMoveModel::getDistance(int from, int to) const {
+  if(from <= 0)
+    return mSlots / 2;
+
+  int d = std::abs(from - to) % mSlots;
+  return std::min(d, mSlots - d);
+}
+
+void FilterMoveModel::record(int from, int to, double seconds) {
+  if(from <= 0 || to <= 0 || from == to)
+    return;
+
+  auto & m = mMeasured[getDistance(from, to)];
+  m.first += seconds;
+  m.second++;
+}
+
+double FilterMoveModel::predict(int from, int to) const {
+  if(to <= 0 || from == to)
+    return 0;
+
+  int d = getDistance(from, to);
+  auto it = mMeasured.find(d);
+  if(it != mMeasured.end())
+    return it->second.first / it->second.second;
+
+  double nominal = mBase + mPerSlot * d;
+  if(mMeasured.empty())
+    return nominal;
+
+  // A single measured distance scales the nominal line.
+  if(mMeasured.size() == 1) {
+    auto & m = *mMeasured.begin();
+    return nominal * (m.second.first / m.second.second) / (mBase + mPerSlot * m.first);
+  }
+
+  // Otherwise fit a line to the mean time at each measured distance.
+  double n = 0, sx = 0, sxx = 0, sy = 0, sxy = 0;
+  for(auto & m: mMeasured) {
+    double y = m.second.first / m.second.second;
+    n += 1; sx += m.first; sxx += m.first * m.first;
+    sy += y; sxy += m.first * y;
+  }
+  double slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+  double intercept = (sy - slope * sx) / n;
+  return std::max(intercept + slope * d, 0.0);
+}
+
+int PlanTarget::getRemaining() const {
+  int remaining = 0;
+  for(auto & b: blocks)
+    remaining += std::max(b.count - b.done, 0);
+  return remaining;
+}
+
+ObservationPlan::ObservationPlan() {
+}
+
+bool ObservationPlan::load(const QString & filename, QString & error) {
+  QFile file(filename);
+  if(!file.open(QIODevice::ReadOnly)) {
+    error = "Cannot open " + filename;
+    return false;
+  }
+
+  QJsonParseError parse_error;
+  QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parse_error);
+  if(!document.isObject()) {
+    error = filename + ": " + parse_error.errorString();
+    return false;
+  }
+
+  return fromJson(document.object(), error);
+}
+
+bool ObservationPlan::fromJson(const QJsonObject & plan, QString & error) {
+
+  QString interleave = plan.value("interleave").toString("auto");
+  if(interleave == "auto")
+    mInterleave = INTERLEAVE_AUTO;
+  else if(interleave == "always")
+    mInterleave = INTERLEAVE_ALWAYS;
+  else if(interleave == "never")
+    mInterleave = INTERLEAVE_NEVER;
+  else {
+    error = "interleave must be auto, always or never";
+    return false;
+  }
+  mMaxMoveOverhead = plan.value("max_move_overhead").toDouble(mMaxMoveOverhead);
+  mFrameOverhead = plan.value("frame_overhead").toDouble(mFrameOverhead);
+
+  mTargets.clear();
+  for(auto t: plan.value("targets").toArray()) {
+    QJsonObject o = t.toObject();
+    PlanTarget target;
+    target.catalog = o.value("catalog").toString("NONE");
+    target.object = o.value("object").toString("NONE");
+    QString name = target.catalog + " " + target.object;
+
+    for(auto key: {"not_before", "not_after"}) {
+      if(!o.contains(key))
+        continue;
+      QDateTime time = QDateTime::fromString(o.value(key).toString(), Qt::ISODate);
+      if(!time.isValid()) {
+        error = name + ": " + key + " is not an ISO 8601 time";
+        return false;
+      }
+      (QString(key) == "not_before" ? target.not_before : target.not_after) = time;
+    }
+
+    for(auto b: o.value("blocks").toArray()) {
+      QJsonObject ob = b.toObject();
+      PlanBlock block;
+      block.filter = ob.value("filter").toVariant().toString();
+      block.duration = ob.value("duration").toDouble(-1);
+      block.count = ob.value("count").toInt(1);
+      if(block.duration < 0 || block.count < 1) {
+        error = name + ": each block needs a duration and a positive count";
+        return false;
+      }
+      target.blocks.push_back(block);
+    }
+    if(target.blocks.empty()) {
+      error = name + ": no blocks";
+      return false;
+    }
+
+    mTargets.push_back(target);
+  }
+
+  if(mTargets.empty()) {
+    error = "No targets";
+    return false;
+  }
+
+  return true;
+}
+
+bool ObservationPlan::resolveSlots(const std::map<size_t, std::string> & slot_to_filter,
+                                   QString & error) {
+  for(auto & target: mTargets) {
+    for(auto & block: target.blocks) {
+      if(block.filter.isEmpty())
+        continue;
+
+      bool is_number = false;
+      block.slot = block.filter.toInt(&is_number);
+      if(is_number) {
+        if(slot_to_filter.count(block.slot) == 0) {
+          error = "Filter slot " + block.filter + " is not in the filter wheel";
+          return false;
+        }
+        continue;
+      }
+
+      block.slot = -1;
+      for(auto & it: slot_to_filter) {
+        if(QString::fromStdString(it.second) == block.filter)
+          block.slot = it.first;
+      }
+      if(block.slot < 0) {
+        error = "Filter " + block.filter + " is not in the filter wheel";
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+int ObservationPlan::getRemaining() const {
+  int remaining = 0;
+  for(auto & target: mTargets) {
+    if(!target.expired)
+      remaining += target.getRemaining();
+  }
+  return remaining;
+}
+
+int ObservationPlan::nextTarget(const QDateTime & now, QDateTime & wait_until) {
+
+  int best = -1;
+  wait_until = QDateTime();
+  for(size_t i = 0; i < mTargets.size(); i++) {
+    auto & target = mTargets[i];
+    if(target.expired || target.getRemaining() == 0)
+      continue;
+
+    // Expire the target once not even its shortest frame fits.
+    double shortest = std::numeric_limits<double>::max();
+    for(auto & b: target.blocks) {
+      if(b.done < b.count)
+        shortest = std::min(shortest, b.duration);
+    }
+    if(target.not_after.isValid() &&
+       now.addMSecs(qint64(shortest * 1000)) > target.not_after) {
+      target.expired = true;
+      continue;
+    }
+
+    if(target.not_before.isValid() && now < target.not_before) {
+      if(!wait_until.isValid() || target.not_before < wait_until)
+        wait_until = target.not_before;
+      continue;
+    }
+
+    // Earliest deadline first; unconstrained targets last, in plan order.
+    if(best < 0)
+      best = i;
+    else if(target.not_after.isValid() &&
+            (!mTargets[best].not_after.isValid() ||
+             target.not_after < mTargets[best].not_after))
+      best = i;
+  }
+
+  if(best >= 0)
+    wait_until = QDateTime();
+  return best;
+}
+
+/// Predict the filter move time of a list of frames.
+static double moveCost(const std::vector<ExposureStep> & steps, int current_slot,
+                       const FilterMoveModel & moves) {
+  double cost = 0;
+  int slot = current_slot;
+  for(auto & step: steps) {
+    if(step.slot <= 0)
+      continue;
+    cost += moves.predict(slot, step.slot);
+    slot = step.slot;
+  }
+  return cost;
+}
+
+std::vector<ExposureStep> ObservationPlan::scheduleTarget(int target_index, int current_slot,
+                                                          const FilterMoveModel & moves,
+                                                          Schedule & schedule) const {
+
+  const PlanTarget & target = mTargets[target_index];
+  auto make_step = [&](int block) {
+    ExposureStep step;
+    step.catalog = target.catalog;
+    step.object = target.object;
+    step.filter = target.blocks[block].filter;
+    step.slot = target.blocks[block].slot;
+    step.duration = target.blocks[block].duration;
+    step.target = target_index;
+    step.block = block;
+    return step;
+  };
+
+  // Group the unfinished blocks by filter slot.
+  std::vector<int> slots;
+  std::vector<std::vector<int>> groups;
+  int frames = 0;
+  schedule = Schedule();
+  for(size_t b = 0; b < target.blocks.size(); b++) {
+    auto & block = target.blocks[b];
+    if(block.done >= block.count)
+      continue;
+    auto it = std::find(slots.begin(), slots.end(), block.slot);
+    if(it == slots.end()) {
+      slots.push_back(block.slot);
+      groups.push_back(std::vector<int>());
+      it = slots.end() - 1;
+    }
+    groups[it - slots.begin()].push_back(b);
+    frames += block.count - block.done;
+    schedule.exposure += (block.count - block.done) * block.duration;
+  }
+
+  // Visit the filters in the order that travels least from the current
+  // slot. Wheels hold few filters, so every order can be tried.
+  std::vector<size_t> order(groups.size());
+  for(size_t i = 0; i < order.size(); i++)
+    order[i] = i;
+  auto path_cost = [&](const std::vector<size_t> & o) {
+    double cost = 0;
+    int slot = current_slot;
+    for(auto g: o) {
+      cost += moves.predict(slot, slots[g]);
+      if(slots[g] > 0)
+        slot = slots[g];
+    }
+    return cost;
+  };
+  if(order.size() <= 8) {
+    std::vector<size_t> candidate = order;
+    double best = path_cost(order);
+    while(std::next_permutation(candidate.begin(), candidate.end())) {
+      double cost = path_cost(candidate);
+      if(cost < best) {
+        best = cost;
+        order = candidate;
+      }
+    }
+  }
+
+  // One block after another.
+  std::vector<ExposureStep> blocked;
+  for(auto g: order) {
+    for(auto b: groups[g]) {
+      for(int i = target.blocks[b].done; i < target.blocks[b].count; i++)
+        blocked.push_back(make_step(b));
+    }
+  }
+  schedule.blocked_moves = moveCost(blocked, current_slot, moves);
+  if(groups.size() <= 1 || mInterleave == INTERLEAVE_NEVER)
+    return blocked;
+
+  // One frame per filter per cycle, either always in the same direction or
+  // reversing each cycle so that consecutive cycles share a filter.
+  auto interleave = [&](bool reverse) {
+    std::vector<int> remaining(target.blocks.size());
+    for(size_t b = 0; b < target.blocks.size(); b++)
+      remaining[b] = target.blocks[b].count - target.blocks[b].done;
+
+    std::vector<ExposureStep> steps;
+    std::vector<size_t> cycle = order;
+    while(int(steps.size()) < frames) {
+      for(auto g: cycle) {
+        for(auto b: groups[g]) {
+          if(remaining[b] > 0) {
+            steps.push_back(make_step(b));
+            remaining[b]--;
+            break;
+          }
+        }
+      }
+      if(reverse)
+        std::reverse(cycle.begin(), cycle.end());
+    }
+    return steps;
+  };
+  std::vector<ExposureStep> interleaved = interleave(true);
+  std::vector<ExposureStep> rotated = interleave(false);
+  schedule.interleaved_moves = moveCost(interleaved, current_slot, moves);
+  double rotated_moves = moveCost(rotated, current_slot, moves);
+  if(rotated_moves < schedule.interleaved_moves) {
+    interleaved.swap(rotated);
+    schedule.interleaved_moves = rotated_moves;
+  }
+
+  // Interleave if the extra moves are a small part of the target's time.
+  double extra = schedule.interleaved_moves - schedule.blocked_moves;
+  double total = schedule.exposure + frames * mFrameOverhead + schedule.blocked_moves;
+  schedule.interleaved = mInterleave == INTERLEAVE_ALWAYS ||
+    extra <= mMaxMoveOverhead * total;
+
+  return schedule.interleaved ? interleaved : blocked;
+}
+
+void ObservationPlan::markDone(const ExposureStep & step) {
+  if(step.target < 0 || step.target >= int(mTargets.size()))
+    return;
+  auto & blocks = mTargets[step.target].blocks;
+  if(step.block >= 0 && step.block < int(blocks.size()))
+    blocks[step.block].done++;
+}
+
+void ObservationPlan::expireTarget(int target) {
+  if(target >= 0 && target < int(mTargets.size()))
+    mTargets[target].expired = true;
+}
+
+double ObservationPlan::predictSeconds(const QDateTime & now, int current_slot,
+                                       const FilterMoveModel & moves) const {
+
+  // Run the plan on a copy, advancing a simulated clock.
+  ObservationPlan plan = *this;
+  double elapsed = 0;
+  int slot = current_slot;
+  auto at = [&](double seconds) { return now.addMSecs(std::llround(seconds * 1000)); };
+
+  while(true) {
+    QDateTime wait_until;
+    int index = plan.nextTarget(at(elapsed), wait_until);
+    if(index < 0) {
+      if(!wait_until.isValid())
+        break;
+      elapsed = std::max(elapsed, now.msecsTo(wait_until) * 1E-3);
+      continue;
+    }
+
+    Schedule schedule;
+    auto steps = plan.scheduleTarget(index, slot, moves, schedule);
+    const QDateTime & not_after = plan.mTargets[index].not_after;
+    int taken = 0;
+    for(auto & step: steps) {
+      double move = moves.predict(slot, step.slot);
+      if(not_after.isValid() && at(elapsed + move + step.duration) > not_after)
+        continue;
+      elapsed += move + step.duration + mFrameOverhead;
+      if(step.slot > 0)
+        slot = step.slot;
+      plan.markDone(step);
+      taken++;
+    }
+    // As in Worker::runPlan(), frames that do not fit are skipped and the
+    // target is given up once none fit.
+    if(taken == 0)
+      plan.expireTarget(index);
+  }
+
+  return elapsed;
+}
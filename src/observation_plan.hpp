@@ -0,0 +1,196 @@
+#ifndef OBSERVATION_PLAN_HPP
+#define OBSERVATION_PLAN_HPP
+
+// system includes
+#include <QDateTime>
+#include <QJsonObject>
+#include <QString>
+#include <map>
+#include <string>
+#include <vector>
+
+/// One exposure of a sequence or plan.
+struct ExposureStep {
+  QString catalog; ///< Catalog of the object.
+  QString object; ///< Name of the object.
+  QString filter; ///< Name or slot number of the filter. Empty leaves the wheel alone.
+  int slot = -1; ///< Filter slot, -1 if unknown.
+  double duration = 0; ///< Exposure duration (seconds).
+  int target = -1; ///< Index of the plan target, -1 outside a plan.
+  int block = -1; ///< Index of the block within the target.
+}; // struct ExposureStep
+
+/// Predicts the time to move the filter wheel between two slots from the
+/// moves measured so far.
+///
+/// Moves are assumed to take the same time for the same number of slots
+/// travelled (the shorter way around the wheel). Distances never measured are
+/// interpolated with a straight line through those that were, or estimated
+/// from nominal values until a move has been measured.
+class FilterMoveModel {
+
+public:
+  /// Default constructor
+  FilterMoveModel();
+
+protected:
+  int mSlots = 5; ///< Number of slots in the wheel.
+  double mBase = 1; ///< Nominal time to start and finish a move (seconds).
+  double mPerSlot = 1; ///< Nominal time per slot travelled (seconds).
+
+  /// Sum of measured times and count of moves, by distance.
+  std::map<int, std::pair<double, int>> mMeasured;
+
+public:
+  /// Set the number of slots in the wheel.
+  void setSlotCount(int slots);
+
+  /// Get the number of slots travelled between two slots.
+  /// \param from Current slot. Zero or less if unknown.
+  /// \param to Destination slot.
+  int getDistance(int from, int to) const;
+
+  /// Record a completed move.
+  /// \param seconds Time the move took (seconds).
+  void record(int from, int to, double seconds);
+
+  /// Predict the time to move between two slots (seconds). 0 if they match.
+  double predict(int from, int to) const;
+
+  //
+}; // FilterMoveModel
+
+/// A filter, duration and number of frames to take of a target.
+struct PlanBlock {
+  QString filter; ///< Name or slot number of the filter.
+  int slot = -1; ///< Filter slot, set by ObservationPlan::resolveSlots().
+  double duration = 0; ///< Exposure duration (seconds).
+  int count = 0; ///< Frames requested.
+  int done = 0; ///< Frames taken.
+}; // struct PlanBlock
+
+/// An object to observe and when it may be observed.
+struct PlanTarget {
+  QString catalog; ///< Catalog of the object.
+  QString object; ///< Name of the object.
+  QDateTime not_before; ///< Earliest start of an exposure. Invalid if unconstrained.
+  QDateTime not_after; ///< Latest end of an exposure. Invalid if unconstrained.
+  std::vector<PlanBlock> blocks; ///< Frames to take.
+  bool expired = false; ///< Set once not_after has passed.
+
+  /// Get the number of frames still to be taken.
+  int getRemaining() const;
+}; // struct PlanTarget
+
+/// A list of targets, each with filter/duration/count blocks and a time
+/// window, and the order in which to take them.
+///
+/// Plans are JSON files:
+///
+///   {"interleave": "auto", "max_move_overhead": 0.05, "frame_overhead": 5,
+///    "targets": [
+///      {"catalog": "M", "object": "42",
+///       "not_before": "2026-10-19T02:00:00Z", "not_after": "2026-10-19T04:00:00Z",
+///       "blocks": [{"filter": "Red", "duration": 30, "count": 10},
+///                  {"filter": "Green", "duration": 30, "count": 10}]}]}
+///
+/// Each target is finished before the next begins. Of the targets whose
+/// windows are open, the one whose window closes first goes next. Within a
+/// target, the filters are ordered to travel the shortest distance around
+/// the wheel. They are either taken one block at a time, or interleaved one
+/// frame per filter (e.g. R,G,B,B,G,R,...). "auto" interleaves when doing so
+/// costs no more than max_move_overhead of the target's time in extra
+/// filter moves.
+class ObservationPlan {
+
+public:
+  /// When to interleave the filters of a target.
+  enum Interleave {
+    INTERLEAVE_AUTO,
+    INTERLEAVE_ALWAYS,
+    INTERLEAVE_NEVER,
+  };
+
+  /// How scheduleTarget() ordered a target.
+  struct Schedule {
+    bool interleaved = false; ///< Whether the filters were interleaved.
+    double blocked_moves = 0; ///< Predicted filter move time if blocked (seconds).
+    double interleaved_moves = 0; ///< Predicted filter move time if interleaved (seconds).
+    double exposure = 0; ///< Total exposure time (seconds).
+  };
+
+  /// Default constructor
+  ObservationPlan();
+
+protected:
+  std::vector<PlanTarget> mTargets; ///< Targets in the order given.
+  Interleave mInterleave = INTERLEAVE_AUTO; ///< When to interleave filters.
+  double mMaxMoveOverhead = 0.05; ///< Largest extra move time for interleaving (fraction).
+  double mFrameOverhead = 5; ///< Time per frame other than exposure and moves (seconds).
+
+public:
+  /// Read a plan from a JSON file.
+  /// \param error Reason the plan was rejected.
+  /// \return False if the file is not a valid plan.
+  bool load(const QString & filename, QString & error);
+
+  /// Read a plan from a JSON object.
+  /// \param error Reason the plan was rejected.
+  /// \return False if the object is not a valid plan.
+  bool fromJson(const QJsonObject & plan, QString & error);
+
+  /// Find the slot of each block's filter. Filters given as slot numbers
+  /// must be slots of the wheel.
+  /// \param slot_to_filter Filter names by slot, from the filter wheel.
+  /// \param error Names the first filter or slot not found.
+  /// \return False if a filter is not in the wheel.
+  bool resolveSlots(const std::map<size_t, std::string> & slot_to_filter, QString & error);
+
+  /// Get the targets.
+  const std::vector<PlanTarget> & getTargets() const { return mTargets; }
+
+  /// Get the number of frames still to be taken of targets that have not expired.
+  int getRemaining() const;
+
+  /// Choose the next target, marking any whose window has closed as expired.
+  /// \param now Current time.
+  /// \param wait_until Set, when no window is open yet, to the time the
+  ///        first one opens. Invalid when nothing is left to do.
+  /// \return Index of the target, or -1 if there is none to take now.
+  int nextTarget(const QDateTime & now, QDateTime & wait_until);
+
+  /// Order the remaining frames of a target.
+  /// \param target Index of the target.
+  /// \param current_slot Slot the wheel is in. Zero or less if unknown.
+  /// \param moves Filter move times.
+  /// \param schedule Receives the predicted costs and the choice made.
+  /// \return Frames in the order they should be taken.
+  std::vector<ExposureStep> scheduleTarget(int target, int current_slot,
+                                           const FilterMoveModel & moves,
+                                           Schedule & schedule) const;
+
+  /// Record that a frame was taken.
+  void markDone(const ExposureStep & step);
+
+  /// Give up on a target, e.g. because its window closed.
+  void expireTarget(int target);
+
+  /// Predict the time to finish the plan, including waits for windows to open.
+  /// \param now Current time.
+  /// \param current_slot Slot the wheel is in. Zero or less if unknown.
+  /// \param moves Filter move times.
+  /// \return Time from now (seconds).
+  double predictSeconds(const QDateTime & now, int current_slot,
+                        const FilterMoveModel & moves) const;
+
+  /// Set the time per frame other than the exposure and filter moves.
+  /// \param seconds Time (seconds).
+  void setFrameOverhead(double seconds) { mFrameOverhead = seconds; }
+
+  /// Get the time per frame other than the exposure and filter moves (seconds).
+  double getFrameOverhead() const { return mFrameOverhead; }
+
+  //
+}; // ObservationPlan
+
+#endif // OBSERVATION_PLAN_HPP
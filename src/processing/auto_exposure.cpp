@@ -0,0 +1,231 @@
+// local includes
+#include "auto_exposure.hpp"
+#include "statistics.hpp"
+
+// system includes
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+  /// Convert a time point to seconds since the epoch.
+  template<typename T>
+  double ToSeconds(const T & time_point) {
+    using namespace std::chrono;
+    return duration_cast<duration<double>>(time_point.time_since_epoch()).count();
+  }
+
+  /// Largest rate of change of the sky brightness accepted from the fit
+  /// (1/s). Twilight changes by roughly a factor of two every few minutes;
+  /// anything much faster is noise in the fit.
+  const double MAX_LOG_SLOPE = 0.02;
+
+  /// Smallest signal, in units of the read noise, accepted as a measurement.
+  /// Below this a frame holds no star or no light to scale from.
+  const double MIN_DETECTION = 5;
+}
+
+AutoExposure::AutoExposure() {
+}
+
+AutoExposure::~AutoExposure() {
+}
+
+void AutoExposure::setTargetLevel(double level, double tolerance) {
+  mMode = MODE_LEVEL;
+  mTarget = level;
+  mTolerance = tolerance;
+  mSamples.clear();
+}
+
+void AutoExposure::setTargetSNR(double snr, double tolerance) {
+  mMode = MODE_SNR;
+  mTarget = snr;
+  mTolerance = tolerance;
+  mSamples.clear();
+}
+
+void AutoExposure::setLimits(double duration_min, double duration_max) {
+  mDurationMin = duration_min;
+  mDurationMax = duration_max;
+}
+
+void AutoExposure::setInitialDuration(double duration) {
+  mDuration = duration;
+}
+
+void AutoExposure::setLevels(double bias, double saturation) {
+  mBiasLevel = bias;
+  mSaturationLevel = saturation;
+}
+
+void AutoExposure::setNoiseModel(double gain, double read_noise) {
+  mGain = gain > 0 ? gain : 1.0;
+  mReadNoise = read_noise;
+}
+
+AutoExposure::Measurement AutoExposure::measureLevel(const ImageData & image,
+                                                     Sample & sample, double & value) {
+  // A strided histogram is plenty for a median and avoids touching every pixel.
+  value = Statistics::HistogramMedian(image.data, 7);
+  if(value >= mSaturationLevel)
+    return SATURATED;
+  if(value - mBiasLevel < MIN_DETECTION * mReadNoise / mGain)
+    return UNMEASURABLE;
+
+  sample.rate = (value - mBiasLevel) / image.exposure_duration_sec;
+  return MEASURED;
+}
+
+AutoExposure::Measurement AutoExposure::measureStar(const ImageData & image,
+                                                    Sample & sample, double & value) {
+  const long w = image.width;
+  const long h = image.height;
+  const long r = mApertureRadius;
+  const long r_in = 2 * r;
+  const long r_out = 3 * r;
+  if(w <= 2 * r_out || h <= 2 * r_out)
+    return UNMEASURABLE;
+
+  // Brightest pixel away from the edges.
+  long peak = r_out * w + r_out;
+  for(long y = r_out; y < h - r_out; y++) {
+    const uint16_t * row = image.data.data() + y * w;
+    for(long x = r_out; x < w - r_out; x++) {
+      if(row[x] > image.data[peak])
+        peak = y * w + x;
+    }
+  }
+  if(image.data[peak] >= mSaturationLevel)
+    return SATURATED;
+
+  // Aperture photometry with the sky from a median annulus.
+  long px = peak % w;
+  long py = peak / w;
+  double sum = 0;
+  long n_aperture = 0;
+  std::vector<double> annulus;
+  for(long dy = -r_out; dy <= r_out; dy++) {
+    for(long dx = -r_out; dx <= r_out; dx++) {
+      long d2 = dx * dx + dy * dy;
+      double v = image.data[(py + dy) * w + px + dx];
+      if(d2 <= r * r) {
+        sum += v;
+        n_aperture++;
+      } else if(d2 >= r_in * r_in && d2 <= r_out * r_out) {
+        annulus.push_back(v);
+      }
+    }
+  }
+  double sky = Statistics::MedianInPlace(annulus);
+  double flux = (sum - n_aperture * sky) * mGain;
+
+  double t = image.exposure_duration_sec;
+  double sky_e = std::max(0.0, sky - mBiasLevel) * mGain;
+  double noise = sqrt(std::max(0.0, flux) + n_aperture * (sky_e + mReadNoise * mReadNoise));
+  value = flux / noise;
+
+  // A starless or clouded-out frame gives no rate to scale from.
+  if(value < MIN_DETECTION)
+    return UNMEASURABLE;
+
+  sample.rate = flux / t;
+  sample.sky_rate = sky_e / t;
+  return MEASURED;
+}
+
+double AutoExposure::predictRate(double time, double & slope) {
+
+  // Least squares fit of ln(rate) against time, relative to the newest sample.
+  double t0 = mSamples.back().time;
+  double n = mSamples.size();
+  double st = 0, sy = 0, stt = 0, sty = 0;
+  for(auto & s: mSamples) {
+    double t = s.time - t0;
+    double y = log(s.rate);
+    st += t; sy += y; stt += t * t; sty += t * y;
+  }
+
+  slope = 0;
+  double denominator = n * stt - st * st;
+  if(n > 1 && denominator > 0)
+    slope = (n * sty - st * sy) / denominator;
+  slope = std::max(-MAX_LOG_SLOPE, std::min(MAX_LOG_SLOPE, slope));
+
+  double intercept = (sy - slope * st) / n;
+  return exp(intercept + slope * (time - t0));
+}
+
+double AutoExposure::solveDuration(double rate, double slope, double sky_rate) {
+
+  if(mMode == MODE_LEVEL) {
+    // Integrate rate * exp(slope * t) from 0 to T and solve for the signal.
+    double signal = std::max(1.0, mTarget - mBiasLevel);
+    if(fabs(slope) < 1E-6)
+      return signal / rate;
+
+    double arg = 1 + slope * signal / rate;
+    if(arg <= 0)
+      return mDurationMax; // A fading sky that can never reach the target.
+    return log(arg) / slope;
+  }
+
+  // Solve SNR^2 = (a t)^2 / ((a + b) t + c) for t, where a is the star rate,
+  // b the sky rate in the aperture, and c the read noise in the aperture.
+  double n_aperture = M_PI * mApertureRadius * mApertureRadius;
+  double a = rate;
+  double b = n_aperture * sky_rate;
+  double c = n_aperture * mReadNoise * mReadNoise;
+  double snr2 = mTarget * mTarget;
+  return (snr2 * (a + b) + sqrt(snr2 * snr2 * (a + b) * (a + b) + 4 * a * a * snr2 * c))
+    / (2 * a * a);
+}
+
+double AutoExposure::getNextDuration() {
+  return getNextDuration(ToSeconds(std::chrono::system_clock::now()));
+}
+
+double AutoExposure::getNextDuration(double start_time) {
+
+  if(!mSamples.empty()) {
+    double slope = 0;
+    double rate = predictRate(start_time, slope);
+    mDuration = solveDuration(rate, slope, mSamples.back().sky_rate);
+  }
+
+  mDuration = std::max(mDurationMin, std::min(mDurationMax, mDuration));
+  return mDuration;
+}
+
+bool AutoExposure::update(const ImageData & image) {
+
+  double t = image.exposure_duration_sec;
+  if(image.aborted || t <= 0)
+    return false;
+
+  Sample sample;
+  sample.time = 0.5 * (ToSeconds(image.exposure_start) + ToSeconds(image.exposure_end));
+
+  double value = 0;
+  Measurement measured = (mMode == MODE_LEVEL) ? measureLevel(image, sample, value)
+                                               : measureStar(image, sample, value);
+  if(measured == SATURATED) {
+    // The rate is unknown but too high, so back off sharply and let the next
+    // frame re-establish it.
+    mSamples.clear();
+    mDuration = std::max(mDurationMin, t / 4);
+    return false;
+  } else if(measured == UNMEASURABLE) {
+    // Scaling from no signal would jump to the longest exposure. Repeat this
+    // duration until there is something to measure again.
+    mSamples.clear();
+    mDuration = t;
+    return false;
+  }
+
+  mSamples.push_back(sample);
+  while(mSamples.size() > mMaxSamples)
+    mSamples.pop_front();
+
+  return fabs(value - mTarget) <= mTolerance * mTarget;
+}
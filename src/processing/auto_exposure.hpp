@@ -0,0 +1,123 @@
+#ifndef AUTO_EXPOSURE_HPP
+#define AUTO_EXPOSURE_HPP
+
+// project includes
+#include "image_data.hpp"
+
+// system includes
+#include <deque>
+
+/// Predicts exposure durations from the statistics of previous frames.
+///
+/// Two targets are supported:
+///  - MODE_LEVEL: the median of the frame should reach a given level. Used for
+///    flat fields, where the sky brightness changes quickly during twilight.
+///  - MODE_SNR: the brightest star in the frame should reach a given
+///    signal-to-noise ratio.
+///
+/// Each frame yields a count rate (bias-subtracted ADU per second). The
+/// logarithm of the recent rates is fit against time, so that an
+/// exponentially brightening or fading sky is extrapolated to the next
+/// exposure rather than chased one frame behind.
+class AutoExposure {
+
+public:
+  /// Quantity used to choose the exposure duration.
+  enum Mode {
+    MODE_LEVEL, ///< Median level of the frame.
+    MODE_SNR,   ///< Signal-to-noise ratio of the brightest star.
+  };
+
+  /// Default constructor
+  AutoExposure();
+  /// Default destructor
+  ~AutoExposure();
+
+  /// Outcome of measuring a frame.
+  enum Measurement {
+    MEASURED,     ///< The rate was measured.
+    SATURATED,    ///< The frame was too bright to measure.
+    UNMEASURABLE, ///< Nothing to measure, e.g. no star or no signal above bias.
+  };
+
+protected:
+  /// Count rate measured from one frame.
+  struct Sample {
+    double time = 0; ///< Exposure midpoint (seconds since the epoch).
+    double rate = 0; ///< Rate of the measured quantity (see update()).
+    double sky_rate = 0; ///< Sky rate per pixel, electrons per second.
+  };
+
+  Mode mMode = MODE_LEVEL; ///< Active mode.
+  double mTarget = 30000; ///< Target median (ADU) or SNR.
+  double mTolerance = 0.25; ///< Accepted fractional deviation from the target.
+
+  double mDurationMin = 0.001; ///< Shortest permitted exposure (seconds).
+  double mDurationMax = 3600; ///< Longest permitted exposure (seconds).
+  double mDuration = 1.0; ///< Duration for the next exposure.
+
+  double mBiasLevel = 100; ///< Bias level of the detector (ADU).
+  double mSaturationLevel = 60000; ///< Level above which pixels are unreliable.
+  double mGain = 1.3; ///< Detector gain (electrons / ADU).
+  double mReadNoise = 8.8; ///< Detector read noise (electrons).
+  int mApertureRadius = 5; ///< Photometry aperture radius (pixels).
+
+  std::deque<Sample> mSamples; ///< Recent measurements, oldest first.
+  size_t mMaxSamples = 4; ///< Number of measurements used in the fit.
+
+protected:
+  /// Measure the bias-subtracted median count rate (ADU / s).
+  Measurement measureLevel(const ImageData & image, Sample & sample, double & value);
+
+  /// Measure the electron rate of the brightest star and of the sky.
+  Measurement measureStar(const ImageData & image, Sample & sample, double & value);
+
+  /// Predict the rate at a given time from the recent samples.
+  /// \param time Seconds since the epoch.
+  /// \param slope Output: fitted d(ln rate)/dt (1/s).
+  double predictRate(double time, double & slope);
+
+  /// Exposure needed to accumulate the target at the given rates.
+  double solveDuration(double rate, double slope, double sky_rate);
+
+public:
+  /// Target a median frame level.
+  /// \param level Desired median (ADU, including bias).
+  /// \param tolerance Accepted fractional deviation from the level.
+  void setTargetLevel(double level, double tolerance = 0.25);
+
+  /// Target a signal-to-noise ratio for the brightest star in the frame.
+  /// \param snr Desired signal-to-noise ratio.
+  /// \param tolerance Accepted fractional deviation from the ratio.
+  void setTargetSNR(double snr, double tolerance = 0.25);
+
+  /// Set the permitted range of durations. See Camera::getExposureMinMax.
+  void setLimits(double duration_min, double duration_max);
+
+  /// Set the duration of the first exposure.
+  void setInitialDuration(double duration);
+
+  /// Set the detector bias and saturation levels (ADU).
+  void setLevels(double bias, double saturation);
+
+  /// Set the detector gain (electrons / ADU) and read noise (electrons).
+  void setNoiseModel(double gain, double read_noise);
+
+  /// Get the duration for an exposure starting now.
+  double getNextDuration();
+
+  /// Get the duration for an exposure starting at the specified time.
+  /// \param start_time Seconds since the epoch.
+  double getNextDuration(double start_time);
+
+  /// Measure a completed frame and update the prediction. A saturated frame
+  /// shortens the next exposure; a frame with nothing to measure keeps its
+  /// duration.
+  /// \param image The frame. Must carry exposure_start/end and duration.
+  /// \return true if the frame met the target within the tolerance.
+  bool update(const ImageData & image);
+
+  //
+}; // AutoExposure
+
+#endif // AUTO_EXPOSURE_HPP
@@ -0,0 +1,284 @@
+// local includes
+#include "cosmic_ray.hpp"
+
+// system includes
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <thread>
+
+namespace {
+
+  /// Run fn(first_row, last_row) over horizontal bands of the image in
+  /// parallel. Returns once every band is complete.
+  void ParallelRows(size_t height, unsigned n_threads,
+                    const std::function<void(size_t, size_t)> & fn) {
+    n_threads = std::max(1u, std::min<unsigned>(n_threads, height));
+    size_t band = (height + n_threads - 1) / n_threads;
+
+    std::vector<std::thread> threads;
+    for(unsigned t = 1; t < n_threads; t++) {
+      size_t y0 = t * band;
+      size_t y1 = std::min(height, y0 + band);
+      if(y0 < y1)
+        threads.emplace_back(fn, y0, y1);
+    }
+    fn(0, std::min(height, band));
+
+    for(auto & t: threads)
+      t.join();
+  }
+
+  /// Median of the (2r+1)x(2r+1) box around (x,y). Edges are clamped.
+  template<int R>
+  float BoxMedian(const std::vector<float> & img, size_t width, size_t height,
+                  size_t x, size_t y) {
+    std::array<float, (2 * R + 1) * (2 * R + 1)> box;
+    size_t n = 0;
+    for(int dy = -R; dy <= R; dy++) {
+      size_t yy = std::min<size_t>(height - 1, std::max<long>(0, long(y) + dy));
+      const float * row = img.data() + yy * width;
+      for(int dx = -R; dx <= R; dx++) {
+        size_t xx = std::min<size_t>(width - 1, std::max<long>(0, long(x) + dx));
+        box[n++] = row[xx];
+      }
+    }
+    auto mid = box.begin() + box.size() / 2;
+    std::nth_element(box.begin(), mid, box.end());
+    return *mid;
+  }
+
+  /// Median of the 3x3 box around (x,y) using a fixed exchange network.
+  /// Edges are clamped. This is the hot loop of the cleaner.
+  float Median3x3(const std::vector<float> & img, size_t width, size_t height,
+                  size_t x, size_t y) {
+    size_t xl = x > 0 ? x - 1 : x;
+    size_t xr = x + 1 < width ? x + 1 : x;
+    const float * up   = img.data() + (y > 0 ? y - 1 : y) * width;
+    const float * mid  = img.data() + y * width;
+    const float * down = img.data() + (y + 1 < height ? y + 1 : y) * width;
+    float p[9] = {up[xl],   up[x],   up[xr],
+                  mid[xl],  mid[x],  mid[xr],
+                  down[xl], down[x], down[xr]};
+
+#define CR_SORT(a, b) { if (p[a] > p[b]) std::swap(p[a], p[b]); }
+    CR_SORT(1, 2); CR_SORT(4, 5); CR_SORT(7, 8); CR_SORT(0, 1);
+    CR_SORT(3, 4); CR_SORT(6, 7); CR_SORT(1, 2); CR_SORT(4, 5);
+    CR_SORT(7, 8); CR_SORT(0, 3); CR_SORT(5, 8); CR_SORT(4, 7);
+    CR_SORT(3, 6); CR_SORT(1, 4); CR_SORT(2, 5); CR_SORT(4, 7);
+    CR_SORT(4, 2); CR_SORT(6, 4); CR_SORT(4, 2);
+#undef CR_SORT
+    return p[4];
+  }
+
+  /// Find the root of a union-find set, compressing the path.
+  size_t FindRoot(std::vector<size_t> & parent, size_t i) {
+    while(parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  }
+
+}
+
+CosmicRayCleaner::CosmicRayCleaner() {
+}
+
+CosmicRayCleaner::~CosmicRayCleaner() {
+}
+
+void CosmicRayCleaner::setNoiseModel(double gain, double read_noise) {
+  mGain = gain > 0 ? gain : 1.0;
+  mReadNoise = read_noise;
+}
+
+void CosmicRayCleaner::setSigmaClip(double sigma) {
+  mSigmaClip = sigma;
+}
+
+void CosmicRayCleaner::setObjectLimit(double limit) {
+  mObjectLimit = limit;
+}
+
+void CosmicRayCleaner::setThreads(unsigned threads) {
+  mThreads = threads;
+}
+
+CosmicRayResult CosmicRayCleaner::clean(const ImageData & image) const {
+  using namespace std;
+
+  CosmicRayResult result;
+  result.cleaned = make_shared<ImageData>(image);
+
+  const size_t w = image.width;
+  const size_t h = image.height;
+  const size_t n = w * h;
+  result.mask.assign(n, 0);
+  if(w < 3 || h < 3 || image.aborted)
+    return result;
+
+  unsigned n_threads = mThreads > 0 ? mThreads : thread::hardware_concurrency();
+
+  vector<float> pixels(image.data.begin(), image.data.end());
+  vector<float> med3(n);       // 3x3 median of the image
+  vector<float> laplace(n);    // Positive part of the Laplacian
+  vector<float> signif(n);     // Laplacian over local noise
+  vector<float> signif_bg(n);  // Significance with large scale structure removed
+
+  // Pass 1: median and Laplacian. The Laplacian is evaluated on the image
+  // subsampled 2x2, clipped at zero, and rebinned, which is equivalent to
+  // averaging the positive parts of the four one-sided Laplacians below.
+  // Clipping before rebinning keeps the negative ring around a sharp feature
+  // from cancelling the positive core.
+  ParallelRows(h, n_threads, [&](size_t y0, size_t y1) {
+    for(size_t y = y0; y < y1; y++) {
+      for(size_t x = 0; x < w; x++) {
+        size_t i = y * w + x;
+        med3[i] = Median3x3(pixels, w, h, x, y);
+
+        float c = 2 * pixels[i];
+        float l = (x > 0)     ? pixels[i - 1] : pixels[i];
+        float r = (x + 1 < w) ? pixels[i + 1] : pixels[i];
+        float u = (y > 0)     ? pixels[i - w] : pixels[i];
+        float d = (y + 1 < h) ? pixels[i + w] : pixels[i];
+        laplace[i] = 0.25f * (max(0.0f, c - l - u) + max(0.0f, c - r - u) +
+                              max(0.0f, c - l - d) + max(0.0f, c - r - d));
+      }
+    }
+  });
+
+  // Pass 2: significance with respect to the noise model.
+  const double rn2 = mReadNoise * mReadNoise;
+  ParallelRows(h, n_threads, [&](size_t y0, size_t y1) {
+    for(size_t i = y0 * w; i < y1 * w; i++) {
+      double noise = sqrt(max(0.0, mGain * med3[i]) + rn2) / mGain;
+      signif[i] = laplace[i] / (2.0 * noise);
+    }
+  });
+
+  // Pass 3: remove large scale structure from the significance image, then
+  // detect. The Laplacian is non-negative, so the median removal can only
+  // lower the significance; pixels already below the grow limit are skipped,
+  // which leaves the expensive 5x5 medians for a small fraction of the image.
+  // The fine structure image (which protects stars) is likewise only needed
+  // for candidates.
+  vector<uint8_t> & mask = result.mask;
+  const float grow_limit = mSigmaFrac * mSigmaClip;
+  ParallelRows(h, n_threads, [&](size_t y0, size_t y1) {
+    for(size_t y = y0; y < y1; y++) {
+      for(size_t x = 0; x < w; x++) {
+        size_t i = y * w + x;
+        if(signif[i] <= grow_limit) {
+          signif_bg[i] = 0;
+          continue;
+        }
+
+        signif_bg[i] = signif[i] - BoxMedian<2>(signif, w, h, x, y);
+        if(signif_bg[i] <= mSigmaClip)
+          continue;
+
+        float fine = max(0.01f, med3[i] - BoxMedian<3>(med3, w, h, x, y));
+        if(laplace[i] / fine > mObjectLimit)
+          mask[i] = 1;
+      }
+    }
+  });
+
+  // Pass 4: grow detections into neighbors significant at a lower level.
+  vector<uint8_t> grown(mask);
+  ParallelRows(h, n_threads, [&](size_t y0, size_t y1) {
+    for(size_t y = y0; y < y1; y++) {
+      for(size_t x = 0; x < w; x++) {
+        size_t i = y * w + x;
+        if(mask[i] || signif_bg[i] <= grow_limit)
+          continue;
+
+        bool near_hit = false;
+        for(long dy = -1; dy <= 1 && !near_hit; dy++) {
+          long yy = long(y) + dy;
+          if(yy < 0 || yy >= long(h)) continue;
+          for(long dx = -1; dx <= 1; dx++) {
+            long xx = long(x) + dx;
+            if(xx < 0 || xx >= long(w)) continue;
+            if(mask[yy * w + xx]) { near_hit = true; break; }
+          }
+        }
+        if(near_hit)
+          grown[i] = 1;
+      }
+    }
+  });
+  mask.swap(grown);
+
+  // Pass 5: replace flagged pixels with the median of the unflagged pixels
+  // in the surrounding 5x5 box.
+  uint16_t * out = result.cleaned->data.data();
+  ParallelRows(h, n_threads, [&](size_t y0, size_t y1) {
+    std::array<float, 25> box;
+    for(size_t y = y0; y < y1; y++) {
+      for(size_t x = 0; x < w; x++) {
+        size_t i = y * w + x;
+        if(!mask[i])
+          continue;
+
+        size_t count = 0;
+        for(long dy = -2; dy <= 2; dy++) {
+          long yy = long(y) + dy;
+          if(yy < 0 || yy >= long(h)) continue;
+          for(long dx = -2; dx <= 2; dx++) {
+            long xx = long(x) + dx;
+            if(xx < 0 || xx >= long(w)) continue;
+            size_t j = yy * w + xx;
+            if(!mask[j])
+              box[count++] = pixels[j];
+          }
+        }
+
+        float value = med3[i];
+        if(count > 0) {
+          auto mid = box.begin() + count / 2;
+          std::nth_element(box.begin(), mid, box.begin() + count);
+          value = *mid;
+        }
+        out[i] = uint16_t(min(65535.0f, max(0.0f, value + 0.5f)));
+      }
+    }
+  });
+
+  // Count hits as 8-connected groups of flagged pixels. The mask is sparse so
+  // the union-find only visits flagged pixels.
+  vector<size_t> flagged;
+  for(size_t i = 0; i < n; i++)
+    if(mask[i]) flagged.push_back(i);
+
+  result.pixels = flagged.size();
+  vector<size_t> parent(flagged.size());
+  for(size_t k = 0; k < flagged.size(); k++)
+    parent[k] = k;
+
+  auto lookup = [&](size_t i) {
+    auto it = lower_bound(flagged.begin(), flagged.end(), i);
+    return (it != flagged.end() && *it == i) ? long(it - flagged.begin()) : -1L;
+  };
+  for(size_t k = 0; k < flagged.size(); k++) {
+    size_t x = flagged[k] % w;
+    size_t y = flagged[k] / w;
+    // Only look at neighbors already visited in raster order.
+    const long offsets[4][2] = {{-1, 0}, {-1, -1}, {0, -1}, {1, -1}};
+    for(auto & o: offsets) {
+      long xx = long(x) + o[0];
+      long yy = long(y) + o[1];
+      if(xx < 0 || yy < 0 || xx >= long(w)) continue;
+      long j = lookup(yy * w + xx);
+      if(j >= 0)
+        parent[FindRoot(parent, k)] = FindRoot(parent, j);
+    }
+  }
+  for(size_t k = 0; k < flagged.size(); k++)
+    if(FindRoot(parent, k) == k) result.hits++;
+
+  result.cleaned->cosmic_ray_hits = result.hits;
+  return result;
+}
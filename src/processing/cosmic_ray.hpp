@@ -0,0 +1,74 @@
+#ifndef COSMIC_RAY_HPP
+#define COSMIC_RAY_HPP
+
+// project includes
+#include "image_data.hpp"
+
+// system includes
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// Output of the cosmic ray cleaner.
+struct CosmicRayResult {
+  /// One entry per pixel. Non-zero where a cosmic ray was detected.
+  std::vector<uint8_t> mask;
+  /// Copy of the input image with the flagged pixels replaced.
+  std::shared_ptr<ImageData> cleaned;
+  /// Number of distinct cosmic ray hits (connected groups of flagged pixels).
+  size_t hits = 0;
+  /// Total number of flagged pixels.
+  size_t pixels = 0;
+};
+
+/// Single-frame cosmic ray rejection by Laplacian edge detection.
+///
+/// This follows the L.A.Cosmic approach (van Dokkum 2001): cosmic rays have
+/// much sharper edges than anything that passed through the optics, so they
+/// stand out in the Laplacian of the image relative to the local noise. A
+/// fine-structure image is used to keep compact stars from being flagged.
+/// One detection pass is made, followed by growing the mask into adjacent
+/// pixels that are significant at a lower threshold.
+///
+/// Each pass over the image is split into horizontal bands, one per thread.
+/// The threads are started for each pass and joined at its end; starting
+/// them costs far less than a pass over a full frame.
+class CosmicRayCleaner {
+
+public:
+  /// Default constructor
+  CosmicRayCleaner();
+  /// Default destructor.
+  ~CosmicRayCleaner();
+
+protected:
+  double mGain      = 1.3; ///< Detector gain (electrons / ADU).
+  double mReadNoise = 8.8; ///< Detector read noise (electrons).
+  double mSigmaClip = 4.5; ///< Laplacian significance needed for detection.
+  double mSigmaFrac = 0.3; ///< Fraction of mSigmaClip used to grow detections.
+  double mObjectLimit = 2.0; ///< Minimum Laplacian / fine structure contrast.
+  unsigned mThreads = 0; ///< Number of threads. 0 = hardware concurrency.
+
+public:
+  /// Set the detector gain (electrons / ADU) and read noise (electrons).
+  void setNoiseModel(double gain, double read_noise);
+
+  /// Set the detection threshold in units of sigma.
+  void setSigmaClip(double sigma);
+
+  /// Set the minimum contrast between the Laplacian and the fine structure
+  /// image. Raise this if the cores of stars are being flagged.
+  void setObjectLimit(double limit);
+
+  /// Set the number of threads to use. 0 selects the hardware concurrency.
+  void setThreads(unsigned threads);
+
+  /// Detect and clean cosmic rays in an image. The input is not modified.
+  /// \param image The image to inspect.
+  /// \return Mask, cleaned copy, and hit count.
+  CosmicRayResult clean(const ImageData & image) const;
+
+  //
+}; // CosmicRayCleaner
+
+#endif // COSMIC_RAY_HPP
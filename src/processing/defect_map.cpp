@@ -0,0 +1,312 @@
+// local includes
+#include "defect_map.hpp"
+#include "statistics.hpp"
+
+// system includes
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+namespace {
+  /// Identifies a defect map file ("DMAP").
+  const uint32_t DEFECT_MAP_MAGIC = 0x50414D44;
+  /// Version of the defect map file format.
+  const uint32_t DEFECT_MAP_VERSION = 1;
+}
+
+DefectMap::DefectMap() {
+}
+
+DefectMap::~DefectMap() {
+}
+
+std::shared_ptr<DefectMap>
+DefectMap::build(const std::vector<std::shared_ptr<ImageData>> & frames,
+                 double hot_sigma, double column_sigma) {
+  using namespace std;
+
+  auto map = make_shared<DefectMap>();
+  if(frames.empty())
+    return map;
+
+  size_t width  = frames[0]->width;
+  size_t height = frames[0]->height;
+  for(auto & f: frames) {
+    if(f->width != width || f->height != height || f->aborted) {
+      cout << "Defect map frames must share dimensions and be complete." << endl;
+      return map;
+    }
+  }
+  map->mWidth  = width;
+  map->mHeight = height;
+
+  // Combine the frames by per-pixel median so transient events (cosmic rays)
+  // are not mistaken for hot pixels.
+  size_t n_pixels = width * height;
+  vector<double> master(n_pixels);
+  vector<uint16_t> stack(frames.size());
+  for(size_t i = 0; i < n_pixels; i++) {
+    for(size_t j = 0; j < frames.size(); j++)
+      stack[j] = frames[j]->data[i];
+    master[i] = Statistics::MedianInPlace(stack);
+  }
+
+  // Robust statistics for the whole frame.
+  vector<double> scratch(master);
+  double median = Statistics::MedianInPlace(scratch);
+  double sigma  = Statistics::RobustSigmaInPlace(scratch, median);
+  if(sigma <= 0)
+    sigma = 1;
+
+  // Columns are judged by their median, which is insensitive to the few hot
+  // pixels every column contains.
+  vector<double> column_medians(width);
+  vector<double> column(height);
+  for(size_t x = 0; x < width; x++) {
+    for(size_t y = 0; y < height; y++)
+      column[y] = master[y * width + x];
+    column_medians[x] = Statistics::MedianInPlace(column);
+  }
+  scratch = column_medians;
+  double column_median = Statistics::MedianInPlace(scratch);
+  double column_spread = Statistics::RobustSigmaInPlace(scratch, column_median);
+  if(column_spread <= 0)
+    column_spread = 1;
+
+  vector<bool> bad_column(width, false);
+  for(size_t x = 0; x < width; x++) {
+    if(fabs(column_medians[x] - column_median) > column_sigma * column_spread) {
+      bad_column[x] = true;
+      map->mBadColumns.push_back(x);
+    }
+  }
+
+  // Hot pixels outside of bad columns. Iterating in order keeps the index sorted.
+  double threshold = median + hot_sigma * sigma;
+  for(size_t i = 0; i < n_pixels; i++) {
+    if(master[i] > threshold && !bad_column[i % width])
+      map->mHotPixels.push_back(i);
+  }
+
+  map->resolveFixes();
+  return map;
+}
+
+void DefectMap::resolveFixes() {
+
+  mPixelFixes.clear();
+  mNeighbors.clear();
+  mColumnFixes.clear();
+
+  std::vector<bool> bad_column(mWidth, false);
+  for(auto c: mBadColumns)
+    bad_column[c] = true;
+
+  // Nearest good column on either side of each bad column.
+  for(auto c: mBadColumns) {
+    ColumnFix fix;
+    fix.column = c;
+    for(int32_t x = int32_t(c) - 1; x >= 0; x--) {
+      if(!bad_column[x]) { fix.left = x; break; }
+    }
+    for(int32_t x = c + 1; x < int32_t(mWidth); x++) {
+      if(!bad_column[x]) { fix.right = x; break; }
+    }
+    mColumnFixes.push_back(fix);
+  }
+
+  auto is_defect = [&](int64_t x, int64_t y) {
+    if(bad_column[x])
+      return true;
+    uint32_t index = y * mWidth + x;
+    return std::binary_search(mHotPixels.begin(), mHotPixels.end(), index);
+  };
+
+  // Use the 4-connected neighbors that are themselves good. Fall back to the
+  // diagonals for clusters of hot pixels.
+  const int offsets[8][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1},
+                             {-1, -1}, {1, -1}, {-1, 1}, {1, 1}};
+  for(auto index: mHotPixels) {
+    PixelFix fix;
+    fix.index = index;
+    fix.first_neighbor = mNeighbors.size();
+
+    int64_t x = index % mWidth;
+    int64_t y = index / mWidth;
+    for(int k = 0; k < 8; k++) {
+      // Only consult the diagonals if no direct neighbor was usable.
+      if(k == 4 && fix.n_neighbors > 0)
+        break;
+
+      int64_t nx = x + offsets[k][0];
+      int64_t ny = y + offsets[k][1];
+      if(nx < 0 || ny < 0 || nx >= int64_t(mWidth) || ny >= int64_t(mHeight))
+        continue;
+      if(is_defect(nx, ny))
+        continue;
+
+      mNeighbors.push_back(ny * mWidth + nx);
+      fix.n_neighbors++;
+    }
+
+    if(fix.n_neighbors > 0)
+      mPixelFixes.push_back(fix);
+  }
+}
+
+long DefectMap::apply(ImageData & image) const {
+
+  if(image.width != mWidth || image.height != mHeight)
+    return -1;
+
+  uint16_t * data = image.data.data();
+  long n_corrected = 0;
+
+  // Bad columns first, row by row so memory is walked in order.
+  if(!mColumnFixes.empty()) {
+    for(size_t y = 0; y < mHeight; y++) {
+      uint16_t * row = data + y * mWidth;
+      for(auto & fix: mColumnFixes) {
+        if(fix.left >= 0 && fix.right >= 0)
+          row[fix.column] = (uint32_t(row[fix.left]) + row[fix.right] + 1) / 2;
+        else if(fix.left >= 0)
+          row[fix.column] = row[fix.left];
+        else if(fix.right >= 0)
+          row[fix.column] = row[fix.right];
+      }
+    }
+    n_corrected += mColumnFixes.size() * mHeight;
+  }
+
+  // Hot pixels. Neighbors never include other defects, so order is irrelevant.
+  const uint32_t * neighbors = mNeighbors.data();
+  for(auto & fix: mPixelFixes) {
+    uint32_t sum = 0;
+    for(uint32_t k = 0; k < fix.n_neighbors; k++)
+      sum += data[neighbors[fix.first_neighbor + k]];
+    data[fix.index] = (sum + fix.n_neighbors / 2) / fix.n_neighbors;
+  }
+  n_corrected += mPixelFixes.size();
+
+  return n_corrected;
+}
+
+bool DefectMap::save(const std::string & filename) const {
+
+  std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+  if(!out)
+    return false;
+
+  uint32_t header[6] = {DEFECT_MAP_MAGIC, DEFECT_MAP_VERSION,
+                        uint32_t(mWidth), uint32_t(mHeight),
+                        uint32_t(mHotPixels.size()), uint32_t(mBadColumns.size())};
+  out.write(reinterpret_cast<const char *>(header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(mHotPixels.data()),
+            mHotPixels.size() * sizeof(uint32_t));
+  out.write(reinterpret_cast<const char *>(mBadColumns.data()),
+            mBadColumns.size() * sizeof(uint32_t));
+
+  return bool(out);
+}
+
+std::shared_ptr<DefectMap> DefectMap::load(const std::string & filename) {
+
+  std::ifstream in(filename, std::ios::binary);
+  if(!in)
+    return nullptr;
+
+  uint32_t header[6] = {0};
+  in.read(reinterpret_cast<char *>(header), sizeof(header));
+  if(!in || header[0] != DEFECT_MAP_MAGIC || header[1] != DEFECT_MAP_VERSION)
+    return nullptr;
+
+  auto map = std::make_shared<DefectMap>();
+  map->mWidth  = header[2];
+  map->mHeight = header[3];
+  map->mHotPixels.resize(header[4]);
+  map->mBadColumns.resize(header[5]);
+  in.read(reinterpret_cast<char *>(map->mHotPixels.data()),
+          map->mHotPixels.size() * sizeof(uint32_t));
+  in.read(reinterpret_cast<char *>(map->mBadColumns.data()),
+          map->mBadColumns.size() * sizeof(uint32_t));
+  if(!in)
+    return nullptr;
+
+  // Lookups during resolveFixes() rely on a sorted index.
+  std::sort(map->mHotPixels.begin(), map->mHotPixels.end());
+  std::sort(map->mBadColumns.begin(), map->mBadColumns.end());
+
+  // Reject indices that fall outside of the detector.
+  size_t n_pixels = map->mWidth * map->mHeight;
+  for(auto i: map->mHotPixels)
+    if(i >= n_pixels) return nullptr;
+  for(auto c: map->mBadColumns)
+    if(c >= map->mWidth) return nullptr;
+
+  map->resolveFixes();
+  return map;
+}
+
+DefectMapCache::DefectMapCache() {
+}
+
+DefectMapCache & DefectMapCache::getInstance() {
+  static DefectMapCache instance;
+  return instance;
+}
+
+std::string DefectMapCache::makeKey(const std::string & detector_name,
+                                    const std::string & serial_number,
+                                    const std::string & readout_mode) {
+  std::string key = detector_name + "_" + serial_number + "_" + readout_mode;
+  std::replace_if(key.begin(), key.end(),
+                  [](char c) { return !isalnum(c) && c != '-' && c != '_'; }, '_');
+  return key;
+}
+
+void DefectMapCache::setDirectory(const std::string & directory) {
+  const std::lock_guard<std::mutex> lock(mMutex);
+  mDirectory = directory;
+  mMaps.clear();
+}
+
+std::string DefectMapCache::getDirectory() {
+  const std::lock_guard<std::mutex> lock(mMutex);
+  return mDirectory;
+}
+
+std::shared_ptr<DefectMap> DefectMapCache::get(const std::string & detector_name,
+                                               const std::string & serial_number,
+                                               const std::string & readout_mode) {
+  const std::lock_guard<std::mutex> lock(mMutex);
+  if(mDirectory.empty())
+    return nullptr;
+
+  auto key = makeKey(detector_name, serial_number, readout_mode);
+  auto it = mMaps.find(key);
+  if(it != mMaps.end())
+    return it->second;
+
+  // Cache misses too, so a missing file is only looked for once.
+  auto map = DefectMap::load(mDirectory + "/" + key + ".dmap");
+  mMaps[key] = map;
+  return map;
+}
+
+bool DefectMapCache::put(const std::string & detector_name,
+                         const std::string & serial_number,
+                         const std::string & readout_mode,
+                         std::shared_ptr<DefectMap> map) {
+  const std::lock_guard<std::mutex> lock(mMutex);
+  if(mDirectory.empty() || map == nullptr)
+    return false;
+
+  auto key = makeKey(detector_name, serial_number, readout_mode);
+  if(!map->save(mDirectory + "/" + key + ".dmap"))
+    return false;
+
+  mMaps[key] = map;
+  return true;
+}
@@ -0,0 +1,153 @@
+#ifndef DEFECT_MAP_HPP
+#define DEFECT_MAP_HPP
+
+// project includes
+#include "image_data.hpp"
+
+// system includes
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// A sparse map of hot pixels and bad columns for one detector and readout
+/// mode.
+///
+/// The map is built once from a sequence of dark or bias frames and stored
+/// as sorted pixel indices plus a list of bad columns. At load time the
+/// neighbors used to repair each defect are resolved, so correcting a frame
+/// is a single pass over the defects with no searching or branching on
+/// image contents.
+class DefectMap {
+
+public:
+  /// Default constructor. Creates an empty map.
+  DefectMap();
+  /// Default destructor.
+  ~DefectMap();
+
+protected:
+  /// Precomputed repair for a single hot pixel.
+  struct PixelFix {
+    uint32_t index = 0; ///< Linear index of the hot pixel.
+    uint32_t first_neighbor = 0; ///< Offset into mNeighbors.
+    uint32_t n_neighbors = 0; ///< Number of entries in mNeighbors to average.
+  };
+
+  /// Precomputed repair for a single bad column.
+  struct ColumnFix {
+    uint32_t column = 0; ///< The bad column.
+    int32_t left  = -1; ///< Nearest good column to the left (-1 if none).
+    int32_t right = -1; ///< Nearest good column to the right (-1 if none).
+  };
+
+  size_t mWidth  = 0; ///< Width of the detector in this readout mode.
+  size_t mHeight = 0; ///< Height of the detector in this readout mode.
+
+  std::vector<uint32_t> mHotPixels; ///< Sorted linear indices of hot pixels.
+  std::vector<uint32_t> mBadColumns; ///< Sorted indices of bad columns.
+
+  std::vector<PixelFix> mPixelFixes; ///< Resolved hot pixel repairs.
+  std::vector<uint32_t> mNeighbors; ///< Neighbor indices used by mPixelFixes.
+  std::vector<ColumnFix> mColumnFixes; ///< Resolved bad column repairs.
+
+protected:
+  /// Resolve the neighbors used to repair each defect.
+  void resolveFixes();
+
+public:
+  /// Build a defect map from a sequence of dark or bias frames.
+  /// \param frames Frames of identical dimensions, taken with the shutter closed.
+  /// \param hot_sigma Pixels this many robust sigma above the median are hot.
+  /// \param column_sigma Columns whose median deviates by this many robust
+  ///        sigma from the median column are bad.
+  /// \return A defect map. Empty if the frames are unusable.
+  static std::shared_ptr<DefectMap>
+  build(const std::vector<std::shared_ptr<ImageData>> & frames,
+        double hot_sigma = 5.0, double column_sigma = 5.0);
+
+  /// Load a defect map from disk.
+  /// \param filename Name of the file.
+  /// \return A defect map, or nullptr if the file could not be read.
+  static std::shared_ptr<DefectMap> load(const std::string & filename);
+
+  /// Save this defect map to disk.
+  /// \param filename Name of the output file.
+  /// \return true on success.
+  bool save(const std::string & filename) const;
+
+  /// Repair all defects in the image in place by neighbor interpolation.
+  /// \param image The image to correct. Must match the map's dimensions.
+  /// \return Number of pixels corrected, or -1 if the dimensions differ.
+  long apply(ImageData & image) const;
+
+  /// Get the number of hot pixels in the map.
+  size_t getHotPixelCount() const { return mHotPixels.size(); }
+
+  /// Get the number of bad columns in the map.
+  size_t getBadColumnCount() const { return mBadColumns.size(); }
+
+  /// Get the width of the map.
+  size_t getWidth() const { return mWidth; }
+
+  /// Get the height of the map.
+  size_t getHeight() const { return mHeight; }
+
+  //
+}; // DefectMap
+
+/// Singleton cache of defect maps keyed by detector, serial number and
+/// readout mode. Defects belong to one sensor, so two cameras of the same
+/// model must not share a map.
+class DefectMapCache {
+
+private:
+  /// Default constructor (private)
+  DefectMapCache();
+
+protected:
+  std::mutex mMutex; ///< Protects the members below.
+  std::string mDirectory; ///< Directory holding defect map files.
+  /// Loaded maps. A null entry records that no file exists for the key.
+  std::map<std::string, std::shared_ptr<DefectMap>> mMaps;
+
+public:
+  /// Returns the instance of the DefectMapCache.
+  static DefectMapCache & getInstance();
+
+  /// Construct the file name for a detector and readout mode.
+  /// \param detector_name Name of the detector.
+  /// \param serial_number Serial number of the camera.
+  /// \param readout_mode Name of the readout mode.
+  static std::string makeKey(const std::string & detector_name,
+                             const std::string & serial_number,
+                             const std::string & readout_mode);
+
+public:
+  /// Set the directory from which defect maps are read and written.
+  /// Clears any maps already cached.
+  void setDirectory(const std::string & directory);
+
+  /// Get the directory for defect maps. Empty if none has been set.
+  std::string getDirectory();
+
+  /// Get the defect map for a detector and readout mode, loading it from disk
+  /// on first use.
+  /// \return The defect map, or nullptr if none exists.
+  std::shared_ptr<DefectMap> get(const std::string & detector_name,
+                                 const std::string & serial_number,
+                                 const std::string & readout_mode);
+
+  /// Save a defect map to disk and place it in the cache.
+  /// \return true on success.
+  bool put(const std::string & detector_name,
+           const std::string & serial_number,
+           const std::string & readout_mode,
+           std::shared_ptr<DefectMap> map);
+
+  //
+}; // DefectMapCache
+
+#endif // DEFECT_MAP_HPP
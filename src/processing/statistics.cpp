@@ -0,0 +1,50 @@
+// system includes
+#include <algorithm>
+#include <cmath>
+
+// local includes
+#include "statistics.hpp"
+
+namespace Statistics {
+
+  double MedianInPlace(std::vector<double> & values) {
+    auto mid = values.begin() + values.size() / 2;
+    std::nth_element(values.begin(), mid, values.end());
+    return *mid;
+  }
+
+  uint16_t MedianInPlace(std::vector<uint16_t> & values) {
+    auto mid = values.begin() + values.size() / 2;
+    std::nth_element(values.begin(), mid, values.end());
+    return *mid;
+  }
+
+  double RobustSigmaInPlace(std::vector<double> & values, double median) {
+    for(auto & v: values)
+      v = fabs(v - median);
+
+    // 1.4826 scales the MAD to sigma for normally distributed values.
+    return 1.4826 * MedianInPlace(values);
+  }
+
+  uint16_t HistogramMedian(const std::vector<uint16_t> & data, size_t stride) {
+    std::vector<uint32_t> histogram(65536, 0);
+    size_t count = 0;
+    for(size_t i = 0; i < data.size(); i += stride) {
+      histogram[data[i]]++;
+      count++;
+    }
+
+    size_t half = count / 2;
+    size_t total = 0;
+    for(size_t v = 0; v < histogram.size(); v++) {
+      total += histogram[v];
+      if(total > half)
+        return v;
+    }
+
+    return 0;
+  }
+
+  //
+}; // namespace Statistics
@@ -0,0 +1,33 @@
+#ifndef PROCESSING_STATISTICS_HPP
+#define PROCESSING_STATISTICS_HPP
+
+// system includes
+#include <cstdint>
+#include <vector>
+
+namespace Statistics {
+
+  /// Compute the median of a set of values. The input is reordered.
+  /// \param values Values to inspect. Must not be empty.
+  double MedianInPlace(std::vector<double> & values);
+
+  /// Compute the median of a set of 16-bit values. The input is reordered.
+  /// \param values Values to inspect. Must not be empty.
+  uint16_t MedianInPlace(std::vector<uint16_t> & values);
+
+  /// Compute a robust estimate of the standard deviation from the median
+  /// absolute deviation. The input is reordered.
+  /// \param values Values to inspect. Must not be empty.
+  /// \param median Median of the values.
+  double RobustSigmaInPlace(std::vector<double> & values, double median);
+
+  /// Compute the median of a 16-bit image by histogram. Runs in linear time
+  /// without copying the image.
+  /// \param data Pixel values.
+  /// \param stride Only every stride-th pixel is inspected.
+  uint16_t HistogramMedian(const std::vector<uint16_t> & data, size_t stride = 1);
+
+  //
+}; // namespace Statistics
+
+#endif // PROCESSING_STATISTICS_HPP
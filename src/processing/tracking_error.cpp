@@ -0,0 +1,86 @@
+#include "tracking_error.hpp"
+
+// system includes
+#include <algorithm>
+#include <cmath>
+
+/// Arcseconds per radian.
+static const double ARCSEC_PER_RAD = 180.0 * 3600.0 / M_PI;
+
+TrackingError::TrackingError() {
+}
+
+void TrackingError::reset() {
+  *this = TrackingError();
+}
+
+void TrackingError::add(double t, double ra, double dec) {
+  add(t, ra, dec, ra, ra, dec, dec);
+}
+
+void TrackingError::add(double t, double ra, double dec,
+                        double ra_min, double ra_max, double dec_min, double dec_max) {
+
+  if(!mHaveOrigin) {
+    mHaveOrigin = true;
+    mRA0 = ra;
+    mDEC0 = dec;
+    mCosDEC0 = cos(dec);
+  }
+
+  double x = remainder(ra - mRA0, 2 * M_PI) * mCosDEC0 * ARCSEC_PER_RAD;
+  double y = (dec - mDEC0) * ARCSEC_PER_RAD;
+
+  // The extremes are offsets from the mean, so they share its unwrapping.
+  double scale_x = mCosDEC0 * ARCSEC_PER_RAD;
+  double xs[2] = {x + (ra_min - ra) * scale_x, x + (ra_max - ra) * scale_x};
+  double ys[2] = {y + (dec_min - dec) * ARCSEC_PER_RAD, y + (dec_max - dec) * ARCSEC_PER_RAD};
+  for(double xe: xs) {
+    mPeakX = std::max(mPeakX, fabs(xe));
+    for(double ye: ys)
+      mPeak = std::max(mPeak, sqrt(xe * xe + ye * ye));
+  }
+  for(double ye: ys)
+    mPeakY = std::max(mPeakY, fabs(ye));
+
+  // Welford's update for the means, variances, and co-moments with time.
+  mCount++;
+  double dt = t - mMeanT;
+  double dx = x - mMeanX;
+  double dy = y - mMeanY;
+  mMeanT += dt / mCount;
+  mMeanX += dx / mCount;
+  mMeanY += dy / mCount;
+  mM2T += dt * (t - mMeanT);
+  mM2X += dx * (x - mMeanX);
+  mM2Y += dy * (y - mMeanY);
+  mCTX += dt * (x - mMeanX);
+  mCTY += dt * (y - mMeanY);
+}
+
+double TrackingError::getRmsRA() const {
+  return mCount > 0 ? sqrt(mM2X / mCount) : 0;
+}
+
+double TrackingError::getRmsDEC() const {
+  return mCount > 0 ? sqrt(mM2Y / mCount) : 0;
+}
+
+double TrackingError::getRateRA() const {
+  return mM2T > 0 ? mCTX / mM2T : 0;
+}
+
+double TrackingError::getRateDEC() const {
+  return mM2T > 0 ? mCTY / mM2T : 0;
+}
+
+void TrackingError::apply(ImageData & image, double threshold) const {
+  image.tracking_samples  = mCount;
+  image.tracking_rms_ra   = getRmsRA();
+  image.tracking_rms_dec  = getRmsDEC();
+  image.tracking_peak_ra  = getPeakRA();
+  image.tracking_peak_dec = getPeakDEC();
+  image.tracking_rate_ra  = getRateRA();
+  image.tracking_rate_dec = getRateDEC();
+  image.tracking_flagged  = threshold > 0 && getPeak() > threshold;
+}
@@ -0,0 +1,85 @@
+#ifndef TRACKING_ERROR_HPP
+#define TRACKING_ERROR_HPP
+
+// project includes
+#include "image_data.hpp"
+
+/// Accumulates tracking-error statistics from RA/DEC samples one at a time.
+///
+/// Each sample costs O(1) time and the accumulator uses O(1) memory, so it
+/// can run over any number of updates. Offsets are measured on the sky from
+/// the first sample: RA is scaled by cos(DEC) and unwrapped at 0/2 pi.
+///
+///  - RMS: scatter of each axis about its mean.
+///  - Peak: largest offset from the first sample, per axis and combined.
+///    For decimated samples the bucket extremes are used, so a short
+///    excursion is not averaged away.
+///  - Rate: slope of a least-squares line through each axis.
+class TrackingError {
+
+public:
+  /// Default constructor
+  TrackingError();
+
+protected:
+  bool mHaveOrigin = false; ///< Whether the first sample has been seen.
+  double mRA0 = 0; ///< RA of the first sample (radians).
+  double mDEC0 = 0; ///< DEC of the first sample (radians).
+  double mCosDEC0 = 1; ///< cos(mDEC0).
+
+  long mCount = 0; ///< Number of samples.
+  double mMeanT = 0, mMeanX = 0, mMeanY = 0; ///< Running means.
+  double mM2X = 0, mM2Y = 0; ///< Running sums of squared deviations.
+  double mCTX = 0, mCTY = 0, mM2T = 0; ///< Running co-moments with time.
+  double mPeakX = 0, mPeakY = 0, mPeak = 0; ///< Largest offsets (arcsec).
+
+public:
+  /// Forget all samples.
+  void reset();
+
+  /// Add a sample.
+  /// \param t Time of the sample (seconds, any origin).
+  /// \param ra RA (radians).
+  /// \param dec DEC (radians).
+  void add(double t, double ra, double dec);
+
+  /// Add a sample summarizing several updates, e.g. a decimation bucket.
+  /// \param t Mean time of the updates (seconds, any origin).
+  /// \param ra Mean RA (radians).
+  /// \param dec Mean DEC (radians).
+  /// \param ra_min,ra_max Extremes of RA, on the same branch as ra (radians).
+  /// \param dec_min,dec_max Extremes of DEC (radians).
+  void add(double t, double ra, double dec,
+           double ra_min, double ra_max, double dec_min, double dec_max);
+
+  /// Number of samples added.
+  long getCount() const { return mCount; }
+
+  /// RMS scatter of RA about its mean, on the sky (arcsec).
+  double getRmsRA() const;
+  /// RMS scatter of DEC about its mean (arcsec).
+  double getRmsDEC() const;
+
+  /// Largest RA offset from the first sample, on the sky (arcsec).
+  double getPeakRA() const { return mPeakX; }
+  /// Largest DEC offset from the first sample (arcsec).
+  double getPeakDEC() const { return mPeakY; }
+  /// Largest total offset from the first sample (arcsec). For decimated
+  /// samples this is the farthest corner of the bucket's extremes.
+  double getPeak() const { return mPeak; }
+
+  /// Drift rate in RA, on the sky (arcsec/s).
+  double getRateRA() const;
+  /// Drift rate in DEC (arcsec/s).
+  double getRateDEC() const;
+
+  /// Copy the statistics into an image's tracking fields.
+  /// \param image The image.
+  /// \param threshold Peak offset (arcsec) above which the image is flagged.
+  ///        Zero or less disables flagging.
+  void apply(ImageData & image, double threshold) const;
+
+  //
+}; // TrackingError
+
+#endif // TRACKING_ERROR_HPP
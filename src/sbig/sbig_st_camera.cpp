@@ -219,7 +219,7 @@ std::string SbigSTCamera::ToString() {
 }
 
 void SbigSTCamera::abortExposure() {
-  do_exposure_ = false;
+  mSTDevice->Abort();
 }
 
 
@@ -266,6 +266,13 @@ double SbigSTCamera::getTemperature(niad::TemperatureType target) {
   return temperature;
 }
 
+double SbigSTCamera::getGain(niad::CameraReadoutMode readout_mode) {
+  auto it = mReadoutSettings.find(readout_mode);
+  if(it == mReadoutSettings.end())
+    return 0;
+  return it->second.gain;
+}
+
 double SbigSTCamera::getTemperatureTarget(niad::TemperatureType target) {
   // Get access to the SBIG driver
   SbigSTDriver& drv = SbigSTDriver::GetInstance();
@@ -310,7 +317,10 @@ ImageData * SbigSTCamera::acquireImage(double exposure_duration_sec,
                                        niad::CameraReadoutMode readout_mode,
                                        niad::CameraShutterAction shutter_action)
 {
-  // Indicate we are going to do an exposure.
+  // Indicate we are going to do an exposure. Anything that cancels the
+  // device from here on aborts it.
+  auto & cancellation = mSTDevice->GetCancellation();
+  uint64_t generation = cancellation.Generation();
   do_exposure_ = true;
 
   // Get the camera's preferred settings for this readout mode.
@@ -339,7 +349,9 @@ ImageData * SbigSTCamera::acquireImage(double exposure_duration_sec,
   SbigSTDriver &drv = SbigSTDriver::GetInstance();
 
   // unpack things from the settings
-  uint16_t exposure_time_csec = exposure_duration_sec * 100;
+  // The main detector accepts up to 2^24 hundredths of a second, more than
+  // 16 bits hold.
+  uint32_t exposure_time_csec = std::lround(exposure_duration_sec * 100);
   uint16_t width              = right - left;
   uint16_t height             = bottom - top;
   uint16_t bin_mode           = default_config.binning_mode;
@@ -369,18 +381,15 @@ ImageData * SbigSTCamera::acquireImage(double exposure_duration_sec,
   // record the start of the exposure
   auto exposure_start = std::chrono::high_resolution_clock::now();
 
-  // Instruct the thread to sleep for most of the exposure, waking
-  // up every 100 ms to determine if the exposure should continue.
-  // If the exposure is aborted, return a 1x1 pixel image explicitly
-  // marked as aborted.
-  size_t sleep_intervals = exposure_time_csec * 10.0 / 100;
-  for(size_t i = 0; i < sleep_intervals - 1; i++) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-
-    // return a 1x1 pixel image explicitly labeled as aborted.
-    if(!do_exposure_)
-      break;
-  }
+  // Instruct the thread to sleep for most of the exposure. An abort wakes
+  // it at once, in which case a 1x1 pixel image explicitly marked as
+  // aborted is returned. A replayed trace may run on another time scale.
+  double time_scale = drv.GetTimeScale();
+  auto sleep_duration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    (std::chrono::milliseconds(exposure_time_csec * 10) -
+     std::chrono::milliseconds(100)) * time_scale);
+  if(sleep_duration.count() > 0)
+    cancellation.SleepFor(generation, sleep_duration);
 
   // For the remainder of the exposure, poll the completion status flag
   // to get an accurate end time. Note that if the driver is busy, the end
@@ -398,7 +407,12 @@ ImageData * SbigSTCamera::acquireImage(double exposure_duration_sec,
     else if (mDetectorId== 1 || mDetectorId== 2) // guide cameras
       exposure_complete = get_bit(query_r.status, 2) & get_bit(query_r.status, 3);
 
-  } while (do_exposure_ && !exposure_complete);
+    // Leave the driver free for other cameras between polls.
+    if(!exposure_complete && time_scale > 0)
+      cancellation.SleepFor(generation, std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::milliseconds(1) * time_scale));
+
+  } while (!cancellation.IsCancelled(generation) && !exposure_complete);
 
   auto exposure_end = std::chrono::high_resolution_clock::now();
 
@@ -416,13 +430,14 @@ ImageData * SbigSTCamera::acquireImage(double exposure_duration_sec,
             << " ms" << std::endl;
 
   ImageData * img = nullptr;
-  if (do_exposure_) {
+  if (!cancellation.IsCancelled(generation)) {
 
     // read the data from the detector
     std::cout << " Starting readout ..." << std::endl;
     auto readout_start = std::chrono::high_resolution_clock::now();
     img = drv.DoReadout(mSTDevice->GetHandle(), mDetectorId,
-                                   bin_mode, top, left, width, height);
+                        bin_mode, top, left, width, height,
+                        false, &cancellation, generation);
     auto readout_end = std::chrono::high_resolution_clock::now();
 
     // TODO: Temporary output for read time
@@ -441,14 +456,40 @@ ImageData * SbigSTCamera::acquireImage(double exposure_duration_sec,
     img->readout_end = readout_end;
     img->filter_name = mSTDevice->GetFilterWheel()->getActiveFilterName();
     img->detector_name = mSTDevice->GetInfo().GetDeviceName();
-    img->temperature = getTemperature(niad::TEMPERATURE_TYPE_SENSOR);
+
+    // A closed shutter gives a dark frame, or a bias frame at the shortest
+    // exposure. Otherwise the shutter was open (or left to the main camera).
+    if(shutter_state == 2)
+      img->image_type = exposure_duration_sec <= mExposureDurationMin ? "BIAS" : "DARK";
+    else
+      img->image_type = "LIGHT";
+
+    // Take the temperature at mid-exposure from the background readings
+    // rather than querying the camera after the readout.
+    TemperatureInfo temperature_info;
+    auto sampler = mSTDevice->GetTemperatureSampler();
+    if(sampler != nullptr &&
+       sampler->Interpolate(exposure_start + exposure_duration / 2, temperature_info))
+      img->temperature = mDetectorId == 0 ? temperature_info.main_camera_temperature
+                                          : temperature_info.tracking_camera_temperature;
+    else
+      img->temperature = getTemperature(niad::TEMPERATURE_TYPE_SENSOR);
   } else {
 
-    drv.DoReadout(mSTDevice->GetHandle(), mDetectorId,
-                  bin_mode, top, left, width, height, true);
+    // Clear the charge from the detector so the next exposure starts clean.
+    delete drv.DoReadout(mSTDevice->GetHandle(), mDetectorId,
+                         bin_mode, top, left, width, height, true);
+  }
 
+  // An abort during the readout leaves a partial frame, which is discarded.
+  if (cancellation.IsCancelled(generation)) {
+    delete img;
     img = new ImageData(1, 1);
     img->aborted = true;
+
+    std::cout << " Detector " << mDetectorId << " aborted, idle "
+              << cancellation.Completed(generation)
+              << " ms after the request" << std::endl;
   }
 
   // Exposure is complete. Reset the flag and return the image.
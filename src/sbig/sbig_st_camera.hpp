@@ -32,7 +32,7 @@ protected:
   bool has_electronic_shutter_ = false; ///< True if there is an electronic shutter
   bool has_physical_shutter_   = false; ///< True if there is a physical shutter.
 
-  std::atomic<bool> do_exposure_; ///< Flag to indicate if an exposure should be continued.
+  std::atomic<bool> do_exposure_; ///< Flag to indicate if an exposure is in progress.
 
 public:
   /// Default constructor.
@@ -51,7 +51,8 @@ public:
   /// Get a string describing this object.
   std::string ToString();
 
-  /// Stop an image in progress.
+  /// Stop an image in progress. This aborts all work on the device, so the
+  /// other camera's exposure and any filter wheel move stop as well.
   void  abortExposure();
 
   /// Flag to indicate if an exposure is in progress.
@@ -74,6 +75,9 @@ public:
   /// See camera.hpp
   virtual double getTemperature(niad::TemperatureType temperature_type);
 
+  /// See camera.hpp
+  virtual double getGain(niad::CameraReadoutMode readout_mode);
+
   /// See camera.hpp
   virtual ImageData *acquireImage(double duration,
           niad::CameraReadoutMode readout_mode = niad::CAMERA_READOUT_MODE_1X1,
@@ -0,0 +1,46 @@
+
+// local includes
+#include "sbig_st_cancellation.hpp"
+
+// system includes
+#include <algorithm>
+#include <thread>
+
+/// Current time on the steady clock (ns).
+static int64_t SteadyNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SbigSTCancellation::Cancel() {
+  // Only lock-free atomics here, so this may be called from a signal handler.
+  requested_ns_ = SteadyNowNs();
+  generation_++;
+}
+
+bool SbigSTCancellation::SleepFor(uint64_t generation,
+                                  std::chrono::nanoseconds duration) {
+
+  using namespace std::chrono;
+
+  auto end = steady_clock::now() + duration;
+  while(!IsCancelled(generation)) {
+    auto now = steady_clock::now();
+    if(now >= end)
+      return true;
+
+    std::this_thread::sleep_for(std::min<steady_clock::duration>(end - now, max_wait_));
+  }
+
+  return false;
+}
+
+double SbigSTCancellation::Completed(uint64_t generation) {
+
+  if(!IsCancelled(generation))
+    return 0;
+
+  int64_t latency_ns = std::max<int64_t>(SteadyNowNs() - requested_ns_, 0);
+  latency_.record(latency_ns);
+  return latency_ns * 1E-6;
+}
@@ -0,0 +1,59 @@
+#ifndef SBIG_ST_CANCELLATION_HPP
+#define SBIG_ST_CANCELLATION_HPP
+
+// project includes
+#include "latency_histogram.hpp"
+
+// system includes
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/// Cancels the blocking operations of a SBIG device.
+///
+/// An operation takes the current generation when it starts and stops as soon
+/// as the generation changes. Cancel() only stores to lock-free atomics, so
+/// it is safe in a signal handler and cannot be lost by a later operation
+/// resetting a flag. Sleeping operations poll the generation rather than
+/// being notified. The time from Cancel() to the device being idle again is
+/// recorded.
+class SbigSTCancellation {
+
+private:
+  std::atomic<uint64_t> generation_{0}; ///< Incremented by each Cancel().
+  std::atomic<int64_t> requested_ns_{0}; ///< Time of the last Cancel() (steady clock, ns).
+
+  LatencyHistogram latency_; ///< Time from Cancel() to the device being idle.
+
+  /// Longest single sleep in SleepFor() between checks of the generation.
+  /// Bounds the time an abort takes to wake a sleeping operation.
+  const std::chrono::milliseconds max_wait_{5};
+
+public:
+  /// Get the generation an operation should compare against.
+  uint64_t Generation() const { return generation_.load(); }
+
+  /// Cancel every operation started so far.
+  void Cancel();
+
+  /// Whether an operation started at a generation has been cancelled.
+  bool IsCancelled(uint64_t generation) const { return generation_.load() != generation; }
+
+  /// Sleep, waking early if the operation is cancelled.
+  /// \param generation Generation taken when the operation started.
+  /// \param duration Time to sleep.
+  /// \return False if the operation was cancelled.
+  bool SleepFor(uint64_t generation, std::chrono::nanoseconds duration);
+
+  /// Mark a cancelled operation as having left the device idle.
+  /// \param generation Generation taken when the operation started.
+  /// \return Time since the Cancel() (ms), or 0 if it was not cancelled.
+  double Completed(uint64_t generation);
+
+  /// Get the time taken by each abort to leave the device idle.
+  const LatencyHistogram & GetAbortLatency() const { return latency_; }
+
+  //
+}; // class SbigSTCancellation
+
+#endif // SBIG_ST_CANCELLATION_HPP
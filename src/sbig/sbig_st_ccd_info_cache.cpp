@@ -0,0 +1,117 @@
+
+// local includes
+#include "sbig_st_ccd_info_cache.hpp"
+
+// system includes
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+/// Identifies the cache file format. Bump if SbigSTCCDInfo changes.
+static const char CACHE_MAGIC[8] = {'S', 'B', 'I', 'G', 'C', 'C', 'D', '2'};
+
+/// Whether two answers to request 0 describe the same camera and firmware.
+/// Only the fields the driver fills are compared: the struct has padding,
+/// and readout modes past readoutModes are not guaranteed to be written.
+static bool SameImagingInfo(const GetCCDInfoResults0 & a, const GetCCDInfoResults0 & b) {
+
+  if(a.firmwareVersion != b.firmwareVersion || a.cameraType != b.cameraType ||
+     strncmp(a.name, b.name, sizeof(a.name)) != 0 || a.readoutModes != b.readoutModes)
+    return false;
+
+  size_t modes = std::min<size_t>(a.readoutModes, sizeof(a.readoutInfo) / sizeof(a.readoutInfo[0]));
+  for(size_t i = 0; i < modes; i++) {
+    const READOUT_INFO & ra = a.readoutInfo[i];
+    const READOUT_INFO & rb = b.readoutInfo[i];
+    if(ra.mode != rb.mode || ra.width != rb.width || ra.height != rb.height ||
+       ra.gain != rb.gain || ra.pixelWidth != rb.pixelWidth || ra.pixelHeight != rb.pixelHeight)
+      return false;
+  }
+
+  return true;
+}
+
+void SbigSTCCDInfoCache::SetDirectory(const std::string & directory) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  directory_ = directory;
+}
+
+bool SbigSTCCDInfoCache::IsEnabled() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return !directory_.empty();
+}
+
+std::string SbigSTCCDInfoCache::FileName(const std::string & serial_number) {
+
+  // Serial numbers come from the camera; keep only characters that are safe
+  // in a file name.
+  std::string name;
+  for(char c: serial_number)
+    name += isalnum(static_cast<unsigned char>(c)) ? c : '_';
+
+  return directory_ + "/" + name + ".ccdinfo";
+}
+
+bool SbigSTCCDInfoCache::Load(const std::string & serial_number,
+                              const GetCCDInfoResults0 & imaging_info0,
+                              SbigSTCCDInfo & info) {
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(directory_.empty() || serial_number.empty())
+    return false;
+
+  std::ifstream file(FileName(serial_number), std::ios::binary);
+  if(!file)
+    return false;
+
+  char magic[sizeof(CACHE_MAGIC)] = {};
+  uint32_t size = 0;
+  SbigSTCCDInfo cached;
+  file.read(magic, sizeof(magic));
+  file.read(reinterpret_cast<char *>(&size), sizeof(size));
+  file.read(reinterpret_cast<char *>(&cached), sizeof(cached));
+  if(!file || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 || size != sizeof(cached))
+    return false;
+
+  // A firmware update or a different camera reusing the serial number
+  // invalidates the entry.
+  if(!SameImagingInfo(cached.imaging_info0, imaging_info0)) {
+    std::cout << "CCD info cache for " << serial_number
+              << " is stale; querying the camera." << std::endl;
+    return false;
+  }
+
+  info = cached;
+  return true;
+}
+
+void SbigSTCCDInfoCache::Store(const std::string & serial_number,
+                               const SbigSTCCDInfo & info) {
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(directory_.empty() || serial_number.empty())
+    return;
+
+  // Write a temporary file and rename it so that a reader never sees a
+  // partial entry.
+  std::string filename = FileName(serial_number);
+  std::string tmp_filename = filename + ".tmp";
+  {
+    std::ofstream file(tmp_filename, std::ios::binary | std::ios::trunc);
+    uint32_t size = sizeof(info);
+    file.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    file.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    file.write(reinterpret_cast<const char *>(&info), sizeof(info));
+    if(!file) {
+      std::cout << "Could not write CCD info cache " << tmp_filename << std::endl;
+      return;
+    }
+  }
+
+  if(std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+    std::cout << "Could not write CCD info cache " << filename << std::endl;
+}
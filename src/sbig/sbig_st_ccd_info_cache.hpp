@@ -0,0 +1,59 @@
+#ifndef SBIG_ST_CCD_INFO_CACHE_HPP
+#define SBIG_ST_CCD_INFO_CACHE_HPP
+
+// system includes
+#include <mutex>
+#include <sbigudrv.h>
+#include <string>
+
+/// Static CCD information read from a device when it is opened.
+struct SbigSTCCDInfo {
+  GetCCDInfoResults0 imaging_info0;  ///< Request 0: imaging detector.
+  GetCCDInfoResults4 imaging_info4;  ///< Request 4: imaging detector, extended.
+  GetCCDInfoResults0 tracking_info0; ///< Request 1: tracking detector.
+  GetCCDInfoResults4 tracking_info4; ///< Request 5: tracking detector, extended.
+}; // struct SbigSTCCDInfo
+
+/// On-disk cache of SbigSTCCDInfo, one file per camera serial number.
+///
+/// The readout mode tables, pixel sizes and firmware version of a camera only
+/// change with its firmware. An entry is used only if request 0, which holds
+/// the firmware version, still matches the cached copy (camera type, name,
+/// firmware and readout modes), so a single query validates the remaining
+/// three.
+class SbigSTCCDInfoCache {
+
+private:
+  std::string directory_; ///< Directory holding the cache. Empty disables it.
+  std::mutex mutex_; ///< Serializes file access between devices.
+
+public:
+  /// Set the directory holding the cache. It must exist.
+  /// \param directory The directory. Empty disables the cache.
+  void SetDirectory(const std::string & directory);
+
+  /// Whether a cache directory is set.
+  bool IsEnabled();
+
+  /// Load the cached information for a camera.
+  /// \param serial_number Serial number of the camera.
+  /// \param imaging_info0 Result of request 0, freshly read from the camera.
+  /// \param info Filled with the cached information if found.
+  /// \return True if an entry was found and matches imaging_info0.
+  bool Load(const std::string & serial_number,
+            const GetCCDInfoResults0 & imaging_info0,
+            SbigSTCCDInfo & info);
+
+  /// Store the information for a camera. Failures are reported, not thrown.
+  /// \param serial_number Serial number of the camera.
+  /// \param info The information read from the camera.
+  void Store(const std::string & serial_number, const SbigSTCCDInfo & info);
+
+private:
+  /// Name of the cache file for a camera.
+  std::string FileName(const std::string & serial_number);
+
+  //
+}; // class SbigSTCCDInfoCache
+
+#endif // SBIG_ST_CCD_INFO_CACHE_HPP
@@ -0,0 +1,235 @@
+
+// local includes
+#include "sbig_st_command_executor.hpp"
+#include "sbig_st_errors.hpp"
+
+// system includes
+#include <sbigudrv.h>
+#include <sstream>
+
+SbigSTCommandExecutor::SbigSTCommandExecutor(std::unique_ptr<SbigSTBackend> backend)
+  : backend_(std::move(backend)) {
+  if(backend_ == nullptr)
+    backend_.reset(new SbigSTDirectBackend());
+  thread_ = std::thread(&SbigSTCommandExecutor::Run, this);
+}
+
+SbigSTCommandExecutor::~SbigSTCommandExecutor() {
+  Stop();
+
+  // Flush any trace before the driver is unloaded.
+  backend_.reset();
+}
+
+std::future<void> SbigSTCommandExecutor::Submit(short command, void *params,
+                                                void *results, short handle,
+                                                bool urgent) {
+  Request request;
+  request.task = [this, command, params, results](short & active_handle) {
+    short status = Call(command, params, results);
+    SBIG_CHECK_STATUS(status);
+  };
+  request.command = command;
+  request.handle = handle;
+  request.urgent = urgent;
+
+  return Enqueue(std::move(request));
+}
+
+std::future<void> SbigSTCommandExecutor::SubmitTask(Task task, short handle,
+                                                    bool urgent) {
+  Request request;
+  request.task = std::move(task);
+  request.handle = handle;
+  request.urgent = urgent;
+
+  return Enqueue(std::move(request));
+}
+
+std::future<void> SbigSTCommandExecutor::Enqueue(Request request) {
+
+  request.submitted = std::chrono::steady_clock::now();
+  std::future<void> result = request.promise.get_future();
+
+  // Work issued from the driver thread itself (e.g. by a task) runs inline;
+  // queueing it would deadlock.
+  if(std::this_thread::get_id() == thread_.get_id()) {
+    Execute(request);
+    return result;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if(stop_) {
+      request.promise.set_exception(std::make_exception_ptr(
+        std::runtime_error("SBIG command executor is stopped")));
+      return result;
+    }
+
+    if(request.urgent) {
+      urgent_queue_.push_back(std::move(request));
+    } else {
+      short handle = request.handle;
+      device_queues_[handle].push_back(std::move(request));
+      pending_++;
+    }
+  }
+  queue_cv_.notify_one();
+
+  return result;
+}
+
+void SbigSTCommandExecutor::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    stop_ = true;
+  }
+  queue_cv_.notify_one();
+
+  if(thread_.joinable())
+    thread_.join();
+}
+
+void SbigSTCommandExecutor::Run() {
+
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  Request request;
+  while(NextRequest(lock, request)) {
+    lock.unlock();
+    Execute(request);
+    lock.lock();
+  }
+}
+
+bool SbigSTCommandExecutor::NextRequest(std::unique_lock<std::mutex> & lock,
+                                        Request & request) {
+
+  queue_cv_.wait(lock, [this] {
+    return stop_ || !urgent_queue_.empty() || pending_ > 0;
+  });
+
+  if(urgent_queue_.empty() && pending_ == 0)
+    return false; // stopped and drained
+
+  auto active_has_work = [this] {
+    auto it = device_queues_.find(active_handle_);
+    return it != device_queues_.end() && !it->second.empty();
+  };
+
+  // Callers are synchronous, so the active device's next command usually
+  // arrives a moment after its last one finished. Wait for it briefly
+  // rather than switching to another device and straight back again.
+  if(urgent_queue_.empty() && !active_has_work() && !stop_ &&
+     active_handle_ != NO_HANDLE && batch_count_ > 0 && batch_count_ < max_batch_) {
+    queue_cv_.wait_for(lock, linger_, [this, &active_has_work] {
+      return stop_ || !urgent_queue_.empty() || active_has_work();
+    });
+  }
+
+  if(!urgent_queue_.empty()) {
+    request = std::move(urgent_queue_.front());
+    urgent_queue_.pop_front();
+  } else {
+    // Keep serving the active device until its batch is used up, then take
+    // the queue whose oldest request has waited the longest.
+    auto selected = device_queues_.find(active_handle_);
+    if(selected == device_queues_.end() || selected->second.empty() ||
+       batch_count_ >= max_batch_) {
+      selected = device_queues_.end();
+      for(auto it = device_queues_.begin(); it != device_queues_.end(); ++it) {
+        if(it->second.empty())
+          continue;
+        if(selected == device_queues_.end() ||
+           it->second.front().submitted < selected->second.front().submitted)
+          selected = it;
+      }
+    }
+
+    request = std::move(selected->second.front());
+    selected->second.pop_front();
+    pending_--;
+  }
+
+  if(request.handle == NO_HANDLE || request.handle == active_handle_)
+    batch_count_++;
+  else
+    batch_count_ = 1;
+
+  return true;
+}
+
+void SbigSTCommandExecutor::Execute(Request & request) {
+
+  using namespace std::chrono;
+
+  auto start = steady_clock::now();
+  uint64_t wait_ns = duration_cast<nanoseconds>(start - request.submitted).count();
+  wait_sum_ns_ += wait_ns;
+  uint64_t max_ns = wait_max_ns_;
+  while(wait_ns > max_ns && !wait_max_ns_.compare_exchange_weak(max_ns, wait_ns)) {}
+  wait_.record(wait_ns);
+  commands_++;
+  if(request.urgent)
+    urgent_commands_++;
+
+  try {
+    // Switching device handles is an exceptionally expensive operation for
+    // the SBIG driver. Do so only if necessary.
+    if(request.handle != NO_HANDLE && request.handle != active_handle_) {
+      SetDriverHandleParams handle_p;
+      handle_p.handle = request.handle;
+      short status = Call(CC_SET_DRIVER_HANDLE, &handle_p, nullptr);
+      auto switched = steady_clock::now();
+      latency_.Record(CC_SET_DRIVER_HANDLE, request.handle, 0,
+                      duration_cast<nanoseconds>(switched - start).count());
+      start = switched;
+      SBIG_CHECK_STATUS(status);
+      active_handle_ = request.handle;
+      handle_switches_++;
+    }
+
+    // The wait is charged to the command even if it fails.
+    try {
+      request.task(active_handle_);
+    } catch(...) {
+      latency_.Record(request.command, request.handle, wait_ns,
+                      duration_cast<nanoseconds>(steady_clock::now() - start).count());
+      throw;
+    }
+    latency_.Record(request.command, request.handle, wait_ns,
+                    duration_cast<nanoseconds>(steady_clock::now() - start).count());
+    request.promise.set_value();
+  } catch(...) {
+    request.promise.set_exception(std::current_exception());
+  }
+}
+
+size_t SbigSTCommandExecutor::GetQueueDepth() {
+  std::lock_guard<std::mutex> lock(queue_mutex_);
+  return urgent_queue_.size() + pending_;
+}
+
+SbigSTExecutorStats SbigSTCommandExecutor::GetStats() {
+  SbigSTExecutorStats stats;
+  stats.commands = commands_;
+  stats.urgent_commands = urgent_commands_;
+  stats.handle_switches = handle_switches_;
+  if(stats.commands > 0)
+    stats.mean_wait_ms = wait_sum_ns_ * 1E-6 / stats.commands;
+  stats.max_wait_ms = wait_max_ns_ * 1E-6;
+  return stats;
+}
+
+std::string SbigSTCommandExecutor::StatsToString() {
+
+  auto stats = GetStats();
+
+  std::stringstream ss;
+  ss << "Driver commands: " << stats.commands
+     << " (" << stats.urgent_commands << " urgent), "
+     << "handle switches: " << stats.handle_switches << ", "
+     << "queue wait mean " << stats.mean_wait_ms << " ms, "
+     << "max " << stats.max_wait_ms << " ms";
+
+  return ss.str();
+}
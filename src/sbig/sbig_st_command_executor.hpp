@@ -0,0 +1,152 @@
+#ifndef SBIG_ST_COMMAND_EXECUTOR_HPP
+#define SBIG_ST_COMMAND_EXECUTOR_HPP
+
+// local includes
+#include "sbig_st_command_latency.hpp"
+#include "sbig_st_trace.hpp"
+
+// system includes
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/// Counters describing the work done by a SbigSTCommandExecutor.
+struct SbigSTExecutorStats {
+  uint64_t commands        = 0; ///< Number of requests executed.
+  uint64_t urgent_commands = 0; ///< Number of requests that jumped the queue.
+  uint64_t handle_switches = 0; ///< Number of CC_SET_DRIVER_HANDLE calls issued.
+  double mean_wait_ms      = 0; ///< Mean time a request waited in the queue (ms).
+  double max_wait_ms       = 0; ///< Longest time a request waited in the queue (ms).
+}; // struct SbigSTExecutorStats
+
+/// Runs every call to the SBIG universal driver on one dedicated thread.
+///
+/// Requests are queued per device handle. The executor keeps serving the
+/// active handle while it has work (up to a batch limit) so that the expensive
+/// CC_SET_DRIVER_HANDLE switch is issued as rarely as possible. Urgent
+/// requests (readout lines, aborts) are served before anything else.
+class SbigSTCommandExecutor {
+
+public:
+  /// Handle used for requests that do not address a device.
+  static const short NO_HANDLE = -1;
+
+  /// Work run on the driver thread. The argument is the handle currently
+  /// selected in the driver; a task that selects a different handle must
+  /// update it.
+  typedef std::function<void(short & active_handle)> Task;
+
+private:
+  /// A queued unit of work.
+  struct Request {
+    Task task;
+    short command = -1; ///< SBIG command code, -1 for other work.
+    short handle = NO_HANDLE;
+    bool urgent  = false;
+    std::chrono::steady_clock::time_point submitted;
+    std::promise<void> promise;
+  };
+
+  std::unique_ptr<SbigSTBackend> backend_; ///< Runs the driver calls.
+  std::thread thread_; ///< The driver thread.
+  std::mutex queue_mutex_; ///< Protects the queues and stop_.
+  std::condition_variable queue_cv_; ///< Signalled when work arrives.
+  std::deque<Request> urgent_queue_; ///< Requests served before all others.
+  std::map<short, std::deque<Request>> device_queues_; ///< Requests by handle.
+  size_t pending_ = 0; ///< Requests waiting in device_queues_.
+  bool stop_      = false; ///< Set when the executor should drain and exit.
+
+  // Owned by the driver thread.
+  short active_handle_ = NO_HANDLE; ///< Handle currently selected in the driver.
+  size_t batch_count_  = 0; ///< Requests served for the active handle in a row.
+
+  /// Requests served for one handle before others get a turn.
+  const size_t max_batch_ = 64;
+  /// Time to wait for the active handle's next request before switching.
+  const std::chrono::microseconds linger_{500};
+
+  std::atomic<uint64_t> commands_{0};
+  std::atomic<uint64_t> urgent_commands_{0};
+  std::atomic<uint64_t> handle_switches_{0};
+  std::atomic<uint64_t> wait_sum_ns_{0};
+  std::atomic<uint64_t> wait_max_ns_{0};
+  LatencyHistogram wait_; ///< Queue wait of every request (ns).
+
+  /// Queue wait and driver call time for each command and handle.
+  SbigSTCommandLatency latency_;
+
+public:
+  /// Default constructor. Starts the driver thread.
+  /// \param backend Backend that runs driver calls. Defaults to the real driver.
+  SbigSTCommandExecutor(std::unique_ptr<SbigSTBackend> backend = nullptr);
+  /// Default destructor. Stops the driver thread.
+  ~SbigSTCommandExecutor();
+
+  /// Queue a SBIG command.
+  /// \param sbig_command The SBIG command to run.
+  /// \param params Command parameters. Must remain valid until the future is ready.
+  /// \param results Command results. Must remain valid until the future is ready.
+  /// \param handle Device handle to select first, or NO_HANDLE.
+  /// \param urgent Serve this command before all non-urgent requests.
+  /// \return A future which rethrows any driver error.
+  std::future<void> Submit(short sbig_command, void *params, void *results,
+                           short handle = NO_HANDLE, bool urgent = false);
+
+  /// Queue arbitrary work on the driver thread.
+  /// \param task The work to run.
+  /// \param handle Device handle to select first, or NO_HANDLE.
+  /// \param urgent Serve this task before all non-urgent requests.
+  /// \return A future which rethrows any exception thrown by the task.
+  std::future<void> SubmitTask(Task task, short handle = NO_HANDLE,
+                               bool urgent = false);
+
+  /// Issue a driver call immediately. Only for tasks on the driver thread.
+  /// \return The driver's status code.
+  short Call(short sbig_command, void *params, void *results) {
+    return backend_->Command(sbig_command, params, results);
+  }
+
+  /// Finish all queued work and stop the driver thread.
+  void Stop();
+
+  /// Get the counters collected so far.
+  SbigSTExecutorStats GetStats();
+
+  /// Produces a string describing the counters.
+  std::string StatsToString();
+
+  /// Get the number of requests waiting for the driver thread.
+  size_t GetQueueDepth();
+
+  /// Get the backend's multiplier for time spent waiting on the camera.
+  double GetTimeScale() const { return backend_->TimeScale(); }
+
+  /// Get the queue wait of every request run so far.
+  const LatencyHistogram & GetWait() const { return wait_; }
+
+  /// Get the latency histograms of every command run so far.
+  const SbigSTCommandLatency & GetLatency() const { return latency_; }
+
+private:
+  /// Queue a request.
+  std::future<void> Enqueue(Request request);
+  /// Main loop of the driver thread.
+  void Run();
+  /// Remove the next request to serve. Waits for work; returns false on stop.
+  bool NextRequest(std::unique_lock<std::mutex> & lock, Request & request);
+  /// Run one request on the driver thread.
+  void Execute(Request & request);
+
+  //
+}; // class SbigSTCommandExecutor
+
+#endif // SBIG_ST_COMMAND_EXECUTOR_HPP
@@ -0,0 +1,113 @@
+
+// local includes
+#include "sbig_st_command_latency.hpp"
+#include "sbig_st_errors.hpp"
+
+// system includes
+#include <iomanip>
+#include <sstream>
+
+SbigSTCommandLatency::SbigSTCommandLatency() {
+  handles_[0] = -1;
+  for(int i = 1; i <= MAX_HANDLES; i++)
+    handles_[i] = EMPTY_SLOT;
+
+  for(int c = 0; c < MAX_COMMANDS; c++)
+    for(int h = 0; h <= MAX_HANDLES; h++)
+      timings_[c][h] = nullptr;
+}
+
+SbigSTCommandLatency::~SbigSTCommandLatency() {
+  for(int c = 0; c < MAX_COMMANDS; c++)
+    for(int h = 0; h <= MAX_HANDLES; h++)
+      delete timings_[c][h].load();
+}
+
+int SbigSTCommandLatency::HandleSlot(short handle) {
+
+  if(handle < 0)
+    return 0;
+
+  for(int i = 1; i <= MAX_HANDLES; i++) {
+    short slot_handle = handles_[i].load(std::memory_order_acquire);
+    if(slot_handle == handle)
+      return i;
+
+    // Claim the first free slot. Another thread may claim it first, in
+    // which case check whether it did so for the same handle.
+    if(slot_handle == EMPTY_SLOT) {
+      if(handles_[i].compare_exchange_strong(slot_handle, handle) ||
+         slot_handle == handle)
+        return i;
+    }
+  }
+
+  return MAX_HANDLES;
+}
+
+void SbigSTCommandLatency::Record(short command, short handle,
+                                  uint64_t wait_ns, uint64_t call_ns) {
+
+  if(command < 0 || command >= MAX_COMMANDS)
+    return;
+
+  int slot = HandleSlot(handle);
+  auto & entry = timings_[command][slot];
+  SbigSTCommandTiming * timing = entry.load(std::memory_order_acquire);
+  if(timing == nullptr) {
+    auto created = new SbigSTCommandTiming();
+    created->command = command;
+    created->handle = handles_[slot].load();
+    if(entry.compare_exchange_strong(timing, created)) {
+      timing = created;
+    } else {
+      delete created; // another thread won; timing now holds its entry
+    }
+  }
+
+  timing->wait.record(wait_ns);
+  timing->call.record(call_ns);
+}
+
+std::vector<const SbigSTCommandTiming *> SbigSTCommandLatency::GetTimings() const {
+
+  std::vector<const SbigSTCommandTiming *> output;
+  for(int c = 0; c < MAX_COMMANDS; c++) {
+    for(int h = 0; h <= MAX_HANDLES; h++) {
+      auto timing = timings_[c][h].load(std::memory_order_acquire);
+      if(timing != nullptr)
+        output.push_back(timing);
+    }
+  }
+
+  return output;
+}
+
+std::string SbigSTCommandLatency::ToString() const {
+
+  auto ms = [](double ns) { return ns * 1E-6; };
+
+  std::stringstream ss;
+  ss << std::left << std::setw(32) << "Command"
+     << std::right << std::setw(7) << "Handle"
+     << std::setw(9) << "Count"
+     << "  Wait mean/p99/max (ms)"
+     << "      Call mean/p50/p99/max (ms)\n";
+
+  ss << std::fixed << std::setprecision(3);
+  for(auto timing: GetTimings()) {
+    ss << std::left << std::setw(32) << SBIGCommandToName(timing->command)
+       << std::right << std::setw(7) << timing->handle
+       << std::setw(9) << timing->call.getCount()
+       << std::setw(10) << ms(timing->wait.getMean())
+       << std::setw(9) << ms(timing->wait.getPercentile(99))
+       << std::setw(9) << ms(timing->wait.getMax())
+       << std::setw(10) << ms(timing->call.getMean())
+       << std::setw(9) << ms(timing->call.getPercentile(50))
+       << std::setw(9) << ms(timing->call.getPercentile(99))
+       << std::setw(9) << ms(timing->call.getMax())
+       << "\n";
+  }
+
+  return ss.str();
+}
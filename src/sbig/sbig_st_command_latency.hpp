@@ -0,0 +1,67 @@
+#ifndef SBIG_ST_COMMAND_LATENCY_HPP
+#define SBIG_ST_COMMAND_LATENCY_HPP
+
+// project includes
+#include "latency_histogram.hpp"
+
+// system includes
+#include <atomic>
+#include <climits>
+#include <string>
+#include <vector>
+
+/// Latency of one SBIG command sent to one device.
+struct SbigSTCommandTiming {
+  short command = 0; ///< SBIG command code.
+  short handle  = -1; ///< Device handle, -1 for commands without one.
+  LatencyHistogram wait; ///< Time spent queued for the driver (ns).
+  LatencyHistogram call; ///< Time spent inside SBIGUnivDrvCommand (ns).
+}; // struct SbigSTCommandTiming
+
+/// Latency histograms for every SBIG command, by command code and handle.
+///
+/// Entries are created on first use with compare-and-swap, so recording never
+/// takes a lock and the tables may be read at any time.
+class SbigSTCommandLatency {
+
+public:
+  static const int MAX_COMMANDS = 128; ///< Command codes tracked (0 .. MAX_COMMANDS-1).
+  static const int MAX_HANDLES  = 8; ///< Distinct device handles tracked.
+
+private:
+  static const short EMPTY_SLOT = SHRT_MIN; ///< Marks an unclaimed handle slot.
+
+  /// Handle held by each slot. Slot 0 is reserved for commands without one.
+  std::atomic<short> handles_[MAX_HANDLES + 1];
+  /// Timing entries by command code and handle slot.
+  std::atomic<SbigSTCommandTiming *> timings_[MAX_COMMANDS][MAX_HANDLES + 1];
+
+public:
+  /// Default constructor.
+  SbigSTCommandLatency();
+  /// Default destructor.
+  ~SbigSTCommandLatency();
+
+  /// Record one command.
+  /// \param command SBIG command code.
+  /// \param handle Device handle, or -1.
+  /// \param wait_ns Time the command waited for the driver (ns).
+  /// \param call_ns Time the driver took to run the command (ns).
+  void Record(short command, short handle, uint64_t wait_ns, uint64_t call_ns);
+
+  /// Get every command that has been recorded.
+  /// \return Pointers that remain valid for the lifetime of this object.
+  std::vector<const SbigSTCommandTiming *> GetTimings() const;
+
+  /// Produces a table of the latencies.
+  std::string ToString() const;
+
+private:
+  /// Find or claim the slot for a handle. Unknown handles share the last slot
+  /// once every slot has been claimed.
+  int HandleSlot(short handle);
+
+  //
+}; // class SbigSTCommandLatency
+
+#endif // SBIG_ST_COMMAND_LATENCY_HPP
@@ -14,6 +14,14 @@ SbigSTDevice::SbigSTDevice(SbigSTDeviceInfo info, short handle)
 }
 
 SbigSTDevice::~SbigSTDevice() {
+
+  StopTemperatureSampler();
+
+  auto & latency = cancellation_.GetAbortLatency();
+  if(latency.getCount() > 0)
+    std::cout << info_.GetDeviceName() << " aborts: " << latency.getCount()
+              << ", idle after mean " << latency.getMean() * 1E-6
+              << " ms, max " << latency.getMax() * 1E-6 << " ms" << std::endl;
 }
 
 std::string SbigSTDevice::ToString() {
@@ -38,41 +46,55 @@ void SbigSTDevice::InitializeSTSeries() {
 
   // Get access to the SBIG driver
   SbigSTDriver &drv = SbigSTDriver::GetInstance();
-
-  GetCCDInfoParams info_p;
+  auto &cache = drv.GetCCDInfoCache();
+
+  // Query 0 holds the firmware version, so it is always issued and
+  // validates any cached copy of the other queries.
+  // Zeroed so that padding and unused entries are written to the cache
+  // file consistently.
+  SbigSTCCDInfo ccd_info{};
+  GetCCDInfoParams info_p0;
+  info_p0.request = 0; // Query 0 = Standard request for imaging detector
+  drv.RunCommand(CC_GET_CCD_INFO, &info_p0, &ccd_info.imaging_info0, device_handle_);
+
+  std::string serial_number = info_.GetSerialNumber();
+  if(cache.Load(serial_number, ccd_info.imaging_info0, ccd_info)) {
+    std::cout << "Using cached CCD info for " << serial_number << std::endl;
+  } else {
+    // Queue the remaining queries together rather than one round trip each.
+    GetCCDInfoParams info_p4;
+    info_p4.request = 4; // Query 4 = secondary extended request for imaging CCD
+    GetCCDInfoParams info_p1;
+    info_p1.request = 1; // Query 1 = Standard request for tracking detector
+    GetCCDInfoParams info_p5;
+    info_p5.request = 5; // Query 5 = secondary extended request for tracking CCD
+    auto imaging_query4 = drv.SubmitCommand(CC_GET_CCD_INFO, &info_p4,
+                                            &ccd_info.imaging_info4, device_handle_);
+    auto tracking_query0 = drv.SubmitCommand(CC_GET_CCD_INFO, &info_p1,
+                                             &ccd_info.tracking_info0, device_handle_);
+    auto tracking_query4 = drv.SubmitCommand(CC_GET_CCD_INFO, &info_p5,
+                                             &ccd_info.tracking_info4, device_handle_);
+    imaging_query4.get();
+    tracking_query0.get();
+    tracking_query4.get();
+
+    cache.Store(serial_number, ccd_info);
+  }
 
   //
   // Setup primary imaging detector
   //
-  // Query for basic detector information.
-  info_p.request = 0; // Query 0 = Standard request for imaging detector
-  GetCCDInfoResults0 imaging_info_r0;
-  drv.RunCommand(CC_GET_CCD_INFO, &info_p, &imaging_info_r0, device_handle_);
-  // Query for advanced detector information.
-  info_p.request = 4; // Query 4 = secondary extended request for imaging CCD
-  GetCCDInfoResults4 imaging_info_r4;
-  drv.RunCommand(CC_GET_CCD_INFO, &info_p, &imaging_info_r4, device_handle_);
-  // Initialize the main camera with relevant data.
   main_camera_ = std::make_shared<SbigSTCamera>(this, device_handle_, 0,
-                                                imaging_info_r0,
-                                                imaging_info_r4);
+                                                ccd_info.imaging_info0,
+                                                ccd_info.imaging_info4);
 
   //
   // Setup tracking detector
   //
-  // Query for basic detector information
-  info_p.request = 1; // Query 1 = Standard request for tracking detector
-  GetCCDInfoResults0 tracking_info_r0;
-  drv.RunCommand(CC_GET_CCD_INFO, &info_p, &tracking_info_r0, device_handle_);
-  // Query for advanced detector information
-  info_p.request = 5;
-  GetCCDInfoResults4 tracking_info_r4;
-  drv.RunCommand(CC_GET_CCD_INFO, &info_p, &tracking_info_r4, device_handle_);
-  // configure the guide camera
-  if (imaging_info_r0.firmwareVersion > 0) {
+  if (ccd_info.imaging_info0.firmwareVersion > 0) {
     guide_camera_ = std::make_shared<SbigSTCamera>(this, device_handle_, 1,
-                                                   tracking_info_r0,
-                                                   tracking_info_r4);
+                                                   ccd_info.tracking_info0,
+                                                   ccd_info.tracking_info4);
   }
 
   //
@@ -125,15 +147,25 @@ TemperatureInfo SbigSTDevice::GetTemperatureInfo() {
   ti.main_camera_temperature_setpoint     = temp_r.ccdSetpoint;
   ti.main_camera_temperature              = temp_r.imagingCCDTemperature;
   ti.tracking_camera_temperature_setpoint = temp_r.trackingCCDSetpoint;
-  ti.tracking_camera_temperature          = temp_r.trackingCCDSetpoint;
+  ti.tracking_camera_temperature          = temp_r.trackingCCDTemperature;
   ti.ambient_temperature                  = temp_r.ambientTemperature;
   ti.heatsink_temperature                 = temp_r.heatsinkTemperature;
   ti.fan_percent_power                    = temp_r.fanPower;
   ti.fan_speed                            = temp_r.fanSpeed;
+  ti.cooler_percent_power                 = temp_r.imagingCCDPower;
 
   return ti;
 }
 
+void SbigSTDevice::StartTemperatureSampler(double period_sec) {
+  StopTemperatureSampler();
+  temperature_sampler_.reset(new SbigSTTemperatureSampler(this, period_sec));
+}
+
+void SbigSTDevice::StopTemperatureSampler() {
+  temperature_sampler_.reset();
+}
+
 bool SbigSTDevice::ImageInProgress() {
   bool image_in_progress = false;
   image_in_progress |= main_camera_->ImageInProgress();
@@ -2,39 +2,15 @@
 #define SBIG_DEVICE_H
 
 #include "sbig_st_camera.hpp"
+#include "sbig_st_cancellation.hpp"
 #include "sbig_st_filter_wheel.hpp"
 #include "sbig_st_device_info.hpp"
+#include "sbig_st_temperature_sampler.hpp"
 
 #include <sbigudrv.h>
 #include <string>
 #include <memory>
 
-/// Structure to store temperature information from the camera.
-struct TemperatureInfo {
-  /// True if the fan is on.
-  bool   fan_on                               = false;
-  /// True if temperature regulation is active.
-  bool   temperature_regulation_on            = false;
-  /// Temperature set point for the main camera (Celsius)
-  double main_camera_temperature_setpoint     = 0.0;
-  /// Temperature of the main camera (Celsius)
-  double main_camera_temperature              = 0.0;
-  /// Temperature set point for the tracking camera (Celsius)
-  double tracking_camera_temperature_setpoint = 0.0;
-  /// Temperature of the tracking camera (Celsius)
-  double tracking_camera_temperature          = 0.0;
-  /// Ambient temperature (Celsius)
-  double ambient_temperature                  = 0.0;
-  /// Heatsink temperature (Celsiu)
-  double heatsink_temperature                 = 0.0;
-  /// Percent power for the fan (%)
-  double fan_percent_power                    = 0.0;
-  /// Fan seep (RPM)
-  double fan_speed                            = 0.0;
-
-
-}; // struct TemperatureInfo
-
 /// Class representing a SBIG ST device.
 class SbigSTDevice {
 
@@ -55,6 +31,12 @@ private:
   /// Shared pointer to the filter wheel (if any)
   std::shared_ptr<SbigSTFilterWheel> filter_wheel_ = nullptr;
 
+  /// Cancels exposures, readouts and filter moves on this device.
+  SbigSTCancellation cancellation_;
+
+  /// Background temperature readings (if started).
+  std::unique_ptr<SbigSTTemperatureSampler> temperature_sampler_;
+
 public:
   /// Initialize this device.
   void InitializeDevice();
@@ -116,12 +98,34 @@ public:
   /// Get information about the camera's temperature.
   TemperatureInfo GetTemperatureInfo();
 
+  /// Start reading the temperature in the background. Frames then take their
+  /// temperature from these readings instead of querying the camera.
+  /// \param period_sec Time between readings (seconds).
+  void StartTemperatureSampler(double period_sec);
+
+  /// Stop the background temperature readings. Must not be called from the
+  /// driver thread.
+  void StopTemperatureSampler();
+
+  /// Get the background temperature readings.
+  /// \return The sampler, or nullptr if it was not started.
+  const SbigSTTemperatureSampler * GetTemperatureSampler() { return temperature_sampler_.get(); }
+
   /// Activate temperature regulation.
   bool TemperatureRegulationOn();
 
   /// Determine if an image is in progress.
   bool ImageInProgress();
 
+  /// Abort every exposure, readout and filter wheel move in progress on this
+  /// device. Each returns as soon as the device is back in a clean state.
+  /// Safe to call from any thread or a signal handler; sleeping operations
+  /// notice within a few milliseconds.
+  void Abort() { cancellation_.Cancel(); }
+
+  /// Get the cancellation shared by this device's cameras and filter wheel.
+  SbigSTCancellation & GetCancellation() { return cancellation_; }
+
   //
 }; // SbigSTDevice
 
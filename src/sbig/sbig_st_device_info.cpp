@@ -67,6 +67,9 @@ ushort SbigSTDeviceInfo::GetLPTAddress() const {
 std::string SbigSTDeviceInfo::GetDeviceName() const {
   return device_name_;
 }
+std::string SbigSTDeviceInfo::GetSerialNumber() const {
+  return serial_number_;
+}
 bool SbigSTDeviceInfo::IsValidDevice() {
   if(device_type_ != DEV_NONE)
     return true;
@@ -79,6 +79,9 @@ public:
   /// Get this device's name.
   std::string GetDeviceName() const;
 
+  /// Get this device's serial number.
+  std::string GetSerialNumber() const;
+
   /// Returns true if this device is valid and properly initialized.
   bool IsValidDevice();
 
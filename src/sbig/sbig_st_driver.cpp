@@ -14,7 +14,8 @@
 #include <thread>
 
 SbigSTDriver::SbigSTDriver()
-  : do_readout_(false) {
+  : executor_(std::move(PendingBackend())),
+    do_readout_(false) {
   Open();
 }
 
@@ -48,47 +49,99 @@ std::vector<std::string> SbigSTDriver::GetSupportedFilterWheels() {
   return SbigSTFilterWheel::GetSupportedFilterWheels();
 };
 
-void SbigSTDriver::RunCommand(short command, void *params, void *results) {
+std::unique_ptr<SbigSTBackend> & SbigSTDriver::PendingBackend() {
+  static std::unique_ptr<SbigSTBackend> backend;
+  return backend;
+}
+
+void SbigSTDriver::SetBackend(std::unique_ptr<SbigSTBackend> backend) {
+  PendingBackend() = std::move(backend);
+}
+
+bool SbigSTDriver::IsUrgent(short command) {
+  // Readout lines are timing critical and aborts should take effect at once.
+  switch(command) {
+  case CC_READOUT_LINE:
+  case CC_DUMP_LINES:
+  case CC_END_READOUT:
+  case CC_END_EXPOSURE:
+    return true;
+  default:
+    return false;
+  }
+}
 
-  // get exclusive control of the driver, then issue the command.
-  const std::lock_guard<std::mutex> lock(driver_access_mutex_);
-  SBIG_CHECK_STATUS(SBIGUnivDrvCommand(command, params, results));
+void SbigSTDriver::RunCommand(short command, void *params, void *results) {
+  executor_.Submit(command, params, results).get();
 }
 
 void SbigSTDriver::RunCommand(short command, void *params, void *results, short handle) {
+  SubmitCommand(command, params, results, handle).get();
+}
 
-  // get exclusive control of the driver
-  const std::lock_guard<std::mutex> lock(driver_access_mutex_);
+std::future<void> SbigSTDriver::SubmitCommand(short command, void *params,
+                                              void *results, short handle) {
+  return executor_.Submit(command, params, results, handle, IsUrgent(command));
+}
 
-  // Switching device handles is an exceptionally expensive operation for the
-  // SBIG driver. Do so only if necessary.
-  if(handle != active_device_handle_) {
-    SetDriverHandleParams handle_p;
-    handle_p.handle = handle;
-    SBIG_CHECK_STATUS(SBIGUnivDrvCommand(CC_SET_DRIVER_HANDLE, &handle_p, nullptr));
-    active_device_handle_ = handle;
-  }
+SbigSTExecutorStats SbigSTDriver::GetExecutorStats() {
+  return executor_.GetStats();
+}
+
+const SbigSTCommandLatency & SbigSTDriver::GetCommandLatency() {
+  return executor_.GetLatency();
+}
+
+size_t SbigSTDriver::GetQueueDepth() {
+  return executor_.GetQueueDepth();
+}
+
+double SbigSTDriver::GetTimeScale() {
+  return executor_.GetTimeScale();
+}
 
-  // run the command
-  SBIG_CHECK_STATUS(SBIGUnivDrvCommand(command, params, results));
+const LatencyHistogram & SbigSTDriver::GetQueueWait() {
+  return executor_.GetWait();
 }
 
 void SbigSTDriver::Open() {
   // open the driver
-  SBIG_CHECK_STATUS(SBIGUnivDrvCommand(CC_OPEN_DRIVER, nullptr, nullptr));
+  RunCommand(CC_OPEN_DRIVER, nullptr, nullptr);
 }
 
 void SbigSTDriver::Close() {
 
-  // Explicitly close all devices
-  SetDriverHandleParams handle_p;
-  for(auto it = active_devices_.begin(); it != active_devices_.end(); it++) {
-    CloseDevice(it->second);
-  }
+  // Background samplers wait on the driver thread. Stop them before the
+  // devices are released there.
+  std::vector<std::shared_ptr<SbigSTDevice>> devices;
+  executor_.SubmitTask([this, &devices](short & active_handle) {
+    for(auto it = active_devices_.begin(); it != active_devices_.end(); it++)
+      devices.push_back(it->second);
+  }).get();
+  for(auto device: devices)
+    device->StopTemperatureSampler();
+
+  executor_.SubmitTask([this](short & active_handle) {
+    // Explicitly close all devices and their driver instances, ignoring
+    // errors as those would cause the application to terminate.
+    SetDriverHandleParams handle_p;
+    for(auto it = active_devices_.begin(); it != active_devices_.end(); it++) {
+      handle_p.handle = it->first;
+      executor_.Call(CC_SET_DRIVER_HANDLE, &handle_p, nullptr);
+      executor_.Call(CC_CLOSE_DEVICE, nullptr, nullptr);
+      executor_.Call(CC_CLOSE_DRIVER, nullptr, nullptr);
+    }
 
-  // Explicitly close the driver, ignoring errors as those would cause the application
-  // to terminate.
-  SBIGUnivDrvCommand(CC_CLOSE_DRIVER, nullptr, nullptr);
+    // Close the driver if no device was ever opened with it.
+    if(active_devices_.empty())
+      executor_.Call(CC_CLOSE_DRIVER, nullptr, nullptr);
+    active_devices_.clear();
+  }).get();
+  devices.clear();
+
+  std::cout << executor_.StatsToString() << std::endl;
+  std::cout << executor_.GetLatency().ToString() << std::flush;
+  executor_.Stop();
 }
 
 std::string SbigSTDriver::ToString() {
@@ -155,79 +208,103 @@ std::vector<SbigSTDeviceInfo> SbigSTDriver::GetDeviceList() {
 
 std::shared_ptr<SbigSTDevice> SbigSTDriver::OpenDevice(const SbigSTDeviceInfo & info) {
 
-  // get exclusive control over the driver
-  std::unique_lock<std::mutex> lock(driver_access_mutex_);
+  std::shared_ptr<SbigSTDevice> device;
+  bool is_new = false;
 
-  // Check to see if the device is already open. If so, return that device.
-  for(auto it = active_devices_.begin(); it != active_devices_.end(); ++it) {
-    auto h = it->first;
-    auto d = it->second;
-    auto d_info = d->GetInfo();
+  // Open the device on the driver thread so that no other command can run
+  // between the steps below.
+  executor_.SubmitTask([&](short & active_handle) {
 
-    if(info == d_info) {
-      return active_devices_[h];
+    // Check to see if the device is already open. If so, return that device.
+    for(auto it = active_devices_.begin(); it != active_devices_.end(); ++it) {
+      if(info == it->second->GetInfo()) {
+        device = it->second;
+        return;
+      }
     }
-  }
 
-  OpenDeviceParams dev_params;
-  dev_params.deviceType     = info.GetDeviceType();
-  dev_params.ipAddress      = info.GetIPAddress();
-  dev_params.lptBaseAddress = info.GetLPTAddress();
-
-  // open the device
-  SBIG_CHECK_STATUS(SBIGUnivDrvCommand(CC_OPEN_DEVICE, &dev_params, nullptr));
-
-  // Get the device handle
-  GetDriverHandleResults handle_r;
-  SBIG_CHECK_STATUS(SBIGUnivDrvCommand(CC_GET_DRIVER_HANDLE, nullptr, &handle_r));
-
-  // Switch to this device handle.
-  SetDriverHandleParams handle_p;
-  handle_p.handle = handle_r.handle;
-  SBIG_CHECK_STATUS(SBIGUnivDrvCommand(CC_SET_DRIVER_HANDLE, &handle_r, nullptr));
-  active_device_handle_ = handle_p.handle;
+    OpenDeviceParams dev_params;
+    dev_params.deviceType     = info.GetDeviceType();
+    dev_params.ipAddress      = info.GetIPAddress();
+    dev_params.lptBaseAddress = info.GetLPTAddress();
+
+    // Each driver instance talks to one device. Start a new instance for
+    // every device after the first.
+    short status = CE_NO_ERROR;
+    if(!active_devices_.empty()) {
+      SetDriverHandleParams invalid_p;
+      invalid_p.handle = INVALID_HANDLE_VALUE;
+      status = executor_.Call(CC_SET_DRIVER_HANDLE, &invalid_p, nullptr);
+      SBIG_CHECK_STATUS(status);
+      active_handle = SbigSTCommandExecutor::NO_HANDLE;
+      status = executor_.Call(CC_OPEN_DRIVER, nullptr, nullptr);
+      SBIG_CHECK_STATUS(status);
+    }
 
-  // Establish a link.
-  EstablishLinkParams link_p;
-  EstablishLinkResults link_r;
-  SBIG_CHECK_STATUS(SBIGUnivDrvCommand(CC_ESTABLISH_LINK, &link_p, &link_r));
+    // open the device
+    status = executor_.Call(CC_OPEN_DEVICE, &dev_params, nullptr);
+    SBIG_CHECK_STATUS(status);
 
-  // Make the device, add it to the map, return it to the caller.
-  auto device = std::make_shared<SbigSTDevice>(info, handle_r.handle);
-  active_devices_[handle_r.handle] = device;
+    // Get the device handle
+    GetDriverHandleResults handle_r;
+    status = executor_.Call(CC_GET_DRIVER_HANDLE, nullptr, &handle_r);
+    SBIG_CHECK_STATUS(status);
 
-  // TODO: Rework the initialization sequence for devices so we needn't use
-  // non RAII conventions here:
-  // Release the lock as all driver operations are complete.
-  lock.unlock();
+    // Switch to this device handle.
+    SetDriverHandleParams handle_p;
+    handle_p.handle = handle_r.handle;
+    status = executor_.Call(CC_SET_DRIVER_HANDLE, &handle_p, nullptr);
+    SBIG_CHECK_STATUS(status);
+    active_handle = handle_p.handle;
+
+    // Establish a link.
+    EstablishLinkParams link_p;
+    EstablishLinkResults link_r;
+    status = executor_.Call(CC_ESTABLISH_LINK, &link_p, &link_r);
+    SBIG_CHECK_STATUS(status);
+
+    // Make the device, add it to the map.
+    device = std::make_shared<SbigSTDevice>(info, handle_r.handle);
+    active_devices_[handle_r.handle] = device;
+    is_new = true;
+  }).get();
+
+  // Initialize the device before returning it to the user. Its queries are
+  // issued through the driver thread like any other command.
+  if(is_new)
+    device->InitializeDevice();
 
-  // Initialize the device before returning it to the user.
-  device->InitializeDevice();
   return device;
 }
 
 void SbigSTDriver::CloseDevice(std::shared_ptr<SbigSTDevice> device) {
 
-  // get exclusive control over the driver
-  const std::lock_guard<std::mutex> lock(driver_access_mutex_);
+  // The sampler waits on the driver thread, so stop it from here.
+  device->StopTemperatureSampler();
 
-  // Remove the device from the list of active devices.
-  for(auto it = active_devices_.begin(); it!= active_devices_.end(); ++it) {
-    if(it->second == device) {
-      active_devices_.erase(it);
-      break;
+  short handle = device->GetHandle();
+  executor_.SubmitTask([this, device](short & active_handle) {
+
+    // Remove the device from the list of active devices.
+    for(auto it = active_devices_.begin(); it!= active_devices_.end(); ++it) {
+      if(it->second == device) {
+        active_devices_.erase(it);
+        break;
+      }
     }
-  }
 
-  // Close the device with the driver.
-  short handle = device->GetHandle();
-  SetDriverHandleParams handle_p;
-  handle_p.handle = handle;
-  SBIG_CHECK_STATUS(SBIGUnivDrvCommand(CC_SET_DRIVER_HANDLE, &handle_p, nullptr));
-  SBIG_CHECK_STATUS(SBIGUnivDrvCommand(CC_CLOSE_DEVICE, &handle_p, nullptr));
+    // Close the device with the driver. The executor has already selected
+    // its handle.
+    short status = executor_.Call(CC_CLOSE_DEVICE, nullptr, nullptr);
+    SBIG_CHECK_STATUS(status);
 
-  // Device is closed, remove it from the list of active devices
-  //  active_devices_.erase(handle);
+    // Release this device's driver instance unless it is the last one, which
+    // Close() releases.
+    if(!active_devices_.empty()) {
+      executor_.Call(CC_CLOSE_DRIVER, nullptr, nullptr);
+      active_handle = SbigSTCommandExecutor::NO_HANDLE;
+    }
+  }, handle).get();
 }
 
 
@@ -238,7 +315,9 @@ ImageData * SbigSTDriver::DoReadout(short device_handle,
                                     uint16_t left,
                                     uint16_t width,
                                     uint16_t height,
-                                    bool discard_data) {
+                                    bool discard_data,
+                                    const SbigSTCancellation * cancellation,
+                                    uint64_t generation) {
 
   // allocate the image output buffer
   ImageData * img = new ImageData(width, height);
@@ -246,6 +325,14 @@ ImageData * SbigSTDriver::DoReadout(short device_handle,
   // Obtain exclusive access for the driver to do a readout.
   std::lock_guard<std::mutex> readout_lock(device_readout_mutex_);
 
+  // Tell background work to keep off the driver until the readout ends,
+  // however it ends.
+  struct ReadoutFlag {
+    std::atomic<bool> & flag;
+    ReadoutFlag(std::atomic<bool> & f) : flag(f) { flag = true; }
+    ~ReadoutFlag() { flag = false; }
+  } readout_flag(readout_active_);
+
   // freeze the cooler
   SetTemperatureRegulationParams2 temp_reg_p;
   temp_reg_p.regulation = 3;
@@ -274,8 +361,10 @@ ImageData * SbigSTDriver::DoReadout(short device_handle,
   for (size_t i = 0; (i < height); i++) {
     auto pTmp = img->data.data() + (i * width); // pointer math
 
-    // Check if we need to discard the data or abort the readout.
-    if(discard_data || !do_readout_) {
+    // Check if we need to discard the data or abort the readout. Dumping
+    // the rest of the frame is far quicker than reading it.
+    bool cancelled = cancellation != nullptr && cancellation->IsCancelled(generation);
+    if(discard_data || !do_readout_ || cancelled) {
       DumpLinesParams dl_p;
       dl_p.ccd = detector_id;
       dl_p.readoutMode = bin_mode;
@@ -290,7 +379,7 @@ ImageData * SbigSTDriver::DoReadout(short device_handle,
 
   // end the readout
   EndReadoutParams er_p;
-  er_p.ccd = 0;
+  er_p.ccd = detector_id;
   RunCommand(CC_END_READOUT, &er_p, nullptr, device_handle);
 
   // indicate the readout should not proceed
@@ -309,7 +398,9 @@ void SbigSTDriver::AbortReadout() {
 }
 
 SbigSTDeviceInfo SbigSTDriver::FindDevice(std::string device_id,
-                          std::string filter_wheel_id) {
+                                          std::string filter_wheel_id,
+                                          std::string serial_number,
+                                          int skip) {
 
   SbigSTDeviceInfo output;
 
@@ -331,15 +422,33 @@ SbigSTDeviceInfo SbigSTDriver::FindDevice(std::string device_id,
     return output;
   }
 
-  // Attempt to find the device_id in the list of active devices.
-  auto dev_infos = GetDeviceList();
-  for(auto info: dev_infos) {
-    if (info.GetDeviceName().find(device_id) != std::string::npos) {
+  // Attempt to find the device_id in the list of active devices. Try the
+  // devices found last time before querying the bus again.
+  std::lock_guard<std::mutex> lock(device_list_mutex_);
+  bool is_fresh = false;
+  while(!is_fresh) {
+    is_fresh = device_list_.empty();
+    if(is_fresh)
+      device_list_ = GetDeviceList();
+
+    int to_skip = skip;
+    for(auto info: device_list_) {
+      if (info.GetDeviceName().find(device_id) == std::string::npos)
+        continue;
+      if (!serial_number.empty() && info.GetSerialNumber() != serial_number)
+        continue;
+      if (to_skip-- > 0)
+        continue;
+
       // SBIG Cameras don't really auto-detect their filter wheel, so here
       // we simply assign the filter_wheel_id to help the device later.
       info.SetFilterWheelID(filter_wheel_id);
       return info;
     }
+
+    // Not found in the saved list. Query the bus once more.
+    if(!is_fresh)
+      device_list_.clear();
   }
 
   return output;
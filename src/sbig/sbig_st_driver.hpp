@@ -2,6 +2,9 @@
 #define SBIG_DRIVER_HPP
 
 // local includes
+#include "sbig_st_cancellation.hpp"
+#include "sbig_st_ccd_info_cache.hpp"
+#include "sbig_st_command_executor.hpp"
 class SbigSTDeviceInfo;
 class SbigSTDriver;
 class SbigSTDevice;
@@ -46,13 +49,20 @@ private:
   void operator=(SbigSTDriver const &);
 
 private:
-  std::mutex driver_access_mutex_; ///< Mutex for driver access
+  /// Thread which issues every driver call. Also tracks the active handle.
+  SbigSTCommandExecutor executor_;
   std::mutex device_readout_mutex_; ///< Mutex for detector readout operatoins.
-  /// Map containing handles and active devices.
+  /// Map containing handles and active devices. Only used on the driver thread.
   std::map<short, std::shared_ptr<SbigSTDevice>> active_devices_;
-  short active_device_handle_; ///< Handle for the current active device
 
   std::atomic<bool> do_readout_; ///< Boolean to indicate if readouts should occur.
+  std::atomic<bool> readout_active_{false}; ///< True while any readout runs.
+
+  SbigSTCCDInfoCache ccd_info_cache_; ///< CCD information saved between runs.
+  std::mutex device_list_mutex_; ///< Protects device_list_.
+  /// Devices found by the last USB query. Reused by FindDevice() so that
+  /// several cameras opened together share one query.
+  std::vector<SbigSTDeviceInfo> device_list_;
 
 private:
   /// Open the driver
@@ -61,9 +71,18 @@ private:
   void Close();
   /// Run a command against the driver.
   void RunCommand(short sbig_command, void *params, void *results);
+  /// Whether a command should be served ahead of all others.
+  static bool IsUrgent(short sbig_command);
+  /// Backend handed to the executor when the singleton is created.
+  static std::unique_ptr<SbigSTBackend> & PendingBackend();
 
 public:
 
+  /// Route every driver call through a backend, e.g. a SbigSTTraceRecorder
+  /// or SbigSTTraceReplayer. Must be called before the first GetInstance().
+  /// \param backend The backend.
+  static void SetBackend(std::unique_ptr<SbigSTBackend> backend);
+
   /// Get a vector containing strings of supported camera models.
   /// \return Vector of support camera model names.
   static std::vector<std::string> GetSupportedCameras();
@@ -80,13 +99,24 @@ public:
   /// \return A vector of active devices.
   std::vector<SbigSTDeviceInfo> GetDeviceList();
 
-  /// Find a SBIG camera and filter wheel by name
+  /// Get the on-disk cache of CCD information. Disabled until a directory
+  /// is set.
+  SbigSTCCDInfoCache & GetCCDInfoCache() { return ccd_info_cache_; }
+
+  /// Find a SBIG camera and filter wheel by name. The devices found by the
+  /// previous call are searched first; the USB bus is queried again only if
+  /// none of them match.
   /// \param device_name Camera model.
   /// \param filter_wheel_name Model of the filter wheel.
+  /// \param serial_number Serial number of the camera. Empty matches any.
+  /// \param skip Number of matching cameras to pass over, to tell identical
+  ///        models apart when no serial number is given.
   /// \return SBIG device information matching the requested items. May be "blank"
-  SbigSTDeviceInfo FindDevice(std::string device_name, std::string filter_wheel_name = "");
+  SbigSTDeviceInfo FindDevice(std::string device_name, std::string filter_wheel_name = "",
+                              std::string serial_number = "", int skip = 0);
 
-  /// Opens a SBIG device matching the provided information
+  /// Opens a SBIG device matching the provided information. Each device after
+  /// the first is given its own driver instance and handle.
   /// \param info Specifications on the device to be opened.
   /// \return A shared pointer ot the device.
   std::shared_ptr<SbigSTDevice> OpenDevice(const SbigSTDeviceInfo & info);
@@ -97,9 +127,35 @@ public:
   void CloseDevice(std::shared_ptr<SbigSTDevice> device);
 
   /// Runs a SBIG command. See SBIG universal driver documentation for further
-  /// information.
+  /// information. Blocks until the driver thread has run the command.
   void RunCommand(short sbig_command, void *params, void *results, short handle);
 
+  /// Queues a SBIG command without waiting for it.
+  /// \param sbig_command The SBIG command to run.
+  /// \param params Command parameters. Must remain valid until the future is ready.
+  /// \param results Command results. Must remain valid until the future is ready.
+  /// \param handle Handle of the device the command is for.
+  /// \return A future which rethrows any driver error.
+  std::future<void> SubmitCommand(short sbig_command, void *params, void *results,
+                                  short handle);
+
+  /// Get the handle-switch and queue wait counters of the driver thread.
+  SbigSTExecutorStats GetExecutorStats();
+
+  /// Get queue wait and call time histograms for each command and device.
+  /// Safe to read while commands are running.
+  const SbigSTCommandLatency & GetCommandLatency();
+
+  /// Get the number of commands waiting for the driver thread.
+  size_t GetQueueDepth();
+
+  /// Get the multiplier for time spent waiting on the camera. Not 1 only when
+  /// replaying a trace at another speed.
+  double GetTimeScale();
+
+  /// Get the time every command waited for the driver thread.
+  const LatencyHistogram & GetQueueWait();
+
   /// Produces a string describing this object.
   std::string ToString();
 
@@ -112,15 +168,24 @@ public:
   /// \param width The width of the resulting image.
   /// \param height The height of the resulting image.
   /// \param dump_pixels Dump the pixels rather than saving their data.
+  /// \param cancellation If given, the remaining lines are dumped as soon as
+  ///        the operation is cancelled.
+  /// \param generation Generation of cancellation taken when the operation
+  ///        started.
   ImageData * DoReadout(short device_handle, short detector_id,
                         uint16_t bin_mode,
                         uint16_t top, uint16_t left,
                         uint16_t width, uint16_t height,
-                        bool discard_data = false);
+                        bool discard_data = false,
+                        const SbigSTCancellation * cancellation = nullptr,
+                        uint64_t generation = 0);
 
   /// Abort all active readout operations.
   void AbortReadout();
 
+  /// Whether a readout is running on any device.
+  bool ReadoutInProgress() { return readout_active_; }
+
   //
 }; // class SSbigSTDriver
 
@@ -51,3 +51,31 @@ const char *SBIGErrorToName(int id) {
   default : return NULL;
   }
 }
+
+const char *SBIGCommandToName(int command) {
+  switch (command) {
+    ID_AND_NAME(CC_START_EXPOSURE);
+    ID_AND_NAME(CC_END_EXPOSURE);
+    ID_AND_NAME(CC_READOUT_LINE);
+    ID_AND_NAME(CC_DUMP_LINES);
+    ID_AND_NAME(CC_SET_TEMPERATURE_REGULATION);
+    ID_AND_NAME(CC_QUERY_TEMPERATURE_STATUS);
+    ID_AND_NAME(CC_ESTABLISH_LINK);
+    ID_AND_NAME(CC_GET_DRIVER_INFO);
+    ID_AND_NAME(CC_GET_CCD_INFO);
+    ID_AND_NAME(CC_QUERY_COMMAND_STATUS);
+    ID_AND_NAME(CC_OPEN_DRIVER);
+    ID_AND_NAME(CC_CLOSE_DRIVER);
+    ID_AND_NAME(CC_END_READOUT);
+    ID_AND_NAME(CC_OPEN_DEVICE);
+    ID_AND_NAME(CC_CLOSE_DEVICE);
+    ID_AND_NAME(CC_GET_DRIVER_HANDLE);
+    ID_AND_NAME(CC_SET_DRIVER_HANDLE);
+    ID_AND_NAME(CC_START_READOUT);
+    ID_AND_NAME(CC_CFW);
+    ID_AND_NAME(CC_START_EXPOSURE2);
+    ID_AND_NAME(CC_SET_TEMPERATURE_REGULATION2);
+    ID_AND_NAME(CC_QUERY_USB2);
+  default : return "CC_UNKNOWN";
+  }
+}
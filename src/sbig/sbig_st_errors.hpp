@@ -7,6 +7,9 @@
 
 const char *SBIGErrorToName(int id);
 
+/// Get the name of a SBIG command code, e.g. "CC_READOUT_LINE".
+const char *SBIGCommandToName(int command);
+
 #define SBIG_CHECK_STATUS(status)                                       \
   if (status != CE_NO_ERROR) {                                          \
     std::cout << "Location : " << __FILE__ << ":" << __LINE__ << std::endl; \
@@ -162,6 +162,8 @@ double SbigSTFilterWheel::setFilter(size_t filter_slot) {
 
   // get the driver
   auto &drv = SbigSTDriver::GetInstance();
+  auto &cancellation = device_->GetCancellation();
+  uint64_t generation = cancellation.Generation();
 
   // instruct the filter wheel to re-initialize
   CFWParams cfw_p;
@@ -175,13 +177,23 @@ double SbigSTFilterWheel::setFilter(size_t filter_slot) {
   bool goto_in_progress = true;
   cfw_p.cfwCommand = CFWC_QUERY;
   do {
-    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if(!cancellation.SleepFor(generation, std::chrono::milliseconds(10)))
+      break;
     drv.RunCommand(CC_CFW, &cfw_p, &cfw_r, device_->GetHandle());
     if(cfw_r.cfwStatus == CFWS_IDLE || cfw_r.cfwError > 1)
       goto_in_progress = false;
 
   } while(goto_in_progress);
 
+  // The wheel cannot be stopped mid-move, so stop waiting for it. The slot
+  // is left unchanged; the next move goes to an absolute slot regardless.
+  if(goto_in_progress) {
+    std::cout << "Filter wheel move to slot " << filter_slot << " abandoned "
+              << cancellation.Completed(generation)
+              << " ms after the abort request" << std::endl;
+    return 0.0;
+  }
+
   // Set the active slot.
   mActiveSlot = filter_slot;
 
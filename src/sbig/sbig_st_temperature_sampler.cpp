@@ -0,0 +1,160 @@
+
+// local includes
+#include "sbig_st_temperature_sampler.hpp"
+#include "sbig_st_device.hpp"
+#include "sbig_st_driver.hpp"
+
+// system includes
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+SbigSTTemperatureSampler::SbigSTTemperatureSampler(SbigSTDevice * device,
+                                                   double period_sec,
+                                                   double history_sec)
+  : device_(device),
+    period_(std::max<int64_t>(int64_t(period_sec * 1000), 100)) {
+
+  size_t capacity = std::max<size_t>(size_t(std::ceil(history_sec / GetPeriod())), 2);
+  ring_.resize(capacity);
+  thread_ = std::thread(&SbigSTTemperatureSampler::Run, this);
+}
+
+SbigSTTemperatureSampler::~SbigSTTemperatureSampler() {
+  Stop();
+}
+
+void SbigSTTemperatureSampler::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    stop_ = true;
+  }
+  stop_cv_.notify_one();
+
+  if(thread_.joinable())
+    thread_.join();
+}
+
+void SbigSTTemperatureSampler::Run() {
+
+  using namespace std::chrono;
+
+  auto & drv = SbigSTDriver::GetInstance();
+  const milliseconds readout_poll(20);
+
+  std::unique_lock<std::mutex> lock(stop_mutex_);
+  auto next_sample = steady_clock::now();
+  while(true) {
+    // Wait for the next reading, then for any readout to end. A reading
+    // between readout lines would delay the rest of the frame.
+    auto stopped = [this] { return stop_; };
+    if(stop_cv_.wait_until(lock, next_sample, stopped))
+      return;
+    while(drv.ReadoutInProgress()) {
+      if(stop_cv_.wait_for(lock, readout_poll, stopped))
+        return;
+    }
+    next_sample += period_;
+
+    lock.unlock();
+    try {
+      // Stamp the reading with the middle of the query.
+      auto start = high_resolution_clock::now();
+      TemperatureInfo info = device_->GetTemperatureInfo();
+      auto end = high_resolution_clock::now();
+
+      std::lock_guard<std::mutex> ring_lock(ring_mutex_);
+      ring_[next_].time = start + (end - start) / 2;
+      ring_[next_].info = info;
+      next_ = (next_ + 1) % ring_.size();
+      count_ = std::min(count_ + 1, ring_.size());
+    } catch(std::exception & e) {
+      std::cout << "Temperature sample failed: " << e.what() << std::endl;
+    }
+    lock.lock();
+
+    // Do not try to catch up on readings missed during a long readout.
+    if(next_sample < steady_clock::now())
+      next_sample = steady_clock::now() + period_;
+  }
+}
+
+std::vector<TemperatureSample> SbigSTTemperatureSampler::GetHistory() const {
+
+  std::lock_guard<std::mutex> lock(ring_mutex_);
+  std::vector<TemperatureSample> output;
+  output.reserve(count_);
+  size_t first = (next_ + ring_.size() - count_) % ring_.size();
+  for(size_t i = 0; i < count_; i++)
+    output.push_back(ring_[(first + i) % ring_.size()]);
+
+  return output;
+}
+
+bool SbigSTTemperatureSampler::GetLatest(TemperatureSample & sample) const {
+
+  std::lock_guard<std::mutex> lock(ring_mutex_);
+  if(count_ == 0)
+    return false;
+
+  sample = ring_[(next_ + ring_.size() - 1) % ring_.size()];
+  return true;
+}
+
+bool SbigSTTemperatureSampler::Interpolate(std::chrono::high_resolution_clock::time_point time,
+                                           TemperatureInfo & info) const {
+
+  std::lock_guard<std::mutex> lock(ring_mutex_);
+  if(count_ == 0)
+    return false;
+
+  // Readings are in time order, oldest at `first`.
+  size_t first = (next_ + ring_.size() - count_) % ring_.size();
+  auto at = [&](size_t i) -> const TemperatureSample & {
+    return ring_[(first + i) % ring_.size()];
+  };
+
+  const TemperatureSample & newest = at(count_ - 1);
+  if(time >= newest.time) {
+    if(time - newest.time > 2 * period_)
+      return false;
+    info = newest.info;
+    return true;
+  }
+  if(time < at(0).time)
+    return false;
+
+  // Find the first reading after the time.
+  size_t lo = 0;
+  size_t hi = count_ - 1;
+  while(hi - lo > 1) {
+    size_t mid = (lo + hi) / 2;
+    if(at(mid).time <= time)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  const TemperatureSample & a = at(lo);
+  const TemperatureSample & b = at(hi);
+  double f = std::chrono::duration<double>(time - a.time).count() /
+    std::chrono::duration<double>(b.time - a.time).count();
+  auto lerp = [f](double x, double y) { return x + f * (y - x); };
+
+  info = f < 0.5 ? a.info : b.info;
+  info.main_camera_temperature_setpoint = lerp(a.info.main_camera_temperature_setpoint,
+                                               b.info.main_camera_temperature_setpoint);
+  info.main_camera_temperature = lerp(a.info.main_camera_temperature,
+                                      b.info.main_camera_temperature);
+  info.tracking_camera_temperature_setpoint = lerp(a.info.tracking_camera_temperature_setpoint,
+                                                   b.info.tracking_camera_temperature_setpoint);
+  info.tracking_camera_temperature = lerp(a.info.tracking_camera_temperature,
+                                          b.info.tracking_camera_temperature);
+  info.ambient_temperature = lerp(a.info.ambient_temperature, b.info.ambient_temperature);
+  info.heatsink_temperature = lerp(a.info.heatsink_temperature, b.info.heatsink_temperature);
+  info.fan_percent_power = lerp(a.info.fan_percent_power, b.info.fan_percent_power);
+  info.fan_speed = lerp(a.info.fan_speed, b.info.fan_speed);
+  info.cooler_percent_power = lerp(a.info.cooler_percent_power, b.info.cooler_percent_power);
+
+  return true;
+}
@@ -0,0 +1,109 @@
+#ifndef SBIG_ST_TEMPERATURE_SAMPLER_HPP
+#define SBIG_ST_TEMPERATURE_SAMPLER_HPP
+
+// local includes
+class SbigSTDevice;
+
+// system includes
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Structure to store temperature information from the camera.
+struct TemperatureInfo {
+  /// True if the fan is on.
+  bool   fan_on                               = false;
+  /// True if temperature regulation is active.
+  bool   temperature_regulation_on            = false;
+  /// Temperature set point for the main camera (Celsius)
+  double main_camera_temperature_setpoint     = 0.0;
+  /// Temperature of the main camera (Celsius)
+  double main_camera_temperature              = 0.0;
+  /// Temperature set point for the tracking camera (Celsius)
+  double tracking_camera_temperature_setpoint = 0.0;
+  /// Temperature of the tracking camera (Celsius)
+  double tracking_camera_temperature          = 0.0;
+  /// Ambient temperature (Celsius)
+  double ambient_temperature                  = 0.0;
+  /// Heatsink temperature (Celsiu)
+  double heatsink_temperature                 = 0.0;
+  /// Percent power for the fan (%)
+  double fan_percent_power                    = 0.0;
+  /// Fan seep (RPM)
+  double fan_speed                            = 0.0;
+  /// Percent power for the main camera's cooler (%)
+  double cooler_percent_power                 = 0.0;
+
+
+}; // struct TemperatureInfo
+
+/// One TemperatureInfo reading.
+struct TemperatureSample {
+  /// When the reading was taken. Same clock as ImageData::exposure_start.
+  std::chrono::high_resolution_clock::time_point time;
+  /// The reading.
+  TemperatureInfo info;
+}; // struct TemperatureSample
+
+/// Reads a device's TemperatureInfo at a fixed rate on its own thread.
+///
+/// Readings go to a fixed-size ring holding the last history_sec seconds, so
+/// a night's worth stays available without growing. Sampling pauses while any
+/// readout is in progress to keep the driver free for the readout lines.
+class SbigSTTemperatureSampler {
+
+private:
+  SbigSTDevice * device_ = nullptr; ///< Device to read. Not owned.
+  std::chrono::milliseconds period_; ///< Time between readings.
+
+  mutable std::mutex ring_mutex_; ///< Protects ring_, next_ and count_.
+  std::vector<TemperatureSample> ring_; ///< Readings, oldest overwritten first.
+  size_t next_  = 0; ///< Slot the next reading goes to.
+  size_t count_ = 0; ///< Number of valid readings in ring_.
+
+  std::thread thread_; ///< The sampling thread.
+  std::mutex stop_mutex_; ///< Protects stop_.
+  std::condition_variable stop_cv_; ///< Wakes the thread to stop.
+  bool stop_ = false; ///< Set when the thread should exit.
+
+public:
+  /// Default constructor. Starts sampling.
+  /// \param device Device to read. Must outlive the sampler.
+  /// \param period_sec Time between readings (seconds).
+  /// \param history_sec Time covered by the ring (seconds).
+  SbigSTTemperatureSampler(SbigSTDevice * device, double period_sec,
+                           double history_sec = 24 * 3600);
+  /// Default destructor. Stops sampling.
+  ~SbigSTTemperatureSampler();
+
+  /// Stop sampling. Must not be called from the driver thread.
+  void Stop();
+
+  /// Get the time between readings (seconds).
+  double GetPeriod() const { return period_.count() * 1E-3; }
+
+  /// Get every reading in the ring, oldest first.
+  std::vector<TemperatureSample> GetHistory() const;
+
+  /// Get the newest reading.
+  /// \return False if there is none yet.
+  bool GetLatest(TemperatureSample & sample) const;
+
+  /// Interpolate the readings to a time.
+  /// \param time Time of interest.
+  /// \param info Interpolated temperatures. Flags come from the nearer reading.
+  /// \return False if no reading covers the time. Times up to two periods after
+  ///         the newest reading take its values.
+  bool Interpolate(std::chrono::high_resolution_clock::time_point time,
+                   TemperatureInfo & info) const;
+
+private:
+  /// Main loop of the sampling thread.
+  void Run();
+
+  //
+}; // class SbigSTTemperatureSampler
+
+#endif // SBIG_ST_TEMPERATURE_SAMPLER_HPP
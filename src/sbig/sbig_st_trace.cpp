@@ -0,0 +1,456 @@
+
+// local includes
+#include "sbig_st_trace.hpp"
+#include "sbig_st_errors.hpp"
+
+// system includes
+#include <sbigudrv.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+/// Identifies the trace file format.
+static const char TRACE_MAGIC[8] = {'S', 'B', 'I', 'G', 'T', 'R', 'C', '2'};
+
+/// Command code and the sub-request (if any) that selects its structs.
+static uint32_t CommandKind(short command, const void *params) {
+
+  uint32_t sub = 0;
+  if(params != nullptr) {
+    if(command == CC_CFW)
+      sub = static_cast<const CFWParams *>(params)->cfwCommand;
+    else if(command == CC_GET_CCD_INFO)
+      sub = static_cast<const GetCCDInfoParams *>(params)->request;
+    else if(command == CC_QUERY_TEMPERATURE_STATUS)
+      sub = static_cast<const QueryTemperatureStatusParams *>(params)->request;
+  }
+
+  return (uint32_t(uint16_t(command)) << 16) | (sub & 0xFFFF);
+}
+
+/// Whether the number of calls of this kind depends on timing.
+static bool IsTimingDependent(uint32_t kind) {
+  short command = kind >> 16;
+  return command == CC_QUERY_COMMAND_STATUS ||
+    command == CC_QUERY_TEMPERATURE_STATUS ||
+    command == CC_SET_DRIVER_HANDLE ||
+    (command == CC_CFW && (kind & 0xFFFF) == CFWC_QUERY);
+}
+
+bool SbigSTCommandSizes(short command, const void *params,
+                        size_t & params_size, size_t & results_size,
+                        size_t & line_bytes) {
+
+  params_size = 0;
+  results_size = 0;
+  line_bytes = 0;
+
+  switch(command) {
+  case CC_OPEN_DRIVER:
+  case CC_CLOSE_DRIVER:
+  case CC_CLOSE_DEVICE:
+    break;
+  case CC_OPEN_DEVICE:
+    params_size = sizeof(OpenDeviceParams);
+    break;
+  case CC_GET_DRIVER_HANDLE:
+    results_size = sizeof(GetDriverHandleResults);
+    break;
+  case CC_SET_DRIVER_HANDLE:
+    params_size = sizeof(SetDriverHandleParams);
+    break;
+  case CC_ESTABLISH_LINK:
+    params_size = sizeof(EstablishLinkParams);
+    results_size = sizeof(EstablishLinkResults);
+    break;
+  case CC_GET_DRIVER_INFO:
+    params_size = sizeof(GetDriverInfoParams);
+    results_size = sizeof(GetDriverInfoResults0);
+    break;
+  case CC_QUERY_USB2:
+    results_size = sizeof(QueryUSBResults2);
+    break;
+  case CC_GET_CCD_INFO: {
+    params_size = sizeof(GetCCDInfoParams);
+    auto request = static_cast<const GetCCDInfoParams *>(params)->request;
+    if(request == 0 || request == 1)
+      results_size = sizeof(GetCCDInfoResults0);
+    else if(request == 4 || request == 5)
+      results_size = sizeof(GetCCDInfoResults4);
+    else
+      return false;
+    break;
+  }
+  case CC_QUERY_TEMPERATURE_STATUS: {
+    params_size = sizeof(QueryTemperatureStatusParams);
+    auto request = static_cast<const QueryTemperatureStatusParams *>(params)->request;
+    if(request == TEMP_STATUS_STANDARD)
+      results_size = sizeof(QueryTemperatureStatusResults);
+    else
+      results_size = sizeof(QueryTemperatureStatusResults2);
+    break;
+  }
+  case CC_SET_TEMPERATURE_REGULATION2:
+    params_size = sizeof(SetTemperatureRegulationParams2);
+    break;
+  case CC_START_EXPOSURE2:
+    params_size = sizeof(StartExposureParams2);
+    break;
+  case CC_QUERY_COMMAND_STATUS:
+    params_size = sizeof(QueryCommandStatusParams);
+    results_size = sizeof(QueryCommandStatusResults);
+    break;
+  case CC_END_EXPOSURE:
+    params_size = sizeof(EndExposureParams);
+    break;
+  case CC_START_READOUT:
+    params_size = sizeof(StartReadoutParams);
+    break;
+  case CC_READOUT_LINE:
+    params_size = sizeof(ReadoutLineParams);
+    line_bytes = static_cast<const ReadoutLineParams *>(params)->pixelLength *
+      sizeof(unsigned short);
+    break;
+  case CC_DUMP_LINES:
+    params_size = sizeof(DumpLinesParams);
+    break;
+  case CC_END_READOUT:
+    params_size = sizeof(EndReadoutParams);
+    break;
+  case CC_CFW:
+    params_size = sizeof(CFWParams);
+    results_size = sizeof(CFWResults);
+    break;
+  default:
+    return false;
+  }
+
+  return true;
+}
+
+void SbigSTCanonicalParams(short command, const void *params,
+                           size_t params_size, char *output) {
+
+  memset(output, 0, params_size);
+  if(params == nullptr || params_size == 0)
+    return;
+
+  // Structs mixing short and long members have padding the caller may not
+  // have cleared, and CFWParams carries buffer pointers; copy field by field.
+  switch(command) {
+  case CC_OPEN_DEVICE: {
+    auto in = static_cast<const OpenDeviceParams *>(params);
+    auto out = reinterpret_cast<OpenDeviceParams *>(output);
+    out->deviceType = in->deviceType;
+    out->lptBaseAddress = in->lptBaseAddress;
+    out->ipAddress = in->ipAddress;
+    break;
+  }
+  case CC_SET_TEMPERATURE_REGULATION2: {
+    auto in = static_cast<const SetTemperatureRegulationParams2 *>(params);
+    auto out = reinterpret_cast<SetTemperatureRegulationParams2 *>(output);
+    out->regulation = in->regulation;
+    out->ccdSetpoint = in->ccdSetpoint;
+    break;
+  }
+  case CC_START_EXPOSURE2: {
+    auto in = static_cast<const StartExposureParams2 *>(params);
+    auto out = reinterpret_cast<StartExposureParams2 *>(output);
+    out->ccd = in->ccd;
+    out->exposureTime = in->exposureTime;
+    out->abgState = in->abgState;
+    out->openShutter = in->openShutter;
+    out->readoutMode = in->readoutMode;
+    out->top = in->top;
+    out->left = in->left;
+    out->height = in->height;
+    out->width = in->width;
+    break;
+  }
+  case CC_CFW: {
+    auto in = static_cast<const CFWParams *>(params);
+    auto out = reinterpret_cast<CFWParams *>(output);
+    out->cfwModel = in->cfwModel;
+    out->cfwCommand = in->cfwCommand;
+    out->cfwParam1 = in->cfwParam1;
+    out->cfwParam2 = in->cfwParam2;
+    out->outLength = in->outLength;
+    out->inLength = in->inLength;
+    break;
+  }
+  default:
+    memcpy(output, params, params_size);
+  }
+}
+
+short SbigSTDirectBackend::Command(short command, void *params, void *results) {
+  return SBIGUnivDrvCommand(command, params, results);
+}
+
+//
+// Recording
+//
+
+SbigSTTraceRecorder::SbigSTTraceRecorder(const std::string & filename,
+                                         std::unique_ptr<SbigSTBackend> backend)
+  : backend_(std::move(backend)),
+    trace_(filename, std::ios::binary),
+    lines_(filename + ".lines", std::ios::binary),
+    start_(std::chrono::steady_clock::now()) {
+
+  if(!trace_ || !lines_)
+    throw std::runtime_error("Cannot create driver trace " + filename);
+
+  if(backend_ == nullptr)
+    backend_.reset(new SbigSTDirectBackend());
+
+  trace_.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+  line_chunk_.reserve(chunk_size_);
+  compressor_ = std::thread(&SbigSTTraceRecorder::CompressChunks, this);
+}
+
+SbigSTTraceRecorder::~SbigSTTraceRecorder() {
+
+  QueueChunk();
+  {
+    std::lock_guard<std::mutex> lock(chunks_mutex_);
+    stop_ = true;
+  }
+  chunks_cv_.notify_one();
+  compressor_.join();
+
+  std::cout << "Driver trace: " << records_ << " calls, "
+            << raw_bytes_ << " bytes of pixel data compressed to "
+            << compressed_bytes_ << std::endl;
+}
+
+short SbigSTTraceRecorder::Command(short command, void *params, void *results) {
+
+  using namespace std::chrono;
+
+  auto start = steady_clock::now();
+  short status = backend_->Command(command, params, results);
+  auto end = steady_clock::now();
+
+  size_t params_size = 0;
+  size_t results_size = 0;
+  size_t line_bytes = 0;
+  if(!SbigSTCommandSizes(command, params, params_size, results_size, line_bytes))
+    std::cout << "Driver trace: sizes of " << SBIGCommandToName(command)
+              << " are unknown; its structs are not recorded." << std::endl;
+  if(params == nullptr)
+    params_size = 0;
+  if(results == nullptr)
+    results_size = line_bytes = 0;
+
+  SbigSTTraceRecord record;
+  record.start_ns = duration_cast<nanoseconds>(start - start_).count();
+  record.duration_ns = duration_cast<nanoseconds>(end - start).count();
+  record.command = command;
+  record.status = status;
+  record.params_size = params_size;
+  record.results_size = results_size;
+  record.line_bytes = line_bytes;
+
+  params_.resize(params_size);
+  SbigSTCanonicalParams(command, params, params_size, params_.data());
+
+  trace_.write(reinterpret_cast<const char *>(&record), sizeof(record));
+  trace_.write(params_.data(), params_size);
+  trace_.write(static_cast<const char *>(results), results_size);
+  records_++;
+
+  // Pixel data is only copied here; compression happens on its own thread.
+  if(line_bytes > 0) {
+    const char *pixels = static_cast<const char *>(results);
+    line_chunk_.insert(line_chunk_.end(), pixels, pixels + line_bytes);
+    if(line_chunk_.size() >= chunk_size_)
+      QueueChunk();
+  }
+
+  return status;
+}
+
+void SbigSTTraceRecorder::QueueChunk() {
+
+  if(line_chunk_.empty())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(chunks_mutex_);
+    chunks_.push_back(std::move(line_chunk_));
+  }
+  chunks_cv_.notify_one();
+
+  line_chunk_ = std::vector<char>();
+  line_chunk_.reserve(chunk_size_);
+}
+
+void SbigSTTraceRecorder::CompressChunks() {
+
+  std::vector<unsigned char> compressed;
+  while(true) {
+    std::vector<char> chunk;
+    {
+      std::unique_lock<std::mutex> lock(chunks_mutex_);
+      chunks_cv_.wait(lock, [this] { return stop_ || !chunks_.empty(); });
+      if(chunks_.empty())
+        return;
+      chunk = std::move(chunks_.front());
+      chunks_.pop_front();
+    }
+
+    // Neighbouring pixels are similar, so their differences compress far
+    // better than the values themselves.
+    uint16_t *pixels = reinterpret_cast<uint16_t *>(chunk.data());
+    size_t n_pixels = chunk.size() / sizeof(uint16_t);
+    for(size_t i = n_pixels; i-- > 1; )
+      pixels[i] -= pixels[i - 1];
+
+    uLongf compressed_size = compressBound(chunk.size());
+    compressed.resize(compressed_size);
+    compress2(compressed.data(), &compressed_size,
+              reinterpret_cast<const Bytef *>(chunk.data()), chunk.size(),
+              Z_BEST_SPEED);
+
+    uint32_t sizes[2] = {uint32_t(chunk.size()), uint32_t(compressed_size)};
+    lines_.write(reinterpret_cast<const char *>(sizes), sizeof(sizes));
+    lines_.write(reinterpret_cast<const char *>(compressed.data()), compressed_size);
+
+    raw_bytes_ += chunk.size();
+    compressed_bytes_ += compressed_size;
+  }
+}
+
+//
+// Replay
+//
+
+SbigSTTraceReplayer::SbigSTTraceReplayer(const std::string & filename,
+                                         double time_scale)
+  : trace_(filename, std::ios::binary),
+    lines_(filename + ".lines", std::ios::binary),
+    time_scale_(time_scale) {
+
+  char magic[sizeof(TRACE_MAGIC)] = {};
+  trace_.read(magic, sizeof(magic));
+  if(!trace_ || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0)
+    throw std::runtime_error("Cannot read driver trace " + filename);
+
+  ReadNext();
+}
+
+void SbigSTTraceReplayer::ReadNext() {
+
+  has_next_ = false;
+  if(!trace_.read(reinterpret_cast<char *>(&next_), sizeof(next_)))
+    return;
+
+  next_params_.resize(next_.params_size);
+  next_results_.resize(next_.results_size);
+  trace_.read(next_params_.data(), next_params_.size());
+  trace_.read(next_results_.data(), next_results_.size());
+  has_next_ = bool(trace_);
+  index_++;
+}
+
+void SbigSTTraceReplayer::ReadLines(char *output, size_t n_bytes) {
+
+  while(n_bytes > 0) {
+    if(line_offset_ == line_buffer_.size()) {
+      uint32_t sizes[2] = {0, 0};
+      std::vector<unsigned char> compressed;
+      if(lines_.read(reinterpret_cast<char *>(sizes), sizeof(sizes))) {
+        compressed.resize(sizes[1]);
+        lines_.read(reinterpret_cast<char *>(compressed.data()), sizes[1]);
+      }
+      if(!lines_)
+        throw std::runtime_error("Driver trace line stream ended early");
+
+      uLongf raw_size = sizes[0];
+      line_buffer_.resize(raw_size);
+      uncompress(reinterpret_cast<Bytef *>(line_buffer_.data()), &raw_size,
+                 compressed.data(), compressed.size());
+      line_offset_ = 0;
+
+      uint16_t *pixels = reinterpret_cast<uint16_t *>(line_buffer_.data());
+      size_t n_pixels = line_buffer_.size() / sizeof(uint16_t);
+      for(size_t i = 1; i < n_pixels; i++)
+        pixels[i] += pixels[i - 1];
+    }
+
+    size_t n = std::min(n_bytes, line_buffer_.size() - line_offset_);
+    memcpy(output, line_buffer_.data() + line_offset_, n);
+    line_offset_ += n;
+    output += n;
+    n_bytes -= n;
+  }
+}
+
+short SbigSTTraceReplayer::Command(short command, void *params, void *results) {
+
+  size_t params_size = 0;
+  size_t results_size = 0;
+  size_t line_bytes = 0;
+  SbigSTCommandSizes(command, params, params_size, results_size, line_bytes);
+  if(params == nullptr)
+    params_size = 0;
+  if(results == nullptr)
+    results_size = line_bytes = 0;
+
+  call_params_.resize(params_size);
+  SbigSTCanonicalParams(command, params, params_size, call_params_.data());
+
+  // Skip recorded polls that this run did not make.
+  uint32_t kind = CommandKind(command, params);
+  auto next_kind = [this] {
+    return CommandKind(next_.command, next_params_.empty() ? nullptr : next_params_.data());
+  };
+  auto next_matches = [&] {
+    return next_kind() == kind && next_params_ == call_params_;
+  };
+  while(has_next_ && !next_matches() && IsTimingDependent(next_kind()))
+    ReadNext();
+
+  if(has_next_ && next_matches()) {
+    std::this_thread::sleep_for(std::chrono::nanoseconds(
+      uint64_t(next_.duration_ns * time_scale_)));
+
+    short status = next_.status;
+    if(results_size > 0)
+      memcpy(results, next_results_.data(), std::min(results_size, next_results_.size()));
+    if(next_.line_bytes > 0) {
+      std::vector<char> discard;
+      char *output = static_cast<char *>(results);
+      if(line_bytes != next_.line_bytes) {
+        discard.resize(next_.line_bytes);
+        output = discard.data();
+      }
+      ReadLines(output, next_.line_bytes);
+    }
+    last_[kind] = std::make_pair(status, next_results_);
+    ReadNext();
+    return status;
+  }
+
+  // This run polled more often than the recording did.
+  if(IsTimingDependent(kind)) {
+    auto it = last_.find(kind);
+    if(it == last_.end())
+      return CE_NO_ERROR;
+    if(results_size > 0)
+      memcpy(results, it->second.second.data(),
+             std::min(results_size, it->second.second.size()));
+    return it->second.first;
+  }
+
+  std::cout << "Driver replay diverged at call " << index_ << ": trace has "
+            << (has_next_ ? SBIGCommandToName(next_.command) : "ended")
+            << ", driver was asked for " << SBIGCommandToName(command);
+  if(has_next_ && next_kind() == kind)
+    std::cout << " with different parameters";
+  std::cout << std::endl;
+  return CE_BAD_PARAMETER;
+}
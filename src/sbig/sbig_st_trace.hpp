@@ -0,0 +1,173 @@
+#ifndef SBIG_ST_TRACE_HPP
+#define SBIG_ST_TRACE_HPP
+
+// system includes
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Interface through which every call to the SBIG universal driver is made.
+class SbigSTBackend {
+public:
+  /// Default destructor.
+  virtual ~SbigSTBackend() {}
+
+  /// Run a command. Same contract as SBIGUnivDrvCommand.
+  virtual short Command(short sbig_command, void *params, void *results) = 0;
+
+  /// Multiplier for time spent waiting on the camera, e.g. while an exposure
+  /// runs. 1 for real hardware.
+  virtual double TimeScale() const { return 1.0; }
+
+  //
+}; // class SbigSTBackend
+
+/// Backend which calls the SBIG universal driver.
+class SbigSTDirectBackend : public SbigSTBackend {
+public:
+  /// See SbigSTBackend.
+  short Command(short sbig_command, void *params, void *results);
+
+  //
+}; // class SbigSTDirectBackend
+
+/// Fixed-size header of one call stored in a trace file. The parameter and
+/// result structs follow it.
+struct SbigSTTraceRecord {
+  uint64_t start_ns     = 0; ///< Start of the call since the trace began (ns).
+  uint32_t duration_ns  = 0; ///< Time spent in the driver (ns).
+  int16_t  command      = 0; ///< SBIG command code.
+  int16_t  status       = 0; ///< Value returned by the driver.
+  uint16_t params_size  = 0; ///< Bytes of parameters that follow.
+  uint16_t results_size = 0; ///< Bytes of results that follow.
+  uint32_t line_bytes   = 0; ///< Bytes of pixel data held in the line stream instead.
+}; // struct SbigSTTraceRecord
+
+/// Copy a command's parameters with padding and pointers zeroed, so equal
+/// parameters compare equal byte for byte.
+/// \param sbig_command The SBIG command.
+/// \param params The command's parameters.
+/// \param params_size Bytes of parameters, from SbigSTCommandSizes.
+/// \param output Receives params_size bytes.
+void SbigSTCanonicalParams(short sbig_command, const void *params,
+                           size_t params_size, char *output);
+
+/// Find the sizes of the structs a command reads and writes.
+/// \param sbig_command The SBIG command.
+/// \param params The command's parameters (some sizes depend on them).
+/// \param params_size Bytes of parameters.
+/// \param results_size Bytes of results, other than pixel data.
+/// \param line_bytes Bytes of pixel data written to results.
+/// \return False if the command is not known.
+bool SbigSTCommandSizes(short sbig_command, const void *params,
+                        size_t & params_size, size_t & results_size,
+                        size_t & line_bytes);
+
+/// Backend which records every call made through another backend.
+///
+/// Calls go to a compact binary trace. Pixel data from readouts goes to a
+/// side stream (the trace file name plus ".lines") which is delta encoded
+/// and zlib compressed on a separate thread, so the readout is not slowed.
+class SbigSTTraceRecorder : public SbigSTBackend {
+
+private:
+  std::unique_ptr<SbigSTBackend> backend_; ///< Backend that runs the calls.
+  std::ofstream trace_; ///< The trace.
+  std::ofstream lines_; ///< Compressed pixel data.
+  std::chrono::steady_clock::time_point start_; ///< Start of the trace.
+  uint64_t records_ = 0; ///< Number of calls recorded.
+  std::vector<char> params_; ///< Canonical parameters of the current call.
+
+  std::vector<char> line_chunk_; ///< Pixel data waiting to be compressed.
+  const size_t chunk_size_ = 1 << 20; ///< Pixel bytes compressed at a time.
+
+  std::thread compressor_; ///< Compresses and writes pixel data.
+  std::mutex chunks_mutex_; ///< Protects chunks_ and stop_.
+  std::condition_variable chunks_cv_; ///< Signalled when a chunk is queued.
+  std::deque<std::vector<char>> chunks_; ///< Chunks waiting to be compressed.
+  bool stop_ = false; ///< Set when the compressor should drain and exit.
+  uint64_t raw_bytes_ = 0; ///< Pixel bytes written (compressor thread).
+  uint64_t compressed_bytes_ = 0; ///< Compressed bytes written (compressor thread).
+
+public:
+  /// Default constructor.
+  /// \param filename Name of the trace file.
+  /// \param backend Backend that runs the calls. Defaults to the real driver.
+  SbigSTTraceRecorder(const std::string & filename,
+                      std::unique_ptr<SbigSTBackend> backend = nullptr);
+  /// Default destructor. Flushes the trace.
+  ~SbigSTTraceRecorder();
+
+  /// See SbigSTBackend.
+  short Command(short sbig_command, void *params, void *results);
+
+  /// See SbigSTBackend.
+  double TimeScale() const { return backend_->TimeScale(); }
+
+private:
+  /// Queue the current chunk of pixel data for compression.
+  void QueueChunk();
+  /// Main loop of the compressor thread.
+  void CompressChunks();
+
+  //
+}; // class SbigSTTraceRecorder
+
+/// Backend which answers calls from a recorded trace instead of a camera.
+///
+/// Calls must arrive in the recorded order with the recorded parameters.
+/// The number of status polls depends on timing, so recorded polls the
+/// caller does not make are skipped, and extra polls get the last recorded
+/// answer.
+class SbigSTTraceReplayer : public SbigSTBackend {
+
+private:
+  std::ifstream trace_; ///< The trace.
+  std::ifstream lines_; ///< Compressed pixel data.
+  double time_scale_ = 1.0; ///< Multiplier applied to recorded call durations.
+
+  bool has_next_ = false; ///< Whether next_ holds a record.
+  uint64_t index_ = 0; ///< Index of next_ in the trace.
+  SbigSTTraceRecord next_; ///< Next record in the trace.
+  std::vector<char> next_params_; ///< Parameters of next_.
+  std::vector<char> next_results_; ///< Results of next_.
+  std::vector<char> call_params_; ///< Canonical parameters of the current call.
+
+  /// Last status and results by command kind, for repeated polls.
+  std::map<uint32_t, std::pair<short, std::vector<char>>> last_;
+
+  std::vector<char> line_buffer_; ///< Decompressed pixel data.
+  size_t line_offset_ = 0; ///< Bytes of line_buffer_ already used.
+
+public:
+  /// Default constructor.
+  /// \param filename Name of the trace file.
+  /// \param time_scale Multiplier for recorded call durations. 1 replays with
+  ///        the original timing, 0 as fast as possible.
+  SbigSTTraceReplayer(const std::string & filename, double time_scale = 1.0);
+
+  /// See SbigSTBackend.
+  short Command(short sbig_command, void *params, void *results);
+
+  /// See SbigSTBackend. Exposures are replayed on the same time scale as
+  /// driver calls.
+  double TimeScale() const { return time_scale_; }
+
+private:
+  /// Read the next record into next_.
+  void ReadNext();
+  /// Copy pixel data from the line stream.
+  void ReadLines(char *output, size_t n_bytes);
+
+  //
+}; // class SbigSTTraceReplayer
+
+#endif // SBIG_ST_TRACE_HPP
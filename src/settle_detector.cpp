@@ -0,0 +1,74 @@
+#include "settle_detector.hpp"
+
+// system includes
+#include <algorithm>
+#include <cmath>
+
+/// Arcseconds per radian.
+static const double ARCSEC_PER_RAD = 180.0 * 3600.0 / M_PI;
+
+SettleDetector::SettleDetector() {
+}
+
+void SettleDetector::setThresholds(double velocity, double jitter, double window) {
+  mMaxVelocity = velocity;
+  mMaxJitter = jitter;
+  mWindow = window;
+}
+
+bool SettleDetector::update(const std::vector<CoordinateSample> & samples,
+                            int64_t now_ns) {
+
+  // Accumulate sums for a least-squares line through each axis. Positions
+  // are on-sky offsets from the first sample so that RA is scaled by
+  // cos(DEC) and does not jump at 0/2 pi.
+  int64_t start_ns = now_ns - int64_t(mWindow * 1E9);
+  const CoordinateSample * first = nullptr;
+  const CoordinateSample * last = nullptr;
+  double n = 0, st = 0, stt = 0;
+  double sx = 0, stx = 0, sxx = 0;
+  double sy = 0, sty = 0, syy = 0;
+  for(auto & s: samples) {
+    if(s.type != niad::COORDINATE_TYPE_RA_DEC || s.arrival_ns < start_ns)
+      continue;
+    if(first == nullptr)
+      first = &s;
+    last = &s;
+
+    double t = (s.arrival_ns - first->arrival_ns) * 1E-9;
+    double x = remainder(s.position[0] - first->position[0], 2 * M_PI)
+      * cos(first->position[1]) * ARCSEC_PER_RAD;
+    double y = (s.position[1] - first->position[1]) * ARCSEC_PER_RAD;
+
+    n += 1;
+    st += t; stt += t * t;
+    sx += x; stx += t * x; sxx += x * x;
+    sy += y; sty += t * y; syy += y * y;
+  }
+
+  mSamples = n;
+  if(mSamples < mMinSamples) {
+    mVelocity = mJitter = NAN;
+    return false;
+  }
+
+  // The window must actually be covered, or a burst after a stall would
+  // look settled.
+  double span = (last->arrival_ns - first->arrival_ns) * 1E-9;
+  double var_t = stt - st * st / n;
+  if(span < mWindow / 2 || var_t <= 0) {
+    mVelocity = mJitter = NAN;
+    return false;
+  }
+
+  double slope_x = (stx - st * sx / n) / var_t;
+  double slope_y = (sty - st * sy / n) / var_t;
+  mVelocity = sqrt(slope_x * slope_x + slope_y * slope_y);
+
+  // Residual sum of squares about each line.
+  double rss_x = (sxx - sx * sx / n) - slope_x * (stx - st * sx / n);
+  double rss_y = (syy - sy * sy / n) - slope_y * (sty - st * sy / n);
+  mJitter = sqrt(std::max(0.0, rss_x + rss_y) / n);
+
+  return mVelocity <= mMaxVelocity && mJitter <= mMaxJitter;
+}
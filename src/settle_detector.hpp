@@ -0,0 +1,63 @@
+#ifndef SETTLE_DETECTOR_HPP
+#define SETTLE_DETECTOR_HPP
+
+// local includes
+#include "client.hpp"
+
+// system includes
+#include <cstdint>
+#include <vector>
+
+/// Decides whether the mount has settled from its recent RA/DEC updates.
+///
+/// A straight line is fit to the positions reported within a sliding window.
+/// The mount is settled when the slope (velocity) and the scatter about the
+/// line (jitter) are both below their thresholds. While tracking, a settled
+/// mount holds RA/DEC fixed, so any motion is slewing or ringing.
+class SettleDetector {
+
+public:
+  /// Default constructor
+  SettleDetector();
+
+protected:
+  double mMaxVelocity = 2; ///< Largest settled velocity (arcsec/s).
+  double mMaxJitter = 1; ///< Largest settled RMS scatter (arcsec).
+  double mWindow = 2; ///< Length of the sliding window (seconds).
+  size_t mMinSamples = 3; ///< Fewest samples needed to judge the mount.
+
+  double mVelocity = 0; ///< Velocity from the last update (arcsec/s).
+  double mJitter = 0; ///< Jitter from the last update (arcsec).
+  size_t mSamples = 0; ///< Samples used in the last update.
+
+public:
+  /// Set the thresholds.
+  /// \param velocity Largest settled velocity (arcsec/s).
+  /// \param jitter Largest settled RMS scatter about a linear fit (arcsec).
+  /// \param window Length of the sliding window (seconds). Should span
+  ///        several coordinate updates.
+  void setThresholds(double velocity, double jitter, double window);
+
+  /// Get the length of the sliding window (seconds).
+  double getWindow() const { return mWindow; }
+
+  /// Evaluate the mount against the thresholds.
+  /// \param samples Recent coordinate updates, oldest first.
+  /// \param now_ns Current local time (nanoseconds since the epoch).
+  /// \return True if the window holds enough RA/DEC updates and they are
+  ///         within the thresholds.
+  bool update(const std::vector<CoordinateSample> & samples, int64_t now_ns);
+
+  /// Get the number of RA/DEC samples considered by the last update().
+  size_t getSampleCount() const { return mSamples; }
+
+  /// Get the velocity measured by the last update() (arcsec/s).
+  double getVelocity() const { return mVelocity; }
+
+  /// Get the jitter measured by the last update() (arcsec).
+  double getJitter() const { return mJitter; }
+
+  //
+}; // SettleDetector
+
+#endif // SETTLE_DETECTOR_HPP
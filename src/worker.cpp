@@ -2,11 +2,59 @@
 
 // system includes
 #include <QDebug>
+#include <QFileInfo>
 #include <QCoreApplication>
 #include <QThread>
 
 #include "datetime_utilities.hpp"
-#include <google/protobuf/util/time_util.h>
+#include "interpolation.hpp"
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <thread>
+
+/// Interpolate the mount position of the specified coordinate type to a
+/// local time using a spline through the samples nearest to that time.
+/// \param samples Buffered samples, in arrival order.
+/// \param type niad::CoordinateType to interpolate.
+/// \param t_ns Local time of interest (nanoseconds since the epoch).
+/// \param position Interpolated position (radians).
+/// \return True if any samples of the specified type were found.
+static bool interpolatePosition(const std::vector<CoordinateSample> & samples,
+                                int32_t type, int64_t t_ns, double position[2]) {
+
+  // Number of samples on either side of t_ns used for the spline. Pointing is
+  // smooth, so a local fit is as accurate as one over the whole window.
+  const size_t half_width = 8;
+
+  // Times are relative to t_ns, in seconds, to preserve precision.
+  std::vector<double> t, a, b;
+  for(auto & s: samples) {
+    if(s.type != type)
+      continue;
+    double dt = (s.arrival_ns - t_ns) * 1E-9;
+    if(!t.empty() && dt <= t.back())
+      continue;
+    t.push_back(dt);
+    a.push_back(s.position[0]);
+    b.push_back(s.position[1]);
+  }
+  if(t.empty())
+    return false;
+
+  size_t center = std::upper_bound(t.begin(), t.end(), 0.0) - t.begin();
+  size_t first = center > half_width ? center - half_width : 0;
+  size_t last = std::min(t.size(), center + half_width);
+  std::vector<double> t_local(t.begin() + first, t.begin() + last);
+  std::vector<double> a_local(a.begin() + first, a.begin() + last);
+  std::vector<double> b_local(b.begin() + first, b.begin() + last);
+
+  // RA and azimuth wrap at 2 pi.
+  Interpolation::Unwrap(a_local, 2 * M_PI);
+  position[0] = Interpolation::Wrap(Interpolation::CubicSpline(t_local, a_local, 0.0), 2 * M_PI);
+  position[1] = Interpolation::CubicSpline(t_local, b_local, 0.0);
+  return true;
+}
 
 Worker::Worker(Client * client)
   : QObject(nullptr), mClient(client), mStopExposures(false) {
@@ -17,84 +65,657 @@ Worker::~Worker() {
 
 void Worker::run() {
 
+  if(initialize()) {
+    if(mPlan.getTargets().empty())
+      runSequence();
+    else
+      runPlan();
+  }
+
+  emit finished();
+}
+
+bool Worker::initialize() {
+
   int status = setupCamera();
   if(status != 0) {
     qDebug() << "Camera initialization failed. Bailing...";
-    emit finished();
-    return;
+    emit initialized(false);
+    return false;
   }
+  mReady = true;
 
   qInfo() << "Worker ready at "
-          << QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+          << QDateTime::currentDateTimeUtc().toString(Qt::ISODate) << "after"
+          << std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - mCreated).count() << "ms";
+  emit initialized(true);
+  return true;
+}
+
+void Worker::runSequence() {
+
+  if(mMainCamera == nullptr) {
+    qWarning() << "No camera available. Ignoring exposure sequence.";
+    emit sequenceFinished(0);
+    return;
+  }
+
+  ExposureStep step;
+  step.catalog = mCatalogName;
+  step.object = mObjectName;
+  step.filter = mFilterName;
+  step.slot = findFilterSlot(mFilterName);
+  step.duration = mExposureDuration;
+  std::vector<ExposureStep> steps(std::max(mExposureQuanity, 0), step);
 
   if(mSetTemperature) {
     mMainCamera->setTemperatureTarget(niad::TEMPERATURE_TYPE_SENSOR, true, mTemperatureTarget);
   }
 
-  // Check to see if the filter is a number
-  bool filter_name_is_number = false;
-  int filter_id = mFilterName.toInt(&filter_name_is_number);
-  if (filter_name_is_number) {
-    mFilterWheel->setFilter(filter_id);
-  } else {
-    mFilterWheel->setFilter(mFilterName.toStdString());
+  // With nothing to expose (e.g. only --temperature was given) the set point
+  // is all that was asked for; do not wait for it.
+  if(steps.empty()) {
+    emit sequenceFinished(0);
+    return;
   }
 
-  for (size_t exp_num = 0; exp_num < mExposureQuanity; exp_num++) {
+  // Dark current depends steeply on temperature, so do not start until the
+  // CCD has reached the set point.
+  if(!waitForCooler()) {
+    emit sequenceFinished(0);
+    return;
+  }
+
+  // Fraction of wall time the shutter is open, and where the rest goes.
+  // With several cameras this shows whether one is starving the others of
+  // driver time.
+  DutyCycleAccountant duty_cycle;
+  duty_cycle.beginSequence(timingLogName(mCatalogName + "_" + mObjectName));
+
+  int completed = 0;
+  runSteps(steps, duty_cycle, QDateTime(), completed);
+
+  qInfo() << getName() << "took" << completed << "exposures";
+  for(auto & line: duty_cycle.getSummary())
+    qInfo().noquote() << getName() << line;
+
+  emit sequenceFinished(completed);
+}
 
+void Worker::runPlan() {
+
+  if(mMainCamera == nullptr) {
+    qWarning() << "No camera available. Ignoring observation plan.";
+    emit sequenceFinished(0);
+    return;
+  }
+
+  if(mFilterWheel == nullptr) {
+    qWarning() << "No filter wheel available. Ignoring observation plan.";
+    emit sequenceFinished(0);
+    return;
+  }
+
+  QString error;
+  auto slot_to_filter = mFilterWheel->getSlotToFilterMap();
+  if(!mPlan.resolveSlots(slot_to_filter, error)) {
+    qWarning() << "Rejected observation plan:" << error;
+    emit sequenceFinished(0);
+    return;
+  }
+  mFilterMoves.setSlotCount(slot_to_filter.size());
+
+  if(mSetTemperature) {
+    mMainCamera->setTemperatureTarget(niad::TEMPERATURE_TYPE_SENSOR, true, mTemperatureTarget);
+  }
+  if(mPlan.getRemaining() == 0) {
+    qInfo() << getName() << "observation plan has no frames to take";
+    emit sequenceFinished(0);
+    return;
+  }
+  if(!waitForCooler()) {
+    emit sequenceFinished(0);
+    return;
+  }
+
+  DutyCycleAccountant duty_cycle;
+  duty_cycle.beginSequence(timingLogName("plan"));
+
+  // Predict the whole plan now; each target refines the frame overhead and
+  // filter move times, and the prediction is updated as it goes.
+  QDateTime plan_start = QDateTime::currentDateTimeUtc();
+  QDateTime predicted_end = plan_start.addMSecs(qint64(1000 *
+    mPlan.predictSeconds(plan_start, mFilterWheel->getActiveFilterSlot(), mFilterMoves)));
+  qInfo() << getName() << "plan of" << mPlan.getRemaining() << "frames on"
+          << mPlan.getTargets().size() << "targets predicted to finish at"
+          << predicted_end.toString(Qt::ISODate);
+
+  int completed = 0;
+  while(!mStopExposures) {
+
+    QDateTime now = QDateTime::currentDateTimeUtc();
+    QDateTime wait_until;
+    int index = mPlan.nextTarget(now, wait_until);
+    if(index < 0) {
+      if(!wait_until.isValid())
+        break;
+
+      // Nothing can be observed yet.
+      qInfo() << getName() << "waiting until" << wait_until.toString(Qt::ISODate)
+              << "for the next target";
+      while(!mStopExposures && QDateTime::currentDateTimeUtc() < wait_until)
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      continue;
+    }
+
+    ObservationPlan::Schedule schedule;
+    const PlanTarget & target = mPlan.getTargets()[index];
+    auto steps = mPlan.scheduleTarget(index, mFilterWheel->getActiveFilterSlot(),
+                                      mFilterMoves, schedule);
+    qInfo() << getName() << "observing" << target.catalog << target.object << ":"
+            << steps.size() << "frames,"
+            << (schedule.interleaved ? "interleaving" : "one block at a time")
+            << "(predicted filter moves" << schedule.blocked_moves << "s blocked,"
+            << schedule.interleaved_moves << "s interleaved)";
+
+    auto taken = runSteps(steps, duty_cycle, target.not_after, completed);
+    size_t n_taken = 0;
+    for(size_t i = 0; i < steps.size(); i++) {
+      if(taken[i]) {
+        mPlan.markDone(steps[i]);
+        n_taken++;
+      }
+    }
+
+    // Frames too long for what is left of the window were skipped. The next
+    // pass tries them again; give up only once none of them fit.
+    if(n_taken == 0 && !mStopExposures) {
+      qWarning() << getName() << target.catalog << target.object << "window closed with"
+                 << target.getRemaining() << "frames left";
+      mPlan.expireTarget(index);
+    }
+
+    if(duty_cycle.getFrameCount() > 0)
+      mPlan.setFrameOverhead(duty_cycle.getMeanOverhead());
+    now = QDateTime::currentDateTimeUtc();
+    qInfo() << getName() << mPlan.getRemaining() << "frames left, now predicted to finish at"
+            << now.addMSecs(qint64(1000 * mPlan.predictSeconds(
+                 now, mFilterWheel->getActiveFilterSlot(), mFilterMoves))).toString(Qt::ISODate)
+            << "(first predicted" << predicted_end.toString(Qt::ISODate) << ")";
+  }
+
+  QDateTime plan_end = QDateTime::currentDateTimeUtc();
+  qInfo() << getName() << "plan took" << completed << "exposures and finished at"
+          << plan_end.toString(Qt::ISODate) << "; predicted"
+          << predicted_end.toString(Qt::ISODate) << "("
+          << predicted_end.msecsTo(plan_end) / 1000.0 << "s late)";
+  for(auto & line: duty_cycle.getSummary())
+    qInfo().noquote() << getName() << line;
+
+  emit sequenceFinished(completed);
+}
+
+QString Worker::timingLogName(const QString & name) {
+  if(mImageAction == niad::CAMERA_IMAGE_ACTION_SEND)
+    return "";
+
+  // The per-frame log goes next to the images.
+  QString filename = QDateTime::currentDateTimeUtc().toString(Qt::ISODate) + "_" + name;
+  if(!mLabel.isEmpty())
+    filename += "_" + mLabel;
+  return mSaveDir.filePath(filename + "_timing.csv");
+}
+
+int Worker::findFilterSlot(const QString & filter_name) {
+  if(mFilterWheel == nullptr || filter_name.isEmpty())
+    return -1;
+
+  bool is_number = false;
+  int slot = filter_name.toInt(&is_number);
+  if(is_number)
+    return slot;
+
+  for(auto & it: mFilterWheel->getSlotToFilterMap()) {
+    if(QString::fromStdString(it.second) == filter_name)
+      return it.first;
+  }
+  return -1;
+}
+
+std::vector<bool> Worker::runSteps(const std::vector<ExposureStep> & steps,
+                                   DutyCycleAccountant & duty_cycle,
+                                   const QDateTime & deadline, int & completed) {
+
+  std::vector<bool> taken(steps.size(), false);
+  if(steps.empty())
+    return taken;
+
+  // Move the filter wheel on another thread, while the mount settles (and,
+  // for the first frame, while the defect map loads). Nothing else uses the
+  // wheel before the exposure.
+  std::future<void> filter_move;
+  QString requested_filter;
+  auto start_filter_move = [&](const ExposureStep & step) {
+    if(mFilterWheel == nullptr || step.filter.isEmpty() || step.filter == requested_filter)
+      return;
+    requested_filter = step.filter;
+    int from = int(mFilterWheel->getActiveFilterSlot());
+    if(step.slot == from)
+      return;
+    filter_move = std::async(std::launch::async, [this, step, from]() {
+      auto move_start = std::chrono::steady_clock::now();
+      applyFilter(step.filter);
+      mFilterMoves.record(from, step.slot, std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - move_start).count());
+    });
+  };
+  start_filter_move(steps[0]);
+
+  // Resolve the defect map once; it is cached for the lifetime of the process.
+  auto & defect_maps = DefectMapCache::getInstance();
+  std::string readout_mode_name = niad::CameraReadoutMode_Name(mReadoutMode);
+  std::string serial_number = mDevice->GetInfo().GetSerialNumber();
+  std::shared_ptr<DefectMap> defect_map = nullptr;
+  if(!mBuildDefectMap)
+    defect_map = defect_maps.get(mMainCamera->getName(), serial_number, readout_mode_name);
+  std::vector<std::shared_ptr<ImageData>> defect_frames;
+
+  // Both the cosmic ray cleaner and the auto-exposure controller need the
+  // detector's noise model.
+  double gain = mGain > 0 ? mGain : mMainCamera->getGain(mReadoutMode);
+  if(gain <= 0) {
+    gain = 1.3;
+    qWarning() << "Camera does not report its gain; assuming" << gain << "e-/ADU";
+  }
+  CosmicRayCleaner cosmic_ray_cleaner;
+  cosmic_ray_cleaner.setNoiseModel(gain, mReadNoise);
+
+  // Configure the auto-exposure controller within the camera's limits.
+  AutoExposure auto_exposure;
+  auto_exposure.setLevels(mBiasLevel, mSaturationLevel);
+  auto_exposure.setNoiseModel(gain, mReadNoise);
+  if(mAutoExposure) {
+    auto limits = mMainCamera->getExposureMinMax();
+    auto_exposure.setLimits(limits[0], limits[1]);
+    auto_exposure.setInitialDuration(steps[0].duration);
+    if(mAutoExposureMode == AutoExposure::MODE_LEVEL)
+      auto_exposure.setTargetLevel(mAutoExposureTarget);
+    else
+      auto_exposure.setTargetSNR(mAutoExposureTarget);
+  }
+
+  QString camera_label = getName();
+  bool store_image = mImageAction != niad::CAMERA_IMAGE_ACTION_SEND;
+  size_t exp_num = 0;
+  for (; exp_num < steps.size(); exp_num++) {
+
+    const ExposureStep & step = steps[exp_num];
     if(mStopExposures)
       break;
 
+    // Skip frames that cannot end before the deadline; a shorter one later
+    // in the list may still fit.
+    double exposure_duration = step.duration;
+    if(mAutoExposure)
+      exposure_duration = auto_exposure.getNextDuration();
+    if(deadline.isValid() &&
+       QDateTime::currentDateTimeUtc().addMSecs(qint64(exposure_duration * 1000)) > deadline) {
+      qDebug() << "Skipping exposure" << exp_num << "of" << exposure_duration
+               << "s, which would end after" << deadline.toString(Qt::ISODate);
+      continue;
+    }
+    duty_cycle.beginFrame();
+    if(exp_num > 0)
+      start_filter_move(step);
+
+    // Do not open the shutter while the mount is still moving.
+    if(!waitForMount())
+      break;
+    duty_cycle.lap(DutyCycleAccountant::PHASE_MOUNT_WAIT);
+
+    // Nor before the filter is in place.
+    if(filter_move.valid())
+      filter_move.get();
+    duty_cycle.lap(DutyCycleAccountant::PHASE_FILTER_MOVE);
+
+    if(!mFirstExposureLogged) {
+      qInfo() << camera_label << "time to first exposure"
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - mCreated).count() << "ms";
+      mFirstExposureLogged = true;
+    }
+
     qDebug() << "Starting exposure" << exp_num;
 
-    // Instruct the client to buffer positions
-    mClient->startBuffering();
+    // Mark the start of this exposure's coordinates.
+    uint64_t coordinates_start = mClient->getCoordinateSequence();
 
     // Take the image.
-    ImageData *image_data =
-      mMainCamera->acquireImage(mExposureDuration, mReadoutMode, mShutterAction);
-
-    // Instruct the client to stop buffering.
-    mClient->stopBuffering();
-
-    // Find the closest values that are applicable. Add them to the image.
-    auto coordinates = mClient->getCoordinates();
-    if(coordinates.size() > 0) {
-      size_t midpoint = coordinates.size() / 2;
-      auto & c = coordinates[midpoint];
-      if(c.type() == niad::COORDINATE_TYPE_RA_DEC) {
-        image_data->ra = c.position(0);
-        image_data->dec = c.position(1);
-        image_data->ra_dec_set = true;
-      } else if (c.type() == niad::COORDINATE_TYPE_AZM_ALT) {
-        image_data->azm = c.position(0);
-        image_data->alt = c.position(1);
-        image_data->azm_alt_set = true;
-      }
+    if(mAutoExposure)
+      qDebug() << "Auto-exposure duration" << exposure_duration;
+    emit exposureStarted(exp_num, steps.size(), exposure_duration);
+    duty_cycle.lap(DutyCycleAccountant::PHASE_OTHER);
+    auto acquire_start = DutyCycleAccountant::Clock::now();
+    std::shared_ptr<ImageData> image_data(
+      mMainCamera->acquireImage(exposure_duration, mReadoutMode, mShutterAction));
+    duty_cycle.addAcquisition(*image_data, acquire_start);
+
+    // Mark the end of this exposure's coordinates, including the updates
+    // still waiting in a decimation bucket.
+    mClient->flushCoordinates();
+    uint64_t coordinates_end = mClient->getCoordinateSequence();
+
+    if(image_data->aborted) {
+      mMetrics.frames_aborted++;
+    } else {
+      mMetrics.frames_acquired++;
+      mMetrics.exposure.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        image_data->exposure_end - image_data->exposure_start).count());
+      mMetrics.readout.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        image_data->readout_end - image_data->readout_start).count());
     }
 
-    auto mount_lla = mClient->getLLA();
-    if(mount_lla.position_size() > 0) {
-      image_data->latitude  = mount_lla.position(0);
-      image_data->longitude = mount_lla.position(1);
-      image_data->altitude  = mount_lla.position(2);
+    // Repair known hot pixels and bad columns, or keep the raw frame if a
+    // defect map is being built.
+    if(!image_data->aborted) {
+      if(mBuildDefectMap)
+        defect_frames.push_back(image_data);
+      else if(defect_map != nullptr)
+        image_data->defects_corrected = defect_map->apply(*image_data);
+    }
+
+    // Replace the image with a copy that has cosmic rays removed.
+    if(mCleanCosmicRays && !mBuildDefectMap && !image_data->aborted) {
+      auto result = cosmic_ray_cleaner.clean(*image_data);
+      qDebug() << "Removed" << result.hits << "cosmic rays"
+               << "(" << result.pixels << "pixels)";
+      image_data = result.cleaned;
+    }
+
+    // Feed the processed frame back to the auto-exposure controller.
+    if(mAutoExposure && !auto_exposure.update(*image_data))
+      qWarning() << "Exposure" << exp_num << "missed the auto-exposure target";
+    duty_cycle.lap(DutyCycleAccountant::PHASE_PROCESSING);
+
+    // Interpolate the pointing to the middle of the exposure.
+    auto coordinates = mClient->getCoordinates(coordinates_start, coordinates_end);
+    auto mount = mClient->getMountSnapshot();
+    int64_t midpoint_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      (image_data->exposure_start + (image_data->exposure_end - image_data->exposure_start) / 2)
+      .time_since_epoch()).count();
+
+    double position[2];
+    if(interpolatePosition(coordinates, niad::COORDINATE_TYPE_RA_DEC,
+                           midpoint_ns, position)) {
+      image_data->ra = position[0];
+      image_data->dec = position[1];
+      image_data->ra_dec_set = true;
+    }
+    if(interpolatePosition(coordinates, niad::COORDINATE_TYPE_AZM_ALT,
+                           midpoint_ns, position)) {
+      image_data->azm = position[0];
+      image_data->alt = position[1];
+      image_data->azm_alt_set = true;
+    }
+
+    // Keep every buffered sample so tracking errors can be studied later.
+    int64_t start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      image_data->exposure_start.time_since_epoch()).count();
+    // Measure the tracking error from the updates within the exposure.
+    double exposure_sec = std::chrono::duration<double>(
+      image_data->exposure_end - image_data->exposure_start).count();
+    TrackingError tracking_error;
+    auto & track = image_data->mount_track;
+    track.reserve(coordinates.size());
+    for(auto & c: coordinates) {
+      bool is_ra_dec = c.type == niad::COORDINATE_TYPE_RA_DEC;
+      bool is_azm_alt = c.type == niad::COORDINATE_TYPE_AZM_ALT;
+      if(!is_ra_dec && !is_azm_alt)
+        continue;
+      double t = (c.arrival_ns - start_ns) * 1E-9;
+      track.time.push_back(t);
+      track.ra.push_back(is_ra_dec ? c.position[0] : NAN);
+      track.dec.push_back(is_ra_dec ? c.position[1] : NAN);
+      track.azm.push_back(is_azm_alt ? c.position[0] : NAN);
+      track.alt.push_back(is_azm_alt ? c.position[1] : NAN);
+      if(is_ra_dec && t >= 0 && t <= exposure_sec)
+        tracking_error.add(t, c.position[0], c.position[1],
+                           c.position_min[0], c.position_max[0],
+                           c.position_min[1], c.position_max[1]);
+    }
+    tracking_error.apply(*image_data, mTrackingThreshold);
+    if(image_data->tracking_flagged)
+      qWarning() << "Exposure" << exp_num << "tracking error"
+                 << tracking_error.getPeak() << "arcsec exceeds"
+                 << mTrackingThreshold << "arcsec";
+
+    if(mount.has_lla) {
+      image_data->latitude  = mount.lla[0];
+      image_data->longitude = mount.lla[1];
+      image_data->altitude  = mount.lla[2];
     }
 
     // Populate the image with some additional information.
-    image_data->object_name = mObjectName.toStdString();
-    image_data->catalog_name = mCatalogName.toStdString();
+    image_data->object_name = step.object.toStdString();
+    image_data->catalog_name = step.catalog.toStdString();
+    duty_cycle.lap(DutyCycleAccountant::PHASE_COORDINATES);
+
+    // Hand the image to the network first. The sender drops old frames rather
+    // than blocking, so the FITS write below proceeds immediately.
+    bool send_image = mImageAction == niad::CAMERA_IMAGE_ACTION_SEND ||
+      mImageAction == niad::CAMERA_IMAGE_ACTION_SEND_AND_STORE;
+    if(send_image && !image_data->aborted)
+      mClient->sendImage(image_data);
+    if(mImageHub != nullptr && !image_data->aborted)
+      mImageHub->publishFrame(image_data);
+    duty_cycle.lap(DutyCycleAccountant::PHASE_SEND);
+
+    QString filename;
+    if(store_image) {
+      filename = QDateTime::currentDateTimeUtc().toString(Qt::ISODate) +
+        "_" + step.catalog + "_" + step.object;
+      if(!mLabel.isEmpty())
+        filename += "_" + mLabel;
+      filename += ".fits";
+      filename = mSaveDir.filePath(filename);
+      auto write_start = std::chrono::steady_clock::now();
+      image_data->saveToFITS(filename.toStdString(), true);
+      mMetrics.fits_write.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - write_start).count());
+      mMetrics.fits_bytes += QFileInfo(filename).size();
+      qDebug() << "Saved " << filename;
+    }
+    duty_cycle.lap(DutyCycleAccountant::PHASE_FITS_WRITE);
+
+    emit exposureFinished(exp_num, !image_data->aborted, filename,
+                          image_data->temperature);
+    taken[exp_num] = true;
+    if(!image_data->aborted)
+      completed++;
+    duty_cycle.endFrame(exp_num, image_data->aborted);
+    qInfo() << camera_label << "duty cycle" << duty_cycle.getFrameDutyCycle()
+            << "% this frame," << duty_cycle.getDutyCycle() << "% overall";
+  }
 
-    QString filename = QDateTime::currentDateTimeUtc().toString(Qt::ISODate) +
-      "_" + mCatalogName + "_" + mObjectName + ".fits";
-    filename = mSaveDir.filePath(filename);
-    image_data->saveToFITS(filename.toStdString(), true);
-    qDebug() << "Saved " << filename;
+  // Leave the wheel idle for whoever uses it next.
+  if(filter_move.valid())
+    filter_move.get();
 
-    // Delete the image data
-    delete image_data;
+  if(mBuildDefectMap && !defect_frames.empty()) {
+    auto map = DefectMap::build(defect_frames);
+    qInfo() << "Defect map:" << map->getHotPixelCount() << "hot pixels,"
+            << map->getBadColumnCount() << "bad columns";
+    if(!defect_maps.put(mMainCamera->getName(), serial_number, readout_mode_name, map))
+      qWarning() << "Failed to save defect map. Was a directory specified?";
   }
 
-  emit finished();
+  return taken;
+}
+
+bool Worker::waitForMount() {
+  using namespace std::chrono;
+
+  if(!mClient->isOpen() || !mClient->isConnected())
+    return true;
+
+  // A mount that never became ready should not cost every frame a timeout.
+  if(mMountTimedOut) {
+    if(mClient->getReadyCount() == mMountTimeoutReadyCount)
+      return true;
+    mMountTimedOut = false;
+  }
+
+  // Poll often enough that the exposure starts promptly once stable.
+  const auto poll = milliseconds(20);
+  auto start = steady_clock::now();
+  auto deadline = start + duration_cast<steady_clock::duration>(duration<double>(mMountTimeout));
+
+  while(!mStopExposures) {
+
+    if(steady_clock::now() > deadline) {
+      qWarning() << "Mount did not settle within" << mMountTimeout
+                 << "s (velocity" << mSettleDetector.getVelocity()
+                 << "arcsec/s, jitter" << mSettleDetector.getJitter()
+                 << "arcsec). Exposing anyway.";
+      mMountTimedOut = true;
+      mMountTimeoutReadyCount = mClient->getReadyCount();
+      return true;
+    }
+
+    if(mClient->isMountReady()) {
+      int64_t now_ns = duration_cast<nanoseconds>(
+        high_resolution_clock::now().time_since_epoch()).count();
+      auto recent = mClient->getRecentCoordinates(4096);
+      if(mSettleDetector.update(recent, now_ns)) {
+        qDebug() << "Mount settled after"
+                 << duration_cast<milliseconds>(steady_clock::now() - start).count()
+                 << "ms (velocity" << mSettleDetector.getVelocity()
+                 << "arcsec/s, jitter" << mSettleDetector.getJitter() << "arcsec)";
+        return true;
+      }
+
+      // Without RA/DEC updates settling cannot be judged; readiness is all
+      // we have to go on.
+      int64_t window_ns = int64_t(mSettleDetector.getWindow() * 1E9);
+      bool stream_is_live = false;
+      for(auto & c: recent) {
+        if(c.type == niad::COORDINATE_TYPE_RA_DEC && c.arrival_ns > now_ns - 2 * window_ns)
+          stream_is_live = true;
+      }
+      if(!stream_is_live && steady_clock::now() - start > 2 * duration<double>(mSettleDetector.getWindow())) {
+        qWarning() << "Mount is ready but is not streaming RA/DEC; not waiting to settle.";
+        return true;
+      }
+    }
+
+    std::this_thread::sleep_for(poll);
+  }
+
+  return false;
+}
+
+bool Worker::waitForCooler() {
+  using namespace std::chrono;
+
+  if(!mSetTemperature || mTemperatureTarget >= 40 || mCoolerTimeout <= 0)
+    return true;
+
+  // Use the background readings when there are any; otherwise read the
+  // temperature here at a similar rate.
+  auto sampler = mDevice->GetTemperatureSampler();
+  const auto poll = duration<double>(sampler != nullptr ? sampler->GetPeriod() : 1.0);
+  auto origin = high_resolution_clock::now();
+  auto start = steady_clock::now();
+  auto deadline = start + duration_cast<steady_clock::duration>(duration<double>(mCoolerTimeout));
+  auto seconds = [&](high_resolution_clock::time_point t) {
+    return duration<double>(t - origin).count();
+  };
+
+  std::vector<double> times, temperatures;
+  auto next_log = start;
+  int bias_frames = 0;
+  while(!mStopExposures) {
+
+    auto now = high_resolution_clock::now();
+    if(sampler != nullptr) {
+      times.clear();
+      temperatures.clear();
+      for(auto & sample: sampler->GetHistory()) {
+        // Readings from before the set point changed do not belong to the fit.
+        if(std::fabs(sample.info.main_camera_temperature_setpoint - mTemperatureTarget) > 0.25) {
+          times.clear();
+          temperatures.clear();
+          continue;
+        }
+        times.push_back(seconds(sample.time));
+        temperatures.push_back(sample.info.main_camera_temperature);
+      }
+    } else {
+      times.push_back(seconds(now));
+      temperatures.push_back(getSensorTemperature());
+    }
+
+    if(mCoolerGate.update(times, temperatures, mTemperatureTarget, seconds(now))) {
+      qInfo() << "CCD stable at" << mCoolerGate.getTemperature() << "C after"
+              << duration_cast<milliseconds>(steady_clock::now() - start).count()
+              << "ms and" << bias_frames << "bias frames";
+      return true;
+    }
+
+    double wait = mCoolerGate.getTimeToStable();
+    if(steady_clock::now() > deadline) {
+      qWarning() << "CCD did not stabilize within" << mCoolerTimeout << "s (at"
+                 << mCoolerGate.getTemperature() << "C, set point"
+                 << mTemperatureTarget << "C). Exposing anyway.";
+      return true;
+    }
+
+    // A fit covering several time constants has found the final temperature;
+    // if that misses the set point, waiting longer will not help.
+    double span = times.empty() ? 0 : times.back() - times.front();
+    if(std::isinf(wait) && span > 3 * mCoolerGate.getTimeConstant()) {
+      qWarning() << "CCD is settling at" << mCoolerGate.getAsymptote()
+                 << "C and will not reach the set point of" << mTemperatureTarget
+                 << "C. Exposing anyway.";
+      return true;
+    }
+
+    if(steady_clock::now() >= next_log) {
+      qInfo() << "Waiting for the CCD: at" << mCoolerGate.getTemperature()
+              << "C, settling at" << mCoolerGate.getAsymptote()
+              << "C with time constant" << mCoolerGate.getTimeConstant()
+              << "s, stable in" << wait << "s";
+      next_log = steady_clock::now() + std::chrono::seconds(30);
+    }
+
+    // Bias frames need no light and little time, so they are a free use of
+    // the wait. Each records its own temperature.
+    bool store_image = mImageAction != niad::CAMERA_IMAGE_ACTION_SEND;
+    if(mBiasWhileCooling && store_image) {
+      double duration = mMainCamera->getExposureMinMax()[0];
+      std::shared_ptr<ImageData> bias(
+        mMainCamera->acquireImage(duration, mReadoutMode,
+                                  niad::CAMERA_SHUTTER_ACTION_CLOSE_CLOSE));
+      if(!bias->aborted) {
+        bias->image_type = "BIAS";
+        bias->object_name = "BIAS";
+        bias->catalog_name = mCatalogName.toStdString();
+        QString filename = QDateTime::currentDateTimeUtc().toString(Qt::ISODate) + "_BIAS";
+        if(!mLabel.isEmpty())
+          filename += "_" + mLabel;
+        filename = mSaveDir.filePath(filename + ".fits");
+        bias->saveToFITS(filename.toStdString(), true);
+        qDebug() << "Saved " << filename << "at" << bias->temperature << "C";
+        bias_frames++;
+      }
+      continue;
+    }
+
+    std::this_thread::sleep_for(poll);
+  }
+
+  return false;
 }
 
 int Worker::setupCamera() {
@@ -102,11 +723,12 @@ int Worker::setupCamera() {
   using namespace std;
 
   // Set up the SBIG camera.
-  string c_name = "ST-10";
-  string f_name = "CFW-8";
+  string c_name = mCameraModel.toStdString();
+  string f_name = mFilterWheelModel.toStdString();
   auto &driver = SbigSTDriver::GetInstance();
   // find a device matching those specifications
-  auto info = driver.FindDevice(c_name, f_name);
+  auto info = driver.FindDevice(c_name, f_name, mCameraSerial.toStdString(),
+                                mCameraSkip);
   if (!info.IsValidDevice()) {
     qInfo() << "Failed to find the specified device.";
     return -1;
@@ -135,6 +757,7 @@ int Worker::setupCamera() {
 
   // Get a shared pointer to the cameras and filter wheel.
   auto device = driver.OpenDevice(info);
+  mDevice = device;
   mMainCamera = device->GetMainCamera();
   mGuideCamera = device->GetGuideCamera();
   mFilterWheel = device->GetFilterWheel();
@@ -151,6 +774,10 @@ int Worker::setupCamera() {
     return -1;
   }
 
+  // Read the temperatures in the background from now on.
+  if (mTelemetryPeriod > 0)
+    device->StartTemperatureSampler(mTelemetryPeriod);
+
   // Print out information on the discovered device.
   qInfo() << "Found " << QString::fromStdString(c_name)
           << " with " << QString::fromStdString(f_name);
@@ -204,12 +831,152 @@ void Worker::setSaveDir(const QString &directory) {
   mSaveDir = directory;
 }
 
+void Worker::setDevice(const QString & camera_model,
+                       const QString & filter_wheel_model,
+                       const QString & serial_number, int skip) {
+  mCameraModel = camera_model;
+  mFilterWheelModel = filter_wheel_model;
+  mCameraSerial = serial_number;
+  mCameraSkip = skip;
+}
+
+void Worker::setLabel(const QString & label) {
+  mLabel = label;
+}
+
+void Worker::setPlan(const ObservationPlan & plan) {
+  mPlan = plan;
+}
+
+void Worker::applyFilter(const QString & filter_name) {
+  if(mFilterWheel == nullptr)
+    return;
+
+  // Check to see if the filter is a number
+  mFilterName = filter_name;
+  bool filter_name_is_number = false;
+  int filter_id = mFilterName.toInt(&filter_name_is_number);
+  if (filter_name_is_number) {
+    mFilterWheel->setFilter(filter_id);
+  } else {
+    mFilterWheel->setFilter(mFilterName.toStdString());
+  }
+}
+
+void Worker::applyTemperature(double temperature) {
+  if(mMainCamera == nullptr)
+    return;
+
+  setTemperature(temperature);
+  mMainCamera->setTemperatureTarget(niad::TEMPERATURE_TYPE_SENSOR,
+                                    temperature < 40, mTemperatureTarget);
+}
+
+double Worker::getSensorTemperature() {
+  if(mMainCamera == nullptr)
+    return NAN;
+
+  // A recent background reading saves a driver round trip.
+  TemperatureSample sample;
+  auto sampler = mDevice->GetTemperatureSampler();
+  if(sampler != nullptr && sampler->GetLatest(sample) &&
+     std::chrono::high_resolution_clock::now() - sample.time <
+     std::chrono::duration<double>(2 * sampler->GetPeriod()))
+    return sample.info.main_camera_temperature;
+
+  return mMainCamera->getTemperature(niad::TEMPERATURE_TYPE_SENSOR);
+}
+
+void Worker::setTelemetryPeriod(double seconds) {
+  mTelemetryPeriod = seconds;
+}
+
+bool Worker::getLatestTemperature(TemperatureSample & sample) {
+  if(!mReady || mDevice->GetTemperatureSampler() == nullptr)
+    return false;
+  return mDevice->GetTemperatureSampler()->GetLatest(sample);
+}
+
+std::vector<TemperatureSample> Worker::getTemperatureHistory() {
+  if(mDevice == nullptr || mDevice->GetTemperatureSampler() == nullptr)
+    return std::vector<TemperatureSample>();
+  return mDevice->GetTemperatureSampler()->GetHistory();
+}
+
 void Worker::stopExposures() {
   mStopExposures = true;
 
-  mMainCamera->abortExposure();
+  // For SBIG devices this also stops the guide camera, the readout and any
+  // filter wheel move. Before initialize() the flag alone is enough.
+  auto camera = getCamera();
+  if(camera != nullptr)
+    camera->abortExposure();
+}
+
+void Worker::clearStop() {
+  mStopExposures = false;
 }
 
 void Worker::setShutterAction(niad::CameraShutterAction action) {
   mShutterAction = action;
 }
+
+void Worker::setSettleThresholds(double velocity, double jitter, double window) {
+  mSettleDetector.setThresholds(velocity, jitter, window);
+}
+
+void Worker::setMountTimeout(double seconds) {
+  mMountTimeout = seconds;
+}
+
+void Worker::setCoolerThresholds(double tolerance, double hold, double timeout) {
+  mCoolerGate.setThresholds(tolerance, hold);
+  mCoolerTimeout = timeout;
+}
+
+void Worker::setBiasWhileCooling(bool enable) {
+  mBiasWhileCooling = enable;
+}
+
+void Worker::setTrackingThreshold(double arcsec) {
+  mTrackingThreshold = arcsec;
+}
+
+void Worker::setImageHub(FanoutHub * hub) {
+  mImageHub = hub;
+}
+
+void Worker::setImageAction(niad::CameraImageAction action) {
+  mImageAction = action;
+}
+
+void Worker::setDefectMapDir(const QString & directory) {
+  DefectMapCache::getInstance().setDirectory(directory.toStdString());
+}
+
+void Worker::setBuildDefectMap(bool build) {
+  mBuildDefectMap = build;
+}
+
+void Worker::setCleanCosmicRays(bool clean) {
+  mCleanCosmicRays = clean;
+}
+
+void Worker::setAutoExposureLevel(double level) {
+  mAutoExposure = true;
+  mAutoExposureMode = AutoExposure::MODE_LEVEL;
+  mAutoExposureTarget = level;
+}
+
+void Worker::setAutoExposureSNR(double snr) {
+  mAutoExposure = true;
+  mAutoExposureMode = AutoExposure::MODE_SNR;
+  mAutoExposureTarget = snr;
+}
+
+void Worker::setDetectorModel(double bias, double saturation, double gain, double read_noise) {
+  mBiasLevel = bias;
+  mSaturationLevel = saturation;
+  mGain = gain;
+  mReadNoise = read_noise;
+}
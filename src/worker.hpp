@@ -7,7 +7,19 @@
 #include "sbig_st_driver.hpp"
 
 // local includes
+#include "acquisition_metrics.hpp"
 #include "client.hpp"
+#include "cooler_gate.hpp"
+#include "duty_cycle.hpp"
+#include "fanout_hub.hpp"
+#include "observation_plan.hpp"
+#include "settle_detector.hpp"
+
+// project includes
+#include "defect_map.hpp"
+#include "cosmic_ray.hpp"
+#include "auto_exposure.hpp"
+#include "tracking_error.hpp"
 
 // External includes
 #include "niad.pb.h"
@@ -17,6 +29,7 @@
 #include <QDateTime>
 #include <QDir>
 #include <QWebSocket>
+#include <chrono>
 #include <memory>
 #include <QWebSocket>
 
@@ -38,7 +51,28 @@ protected:
   /// NIAD client object.
   Client * mClient = nullptr;
 
+  /// Hub that distributes frames to local subscribers, if any.
+  FanoutHub * mImageHub = nullptr;
+
 protected:
+  /// Camera model to open, e.g. "ST-10".
+  QString mCameraModel = "ST-10";
+
+  /// Model of the filter wheel attached to the camera.
+  QString mFilterWheelModel = "CFW-8";
+
+  /// Serial number of the camera. Empty accepts any camera of mCameraModel.
+  QString mCameraSerial = "";
+
+  /// Number of matching cameras to pass over when no serial is given.
+  int mCameraSkip = 0;
+
+  /// Name of this camera in file names and logs. Empty when there is one camera.
+  QString mLabel = "";
+
+  /// Shared pointer to the SBIG device holding the cameras.
+  std::shared_ptr<SbigSTDevice> mDevice;
+
   /// Shared pointer to the main camera
   std::shared_ptr<Camera> mMainCamera;
 
@@ -74,16 +108,162 @@ protected:
 
   niad::CameraShutterAction mShutterAction = niad::CAMERA_SHUTTER_ACTION_OPEN_CLOSE;
 
+  /// What to do with each image once it has been acquired.
+  niad::CameraImageAction mImageAction = niad::CAMERA_IMAGE_ACTION_STORE;
+
+  /// If true, the sequence is treated as darks and used to build a defect map.
+  bool mBuildDefectMap = false;
+
+  /// If true, cosmic rays are removed from each image before it is saved.
+  bool mCleanCosmicRays = false;
+
+  /// If true, mExposureDuration is only the first duration; later durations
+  /// are predicted from the frames by an AutoExposure controller.
+  bool mAutoExposure = false;
+
+  /// Quantity the auto-exposure controller should target.
+  AutoExposure::Mode mAutoExposureMode = AutoExposure::MODE_LEVEL;
+
+  /// Target median level (ADU) or SNR for auto-exposure.
+  double mAutoExposureTarget = 0;
+
+  /// Bias level of the detector (ADU).
+  double mBiasLevel = 100;
+
+  /// Level above which pixels are unreliable (ADU).
+  double mSaturationLevel = 60000;
+
+  /// Detector gain (electrons / ADU). 0 uses the gain the camera reports.
+  double mGain = 0;
+
+  /// Detector read noise (electrons).
+  double mReadNoise = 8.8;
+
+  /// Decides when the mount has stopped moving before each exposure.
+  SettleDetector mSettleDetector;
+
+  /// Longest wait for the mount to become ready and settle (seconds).
+  double mMountTimeout = 120;
+
+  /// Whether waitForMount() last gave up, and the mount's ready count at
+  /// the time. The wait is skipped until the mount reports ready again.
+  bool mMountTimedOut = false;
+  uint64_t mMountTimeoutReadyCount = 0;
+
+  /// Decides when the CCD temperature has stabilized after a set point change.
+  CoolerGate mCoolerGate;
+
+  /// Longest wait for the CCD temperature to stabilize (seconds). 0 disables
+  /// the wait.
+  double mCoolerTimeout = 1800;
+
+  /// If true, bias frames are taken while waiting for the CCD temperature.
+  bool mBiasWhileCooling = false;
+
+  /// Peak tracking error above which images are flagged (arcsec). 0 disables.
+  double mTrackingThreshold = 0;
+
+  /// When this worker was created. Startup times are measured from here.
+  std::chrono::steady_clock::time_point mCreated = std::chrono::steady_clock::now();
+
+  /// True once the time to the first exposure has been logged.
+  bool mFirstExposureLogged = false;
+
+  /// Time between background temperature readings (seconds). 0 disables them.
+  double mTelemetryPeriod = 5;
+
+  /// Set once initialize() has succeeded; mDevice, mMainCamera and
+  /// mFilterWheel are fixed from then on and may be read from other threads.
+  std::atomic<bool> mReady{false};
+
+  /// Counters for the metrics endpoint.
+  AcquisitionMetrics mMetrics;
+
+  /// Plan run by run() instead of a single sequence, if it has targets.
+  ObservationPlan mPlan;
+
+  /// Filter wheel move times measured so far.
+  FilterMoveModel mFilterMoves;
+
 public slots:
 
-  /// Slot to begin the thread.
+  /// Slot to begin the thread. Initializes the camera, runs one exposure
+  /// sequence or the observation plan, and emits finished().
   void run();
 
+  /// Connect to and initialize the camera and filter wheel.
+  /// \return True on success.
+  bool initialize();
+
+  /// Take one exposure sequence using the current settings. The camera must
+  /// have been initialized.
+  void runSequence();
+
+  /// Run the observation plan set by setPlan(). The camera must have been
+  /// initialized. Logs the predicted and actual completion times.
+  void runPlan();
+
+  /// Move the filter wheel immediately.
+  /// \param filter_name Name or slot number of the filter.
+  void applyFilter(const QString & filter_name);
+
+  /// Change the cooler set point immediately.
+  /// \param temperature Set point (Celsius). Values >= +40 C disable cooling.
+  void applyTemperature(double temperature);
+
 signals:
   /// Signal to indicate that all camera-related operations have completed.
   void finished();
 
+  /// Emitted once the camera has been initialized (or failed to).
+  void initialized(bool success);
+
+  /// Emitted as each exposure begins.
+  void exposureStarted(int index, int quantity, double duration);
+
+  /// Emitted once each exposure has been processed and stored.
+  /// \param filename Name of the FITS file, empty if the image was not stored.
+  void exposureFinished(int index, bool success, QString filename, double temperature);
+
+  /// Emitted when an exposure sequence ends.
+  /// \param completed Number of exposures that were not aborted.
+  void sequenceFinished(int completed);
+
 protected:
+  /// Wait until the mount reports ready and its coordinates show it has
+  /// settled. Returns immediately if no mount is connected. Gives up with a
+  /// warning after mMountTimeout, and then does not wait again until the
+  /// mount reports ready anew.
+  /// \return False if exposures were stopped while waiting.
+  bool waitForMount();
+
+  /// Wait until the CCD temperature has stabilized at the set point. Returns
+  /// immediately if cooling is off. Gives up with a warning after
+  /// mCoolerTimeout, or sooner if the cooler is predicted never to get there.
+  /// \return False if exposures were stopped while waiting.
+  bool waitForCooler();
+
+  /// Take a list of exposures, moving the filter wheel between them as needed.
+  /// \param steps Exposures to take, in order.
+  /// \param duty_cycle Accountant to charge each frame to.
+  /// \param deadline Skip frames that would end after this, using the
+  ///        auto-exposure duration when it is on. Invalid for no deadline.
+  /// \param completed Incremented for each frame that was not aborted.
+  /// \return Whether each step was taken, aborted or not.
+  std::vector<bool> runSteps(const std::vector<ExposureStep> & steps,
+                  DutyCycleAccountant & duty_cycle,
+                  const QDateTime & deadline, int & completed);
+
+  /// Get the name of the per-frame timing log for a sequence.
+  /// \param name Describes the sequence, e.g. catalog_object.
+  /// \return Path in the save directory, or empty if images are not stored.
+  QString timingLogName(const QString & name);
+
+  /// Find the filter wheel slot of a filter.
+  /// \param filter_name Name or slot number of the filter.
+  /// \return The slot, or -1 if unknown.
+  int findFilterSlot(const QString & filter_name);
+
   /// Connect to the specified camera(s) and filter wheel and initialize them.
   /// \return Non-zero value on any failure
   int setupCamera();
@@ -140,12 +320,128 @@ public:
   /// \param directory Directory into which files should be saved.
   void setSaveDir(const QString & directory);
 
+  /// Choose the camera and filter wheel opened by initialize().
+  /// \param camera_model Camera model, e.g. "ST-10".
+  /// \param filter_wheel_model Filter wheel model, e.g. "CFW-8".
+  /// \param serial_number Serial number of the camera. Empty accepts any.
+  /// \param skip Number of matching cameras to pass over, so that several
+  ///        workers can share identical models without serial numbers.
+  void setDevice(const QString & camera_model, const QString & filter_wheel_model,
+                 const QString & serial_number = "", int skip = 0);
+
+  /// Name this camera when several are in use. The label is appended to
+  /// file names and prefixed to duty cycle reports.
+  /// \param label Short name for the camera.
+  void setLabel(const QString & label);
+
+  /// Run an observation plan instead of a single sequence. Takes effect in
+  /// run().
+  void setPlan(const ObservationPlan & plan);
+
+  /// Get the camera being controlled, or nullptr until initialize() has
+  /// succeeded. Safe to call from any thread.
+  std::shared_ptr<Camera> getCamera() { return mReady ? mMainCamera : nullptr; }
+
+  /// Get the filter wheel being controlled, or nullptr until initialize()
+  /// has succeeded. Safe to call from any thread.
+  std::shared_ptr<FilterWheel> getFilterWheel() { return mReady ? mFilterWheel : nullptr; }
+
+  /// Read the sensor temperature (Celsius). NaN before initialize().
+  double getSensorTemperature();
+
+  /// Set the time between background temperature readings. Takes effect in
+  /// initialize().
+  /// \param seconds Period (seconds). 0 disables the readings.
+  void setTelemetryPeriod(double seconds);
+
+  /// Get the newest background temperature reading. Safe from any thread.
+  /// \return False before initialize() or if there is no reading yet.
+  bool getLatestTemperature(TemperatureSample & sample);
+
+  /// Get the counters kept while acquiring. Safe to read from any thread.
+  const AcquisitionMetrics & getMetrics() const { return mMetrics; }
+
+  /// Get the name of this camera in logs: its label, or its model if there
+  /// is no label.
+  QString getName() const { return mLabel.isEmpty() ? mCameraModel : mLabel; }
+
+  /// Get every background temperature reading kept so far, oldest first.
+  /// Safe from any thread once initialize() has finished.
+  std::vector<TemperatureSample> getTemperatureHistory();
+
   /// Indicate to the worker thread that exposures should stop.
   void stopExposures();
 
+  /// Allow exposures again after stopExposures(). Call when a new sequence
+  /// is accepted, not when it starts, so an abort sent in between is kept.
+  void clearStop();
+
   /// Sets the action (if any) the shutter should take
   void setShutterAction(niad::CameraShutterAction action);
 
+  /// Set the conditions under which the mount is considered settled.
+  /// \param velocity Largest settled velocity (arcsec/s).
+  /// \param jitter Largest settled RMS scatter (arcsec).
+  /// \param window Time over which the mount is evaluated (seconds).
+  void setSettleThresholds(double velocity, double jitter, double window);
+
+  /// Set the longest time to wait for the mount to settle before an exposure.
+  /// \param seconds Timeout (seconds).
+  void setMountTimeout(double seconds);
+
+  /// Set when the CCD temperature is considered stable before a sequence.
+  /// \param tolerance Largest stable offset from the set point (Celsius).
+  /// \param hold Time the CCD must stay within tolerance (seconds).
+  /// \param timeout Longest wait (seconds). 0 starts exposing immediately.
+  void setCoolerThresholds(double tolerance, double hold, double timeout);
+
+  /// Take bias frames while waiting for the CCD temperature to stabilize.
+  /// They are stored like any other image, with IMAGETYP = BIAS.
+  void setBiasWhileCooling(bool enable);
+
+  /// Flag images whose peak tracking error exceeds a threshold.
+  /// \param arcsec Threshold (arcsec). Zero or less disables flagging.
+  void setTrackingThreshold(double arcsec);
+
+  /// Publish every image to the subscribers of a hub.
+  /// \param hub The hub. Not owned. nullptr disables publishing.
+  void setImageHub(FanoutHub * hub);
+
+  /// Sets whether images are stored locally, sent to the NIAD server, or both.
+  void setImageAction(niad::CameraImageAction action);
+
+  /// Sets the directory holding hot pixel / bad column maps. When set, each
+  /// image is corrected in place using the map for its detector and readout
+  /// mode.
+  /// \param directory Directory containing defect map files.
+  void setDefectMapDir(const QString & directory);
+
+  /// Use the exposure sequence (which should be darks or biases) to build a
+  /// defect map. The map is written to the defect map directory.
+  void setBuildDefectMap(bool build);
+
+  /// Remove cosmic rays from each image before it is sent or saved.
+  void setCleanCosmicRays(bool clean);
+
+  /// Choose each exposure duration so the median frame level reaches the
+  /// target. Intended for twilight flats. The duration set by
+  /// setExposureDuration() is used for the first frame.
+  /// \param level Target median level (ADU).
+  void setAutoExposureLevel(double level);
+
+  /// Choose each exposure duration so the brightest star reaches the
+  /// specified signal-to-noise ratio.
+  /// \param snr Target signal-to-noise ratio.
+  void setAutoExposureSNR(double snr);
+
+  /// Describe the detector to the auto-exposure controller and cosmic ray
+  /// cleaner.
+  /// \param bias Bias level (ADU).
+  /// \param saturation Level above which pixels are unreliable (ADU).
+  /// \param gain Gain (electrons / ADU). 0 uses the gain the camera reports.
+  /// \param read_noise Read noise (electrons).
+  void setDetectorModel(double bias, double saturation, double gain, double read_noise);
+
       //
   }; // Worker
 